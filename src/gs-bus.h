@@ -28,6 +28,7 @@
 #define SYSTEMD_LOGIND_INTERFACE        "org.freedesktop.login1.Manager"
 
 #define SYSTEMD_LOGIND_SESSION_INTERFACE "org.freedesktop.login1.Session"
+#define SYSTEMD_LOGIND_SEAT_INTERFACE   "org.freedesktop.login1.Seat"
 
 /* UPower */
 #define UP_SERVICE                      "org.freedesktop.UPower"
@@ -60,5 +61,8 @@
 #define GS_PATH_GNOME                   "/org/gnome/ScreenSaver"
 #define GS_INTERFACE_GNOME              "org.gnome.ScreenSaver"
 
+/* light-locker specific, exported on GS_PATH */
+#define LL_DIAGNOSTICS_INTERFACE        "org.lightlocker.Diagnostics"
+
 #endif
 
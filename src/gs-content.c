@@ -22,6 +22,9 @@
 
 #include "config.h"
 
+#include <locale.h>
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gdk/gdk.h>
 
@@ -39,6 +42,24 @@
 #define CURVE_RADIUS(s) ((s)*0.3)
 #define CURVE_BEZIER(s) (CURVE_RADIUS(s)*0.447715)
 
+/* The content doesn't depend on the window size, it is painted at
+ * the center, so one surface serves every window. */
+typedef struct {
+        int    scale;
+        char  *locale;
+} CacheKey;
+
+typedef struct {
+        cairo_surface_t *surface;
+        /* Position of the surface relative to the center. */
+        int              x;
+        int              y;
+} CacheEntry;
+
+static GHashTable *cache = NULL;
+static guint       cache_hits = 0;
+static guint       cache_misses = 0;
+
 static void
 draw_lock_icon (cairo_t *cr,
                 int size)
@@ -70,24 +91,16 @@ draw_lock_icon (cairo_t *cr,
         cairo_stroke (cr);
 }
 
-void
-content_draw (GtkWidget *widget,
-              cairo_t   *cr)
+static void
+content_render (cairo_t      *cr,
+                PangoContext *context)
 {
-        PangoContext *context;
         PangoLayout *title_layout;
         PangoLayout *sub_layout;
         PangoFontDescription *desc;
         int width, height;
         int sub_width;
 
-        width = gdk_window_get_width (gtk_widget_get_window (widget));
-        height = gdk_window_get_height (gtk_widget_get_window (widget));
-
-        cairo_translate (cr, width / 2, height / 2);
-
-        context = gdk_pango_context_get_for_screen (gtk_widget_get_screen (widget));
-
         title_layout = pango_layout_new (context);
         pango_layout_set_text (title_layout, _("This session is locked"), -1);
         desc = pango_font_description_from_string (TITLE_FONT);
@@ -128,5 +141,202 @@ content_draw (GtkWidget *widget,
         pango_cairo_show_layout (cr, sub_layout);
 
         g_object_unref (sub_layout);
+}
+
+static guint
+cache_key_hash (gconstpointer data)
+{
+        const CacheKey *key = data;
+
+        return key->scale * 31 + g_str_hash (key->locale);
+}
+
+static gboolean
+cache_key_equal (gconstpointer a,
+                 gconstpointer b)
+{
+        const CacheKey *key_a = a;
+        const CacheKey *key_b = b;
+
+        return key_a->scale == key_b->scale
+                && strcmp (key_a->locale, key_b->locale) == 0;
+}
+
+static void
+cache_key_free (gpointer data)
+{
+        CacheKey *key = data;
+
+        g_free (key->locale);
+        g_slice_free (CacheKey, key);
+}
+
+static void
+cache_entry_free (gpointer data)
+{
+        CacheEntry *entry = data;
+
+        cairo_surface_destroy (entry->surface);
+        g_slice_free (CacheEntry, entry);
+}
+
+static void
+content_cache_invalidate (void)
+{
+        if (cache == NULL || g_hash_table_size (cache) == 0) {
+                return;
+        }
+
+        gs_debug ("Dropping %u cached content surfaces", g_hash_table_size (cache));
+
+        g_hash_table_remove_all (cache);
+}
+
+static void
+content_cache_watch_screen (GdkScreen *screen)
+{
+        GtkSettings *settings;
+
+        if (g_object_get_data (G_OBJECT (screen), "gs-content-cache") != NULL) {
+                return;
+        }
+
+        g_object_set_data (G_OBJECT (screen), "gs-content-cache", GINT_TO_POINTER (TRUE));
+
+        /* Anything that changes the font rendering or the geometry
+         * invalidates the rendered content. */
+        g_signal_connect (screen, "notify::font-options",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+        g_signal_connect (screen, "notify::resolution",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+        g_signal_connect (screen, "monitors-changed",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+        g_signal_connect (screen, "size-changed",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+
+        settings = gtk_settings_get_for_screen (screen);
+        g_signal_connect (settings, "notify::gtk-fontconfig-timestamp",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+        g_signal_connect (settings, "notify::gtk-xft-dpi",
+                          G_CALLBACK (content_cache_invalidate), NULL);
+}
+
+static int
+round_down (double value)
+{
+        int result = (int) value;
+
+        return result > value ? result - 1 : result;
+}
+
+static int
+round_up (double value)
+{
+        int result = (int) value;
+
+        return result < value ? result + 1 : result;
+}
+
+static CacheEntry *
+content_cache_render (GtkWidget *widget)
+{
+        PangoContext    *context;
+        cairo_surface_t *recording;
+        cairo_t         *cr;
+        CacheEntry      *entry;
+        double           x, y, width, height;
+
+        context = gdk_pango_context_get_for_screen (gtk_widget_get_screen (widget));
+
+        /* Record once to find out how large the content is. */
+        recording = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+        cr = cairo_create (recording);
+        content_render (cr, context);
+        cairo_destroy (cr);
+
+        cairo_recording_surface_ink_extents (recording, &x, &y, &width, &height);
+
+        entry = g_slice_new (CacheEntry);
+        entry->x = round_down (x);
+        entry->y = round_down (y);
+        entry->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                                            CAIRO_CONTENT_COLOR_ALPHA,
+                                                            MAX (1, round_up (x + width) - entry->x),
+                                                            MAX (1, round_up (y + height) - entry->y));
+
+        cr = cairo_create (entry->surface);
+        cairo_set_source_surface (cr, recording, - entry->x, - entry->y);
+        cairo_paint (cr);
+        cairo_destroy (cr);
+
+        cairo_surface_destroy (recording);
         g_object_unref (context);
+
+        return entry;
+}
+
+void
+content_draw (GtkWidget *widget,
+              cairo_t   *cr)
+{
+        CacheKey    key;
+        CacheEntry *entry;
+        int         width, height;
+
+        width = gdk_window_get_width (gtk_widget_get_window (widget));
+        height = gdk_window_get_height (gtk_widget_get_window (widget));
+#if GTK_CHECK_VERSION (3, 10, 0)
+        key.scale = gtk_widget_get_scale_factor (widget);
+#else
+        key.scale = 1;
+#endif
+        key.locale = setlocale (LC_MESSAGES, NULL);
+        if (key.locale == NULL) {
+                key.locale = "C";
+        }
+
+        if (cache == NULL) {
+                cache = g_hash_table_new_full (cache_key_hash,
+                                               cache_key_equal,
+                                               cache_key_free,
+                                               cache_entry_free);
+        }
+
+        entry = g_hash_table_lookup (cache, &key);
+        if (entry != NULL) {
+                cache_hits++;
+        } else {
+                CacheKey *new_key;
+
+                cache_misses++;
+
+                content_cache_watch_screen (gtk_widget_get_screen (widget));
+
+                gs_debug ("Rendering content for scale %d (%s)",
+                          key.scale, key.locale);
+
+                entry = content_cache_render (widget);
+
+                new_key = g_slice_new (CacheKey);
+                *new_key = key;
+                new_key->locale = g_strdup (key.locale);
+                g_hash_table_insert (cache, new_key, entry);
+        }
+
+        cairo_set_source_surface (cr, entry->surface,
+                                  width / 2 + entry->x,
+                                  height / 2 + entry->y);
+        cairo_paint (cr);
+}
+
+void
+content_get_cache_stats (guint *hits,
+                         guint *misses)
+{
+        if (hits != NULL) {
+                *hits = cache_hits;
+        }
+        if (misses != NULL) {
+                *misses = cache_misses;
+        }
 }
@@ -27,8 +27,11 @@
 
 G_BEGIN_DECLS
 
-void content_draw (GtkWidget *widget,
-                   cairo_t   *cr);
+void content_draw            (GtkWidget *widget,
+                             cairo_t   *cr);
+
+void content_get_cache_stats (guint     *hits,
+                              guint     *misses);
 
 G_END_DECLS
 
@@ -28,15 +28,306 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 
 #include "gs-debug.h"
+#include "gs-flight.h"
 
 static gboolean debugging = FALSE;
 static FILE    *debug_out = NULL;
 
+/* The flight recorder keeps the last FLIGHT_RECORDS gs_debug calls,
+ * whether debugging is enabled or not. Nothing is formatted, the
+ * arguments are copied as they are.
+ */
+#define FLIGHT_RECORDS 1024
+
+typedef struct {
+        /* 0 while the record is written, its sequence number + 1 after. */
+        volatile gint  seq;
+        guint32        line;
+        gint64         time;
+        const char    *func;
+        const char    *format;
+        guint8         n_args;
+        guint8         n_chars;
+        guint64        args [GS_FLIGHT_ARGS];
+        char           chars [GS_FLIGHT_CHARS];
+} FlightRecord;
+
+static FlightRecord  flight [FLIGHT_RECORDS];
+static volatile gint flight_next = 0;
+/* Worked out ahead, the crash handler can't allocate. */
+static char          flight_path [256];
+
+static void
+flight_record (const char *func,
+               int         line,
+               const char *format,
+               va_list     args)
+{
+        FlightRecord *record;
+        const char   *p;
+        guint         seq;
+
+        seq = (guint) g_atomic_int_add (&flight_next, 1);
+        record = &flight [seq % FLIGHT_RECORDS];
+
+        g_atomic_int_set (&record->seq, 0);
+
+        record->time = g_get_monotonic_time ();
+        record->func = func;
+        record->line = line;
+        record->format = format;
+        record->n_args = 0;
+        record->n_chars = 0;
+
+        /* Walk the conversions only to know what to pull off args. */
+        for (p = format; *p != '\0' && record->n_args < GS_FLIGHT_ARGS; p++) {
+                guint64 *arg = &record->args [record->n_args];
+                int      longs = 0;
+
+                if (*p != '%')
+                        continue;
+                if (*++p == '%')
+                        continue;
+
+                while (*p != '\0' && strchr ("-+ #0123456789.", *p) != NULL)
+                        p++;
+                while (*p != '\0' && strchr ("hlqjzt", *p) != NULL) {
+                        if (*p != 'h')
+                                longs++;
+                        p++;
+                }
+
+                switch (*p) {
+                case 'd':
+                case 'i':
+                        if (longs == 0)
+                                *arg = (gint64) va_arg (args, int);
+                        else if (longs == 1)
+                                *arg = (gint64) va_arg (args, long);
+                        else
+                                *arg = (gint64) va_arg (args, long long);
+                        break;
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                case 'c':
+                        if (longs == 0)
+                                *arg = va_arg (args, unsigned int);
+                        else if (longs == 1)
+                                *arg = va_arg (args, unsigned long);
+                        else
+                                *arg = va_arg (args, unsigned long long);
+                        break;
+                case 'e':
+                case 'E':
+                case 'f':
+                case 'F':
+                case 'g':
+                case 'G':
+                        {
+                                double value = va_arg (args, double);
+                                memcpy (arg, &value, sizeof (value));
+                        }
+                        break;
+                case 'p':
+                        *arg = (guintptr) va_arg (args, void *);
+                        break;
+                case 's':
+                        {
+                                const char *str = va_arg (args, const char *);
+                                gsize       len;
+
+                                if (str == NULL)
+                                        str = "(null)";
+
+                                len = MIN (strlen (str), (gsize) MAX (GS_FLIGHT_CHARS - record->n_chars - 1, 0));
+                                memcpy (record->chars + record->n_chars, str, len);
+                                /* offset << 16 | length */
+                                *arg = ((guint64) record->n_chars << 16) | len;
+                                if (record->n_chars < GS_FLIGHT_CHARS) {
+                                        record->chars [record->n_chars + len] = '\0';
+                                        record->n_chars += len + 1;
+                                }
+                        }
+                        break;
+                default:
+                        /* Something we don't know how to skip, keep what we have. */
+                        goto out;
+                }
+
+                record->n_args++;
+        }
+ out:
+        g_atomic_int_set (&record->seq, seq + 1);
+}
+
+/* Only uses async-signal-safe calls, this runs from the crash handler. */
+static gboolean
+write_all (int         fd,
+           const void *data,
+           gsize       len)
+{
+        const char *p = data;
+
+        while (len > 0) {
+                gssize res = write (fd, p, len);
+
+                if (res < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return FALSE;
+                }
+
+                p += res;
+                len -= res;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+flight_write (int fd)
+{
+        GSFlightHeader header;
+        guint          next;
+        guint          i;
+
+        next = (guint) g_atomic_int_get (&flight_next);
+
+        header.magic = GS_FLIGHT_MAGIC;
+        header.version = GS_FLIGHT_VERSION;
+        header.n_records = 0;
+        header.dropped = 0;
+
+        if (! write_all (fd, &header, sizeof (header)))
+                return FALSE;
+
+        /* Oldest first. */
+        for (i = 0; i < FLIGHT_RECORDS; i++) {
+                FlightRecord  record;
+                GSFlightEntry entry;
+                guint         seq;
+
+                record = flight [(next + i) % FLIGHT_RECORDS];
+                seq = (guint) record.seq;
+
+                /* Empty, or being written right now. */
+                if (seq == 0 || seq != (guint) g_atomic_int_get (&flight [(next + i) % FLIGHT_RECORDS].seq))
+                        continue;
+
+                entry.time = record.time;
+                entry.seq = seq - 1;
+                entry.line = record.line;
+                entry.n_args = record.n_args;
+                entry.func_len = strlen (record.func);
+                entry.format_len = strlen (record.format);
+                entry.chars_len = record.n_chars;
+
+                if (! write_all (fd, &entry, sizeof (entry))
+                    || ! write_all (fd, record.args, entry.n_args * sizeof (guint64))
+                    || ! write_all (fd, record.func, entry.func_len)
+                    || ! write_all (fd, record.format, entry.format_len)
+                    || ! write_all (fd, record.chars, entry.chars_len))
+                        return FALSE;
+
+                header.n_records++;
+        }
+
+        if (next > FLIGHT_RECORDS)
+                header.dropped = next - header.n_records;
+
+        return lseek (fd, 0, SEEK_SET) == 0 && write_all (fd, &header, sizeof (header));
+}
+
+static gboolean
+flight_dump_to (const char *path)
+{
+        gboolean res;
+        int      fd;
+
+        fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0)
+                return FALSE;
+
+        res = flight_write (fd);
+        close (fd);
+
+        return res;
+}
+
+const char *
+gs_debug_flight_path (void)
+{
+        if (flight_path [0] == '\0') {
+                g_snprintf (flight_path, sizeof (flight_path), "%s/light-locker-%d.flight",
+                            g_get_user_runtime_dir (), (int) getpid ());
+        }
+
+        return flight_path;
+}
+
+/* Writes the flight recorder to path, or to gs_debug_flight_path ()
+ * when path is NULL. Decode the file with light-locker-flight.
+ */
+gboolean
+gs_debug_flight_dump (const char *path)
+{
+        if (path == NULL)
+                path = gs_debug_flight_path ();
+
+        return flight_dump_to (path);
+}
+
+static gboolean
+flight_dump_signal_cb (gpointer data)
+{
+        if (gs_debug_flight_dump (NULL)) {
+                gs_debug ("Flight recorder written to %s", gs_debug_flight_path ());
+        } else {
+                g_warning ("Unable to write the flight recorder to %s", gs_debug_flight_path ());
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+flight_crash_handler (int signum)
+{
+        flight_dump_to (flight_path);
+
+        /* SA_RESETHAND put the default action back. */
+        raise (signum);
+}
+
+static void
+flight_init (void)
+{
+        static const int crash_signals [] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+        struct sigaction action;
+        guint            i;
+
+        gs_debug_flight_path ();
+
+        memset (&action, 0, sizeof (action));
+        action.sa_handler = flight_crash_handler;
+        action.sa_flags = SA_RESETHAND;
+        sigemptyset (&action.sa_mask);
+
+        for (i = 0; i < G_N_ELEMENTS (crash_signals); i++)
+                sigaction (crash_signals [i], &action, NULL);
+
+        g_unix_signal_add (SIGUSR1, flight_dump_signal_cb, NULL);
+}
+
 /* Based on rhythmbox/lib/rb-debug.c */
 /* Our own funky debugging function, should only be used when something
  * is not going wrong, if something *is* wrong use g_warning.
@@ -47,10 +338,15 @@ gs_debug_real (const char *func,
                const int   line,
                const char *format, ...)
 {
-        va_list args;
-        char    buffer [1025];
-        char   *str_time;
-        time_t  the_time;
+        va_list   args;
+        char      buffer [1025];
+        char      str_time [16];
+        time_t    the_time;
+        struct tm tm;
+
+        va_start (args, format);
+        flight_record (func, line, format, args);
+        va_end (args);
 
         if (debugging == FALSE)
                 return;
@@ -62,8 +358,7 @@ gs_debug_real (const char *func,
         va_end (args);
 
         time (&the_time);
-        str_time = g_new0 (char, 255);
-        strftime (str_time, 254, "%H:%M:%S", localtime (&the_time));
+        strftime (str_time, sizeof (str_time), "%H:%M:%S", localtime_r (&the_time, &tm));
 
         fprintf ((debug_out ? debug_out : stderr),
                  "[%s] %s:%d (%s):\t %s\n",
@@ -71,8 +366,6 @@ gs_debug_real (const char *func,
 
         if (debug_out)
                 fflush (debug_out);
-
-        g_free (str_time);
 }
 
 gboolean
@@ -85,6 +378,13 @@ void
 gs_debug_init (gboolean debug,
                gboolean to_file)
 {
+        static gboolean flight_ready = FALSE;
+
+        if (! flight_ready) {
+                flight_init ();
+                flight_ready = TRUE;
+        }
+
         /* return if already initialized */
         if (debugging == TRUE) {
                 return;
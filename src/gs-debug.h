@@ -40,6 +40,8 @@ void gs_debug_init             (gboolean debug,
                                 gboolean to_file);
 gboolean gs_debug_enabled      (void);
 void gs_debug_shutdown         (void);
+const char *gs_debug_flight_path (void);
+gboolean gs_debug_flight_dump  (const char *path);
 void gs_debug_real             (const char *func,
                                 const char *file,
                                 int         line,
@@ -0,0 +1,589 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include <gtk/gtkx.h>
+
+#ifdef HAVE_XRANDR_GAMMA
+#include <X11/extensions/Xrandr.h>
+#endif
+
+#ifdef HAVE_XF86VMODE_GAMMA
+#include <X11/extensions/xf86vmode.h>
+#endif
+
+#include "gs-fade.h"
+#include "gs-debug.h"
+
+static void gs_fade_finalize (GObject *object);
+
+/* Interval of the fade timer, in ms. */
+#define FADE_FRAME 16
+
+/* XF86VidModeSetGamma refuses anything lower. */
+#define GAMMA_MIN 0.1
+
+#ifdef HAVE_XRANDR_GAMMA
+typedef struct {
+        RRCrtc        crtc;
+        /* The ramps as read, and the ones written out on each frame. */
+        XRRCrtcGamma *saved;
+        XRRCrtcGamma *frame;
+} FadeCrtc;
+#endif
+
+#ifdef HAVE_XF86VMODE_GAMMA
+typedef struct {
+        int              number;
+        gboolean         usable;
+        /* Ramp size, 0 when only the gamma value can be set. */
+        int              size;
+        /* The saved red, green and blue ramps, followed by
+         * the three ramps written out on each frame. */
+        gushort         *ramps;
+        XF86VidModeGamma gamma;
+} FadeScreen;
+#endif
+
+struct _GSFade
+{
+        GObject     parent_instance;
+
+        guint       timer_id;
+        gint64      start_time;
+        gint64      duration;
+        gdouble     from;
+        gdouble     to;
+        gdouble     alpha;
+
+        /* The original gamma is saved and has to be restored. */
+        gboolean    saved;
+#ifdef HAVE_XRANDR_GAMMA
+        /* Used with RandR 1.2, the screens are left empty then. */
+        FadeCrtc   *crtcs;
+        int         n_crtcs;
+#endif
+#ifdef HAVE_XF86VMODE_GAMMA
+        FadeScreen *screens;
+        int         n_screens;
+#endif
+};
+
+G_DEFINE_TYPE (GSFade, gs_fade, G_TYPE_OBJECT)
+
+#ifdef HAVE_XRANDR_GAMMA
+static void
+randr_clear (GSFade *fade)
+{
+        int i;
+
+        for (i = 0; i < fade->n_crtcs; i++) {
+                XRRFreeGamma (fade->crtcs [i].saved);
+                XRRFreeGamma (fade->crtcs [i].frame);
+        }
+        g_clear_pointer (&fade->crtcs, g_free);
+        fade->n_crtcs = 0;
+}
+
+/* XF86VidMode only reaches the first CRTC of each screen, RandR 1.2
+ * has a gamma ramp for every one of them. */
+static gboolean
+randr_save (GSFade     *fade,
+            GdkDisplay *display)
+{
+        Display *xdisplay;
+        GArray  *crtcs;
+        int      event_base, error_base;
+        int      major, minor;
+        int      i, j;
+
+        xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+        if (! XRRQueryExtension (xdisplay, &event_base, &error_base)
+            || ! XRRQueryVersion (xdisplay, &major, &minor)) {
+                gs_debug ("RandR extension not found");
+                return FALSE;
+        }
+
+        if (major < 1 || (major == 1 && minor < 2)) {
+                gs_debug ("RandR %d.%d has no CRTC gamma", major, minor);
+                return FALSE;
+        }
+
+        crtcs = g_array_new (FALSE, FALSE, sizeof (FadeCrtc));
+
+        gdk_error_trap_push ();
+        for (i = 0; i < gdk_display_get_n_screens (display); i++) {
+                GdkWindow          *root;
+                XRRScreenResources *resources;
+
+                root = gdk_screen_get_root_window (gdk_display_get_screen (display, i));
+
+                /* Unlike the plain call this doesn't probe the outputs,
+                 * which can take a while. */
+                if (major > 1 || minor >= 3)
+                        resources = XRRGetScreenResourcesCurrent (xdisplay, GDK_WINDOW_XID (root));
+                else
+                        resources = XRRGetScreenResources (xdisplay, GDK_WINDOW_XID (root));
+
+                if (resources == NULL)
+                        continue;
+
+                for (j = 0; j < resources->ncrtc; j++) {
+                        FadeCrtc crtc;
+
+                        if (XRRGetCrtcGammaSize (xdisplay, resources->crtcs [j]) <= 0)
+                                continue;
+
+                        crtc.crtc = resources->crtcs [j];
+                        crtc.saved = XRRGetCrtcGamma (xdisplay, crtc.crtc);
+                        if (crtc.saved == NULL)
+                                continue;
+                        if (crtc.saved->size <= 0) {
+                                XRRFreeGamma (crtc.saved);
+                                continue;
+                        }
+                        crtc.frame = XRRAllocGamma (crtc.saved->size);
+
+                        g_array_append_val (crtcs, crtc);
+                }
+
+                XRRFreeScreenResources (resources);
+        }
+
+        fade->n_crtcs = crtcs->len;
+        fade->crtcs = (FadeCrtc *) g_array_free (crtcs, FALSE);
+
+        if (gdk_error_trap_pop () || fade->n_crtcs == 0) {
+                gs_debug ("Unable to read the CRTC gamma");
+                randr_clear (fade);
+                return FALSE;
+        }
+
+        gs_debug ("Fading %d CRTCs", fade->n_crtcs);
+
+        return TRUE;
+}
+
+static void
+randr_apply (GSFade  *fade,
+             Display *xdisplay,
+             guint32  scale)
+{
+        int i, j;
+
+        for (i = 0; i < fade->n_crtcs; i++) {
+                FadeCrtc *crtc = &fade->crtcs [i];
+
+                for (j = 0; j < crtc->saved->size; j++) {
+                        crtc->frame->red [j] = ((guint32) crtc->saved->red [j] * scale) >> 16;
+                        crtc->frame->green [j] = ((guint32) crtc->saved->green [j] * scale) >> 16;
+                        crtc->frame->blue [j] = ((guint32) crtc->saved->blue [j] * scale) >> 16;
+                }
+
+                XRRSetCrtcGamma (xdisplay, crtc->crtc, crtc->frame);
+        }
+}
+
+static void
+randr_restore (GSFade  *fade,
+               Display *xdisplay)
+{
+        int i;
+
+        /* A CRTC that went away in the meantime only raises an error. */
+        for (i = 0; i < fade->n_crtcs; i++)
+                XRRSetCrtcGamma (xdisplay, fade->crtcs [i].crtc, fade->crtcs [i].saved);
+
+        randr_clear (fade);
+}
+#endif
+
+#ifdef HAVE_XF86VMODE_GAMMA
+static gboolean
+vidmode_save (GSFade     *fade,
+              GdkDisplay *display)
+{
+        Display    *xdisplay;
+        int         event_base, error_base;
+        int         major, minor;
+#ifdef HAVE_XF86VMODE_GAMMA_RAMP
+        gboolean    have_ramp;
+#endif
+        gboolean    usable = FALSE;
+        int         i;
+
+        xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+        if (! XF86VidModeQueryExtension (xdisplay, &event_base, &error_base)
+            || ! XF86VidModeQueryVersion (xdisplay, &major, &minor)) {
+                gs_debug ("XF86VidMode extension not found");
+                return FALSE;
+        }
+
+#ifdef HAVE_XF86VMODE_GAMMA_RAMP
+        /* Gamma ramps were added in 2.1. */
+        have_ramp = (major > 2 || (major == 2 && minor >= 1));
+#endif
+
+        fade->n_screens = gdk_display_get_n_screens (display);
+        fade->screens = g_new0 (FadeScreen, fade->n_screens);
+
+        gdk_error_trap_push ();
+        for (i = 0; i < fade->n_screens; i++) {
+                FadeScreen *screen = &fade->screens [i];
+
+                screen->number = GDK_SCREEN_XNUMBER (gdk_display_get_screen (display, i));
+
+#ifdef HAVE_XF86VMODE_GAMMA_RAMP
+                if (have_ramp
+                    && XF86VidModeGetGammaRampSize (xdisplay, screen->number, &screen->size)
+                    && screen->size > 0) {
+                        screen->ramps = g_new (gushort, screen->size * 6);
+                        screen->usable = XF86VidModeGetGammaRamp (xdisplay, screen->number, screen->size,
+                                                                  screen->ramps,
+                                                                  screen->ramps + screen->size,
+                                                                  screen->ramps + screen->size * 2);
+                } else
+#endif
+                {
+                        screen->size = 0;
+                        screen->usable = XF86VidModeGetGamma (xdisplay, screen->number, &screen->gamma);
+                }
+
+                usable |= screen->usable;
+        }
+        if (gdk_error_trap_pop ())
+                usable = FALSE;
+
+        if (! usable) {
+                for (i = 0; i < fade->n_screens; i++)
+                        g_free (fade->screens [i].ramps);
+                g_clear_pointer (&fade->screens, g_free);
+                fade->n_screens = 0;
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+vidmode_apply (GSFade  *fade,
+               Display *xdisplay,
+               gdouble  alpha,
+               guint32  scale)
+{
+        int i;
+
+        for (i = 0; i < fade->n_screens; i++) {
+                FadeScreen *screen = &fade->screens [i];
+
+                if (! screen->usable)
+                        continue;
+
+#ifdef HAVE_XF86VMODE_GAMMA_RAMP
+                if (screen->size > 0) {
+                        gushort *out = screen->ramps + screen->size * 3;
+                        int      j;
+
+                        for (j = 0; j < screen->size * 3; j++)
+                                out [j] = ((guint32) screen->ramps [j] * scale) >> 16;
+
+                        XF86VidModeSetGammaRamp (xdisplay, screen->number, screen->size,
+                                                 out,
+                                                 out + screen->size,
+                                                 out + screen->size * 2);
+                        continue;
+                }
+#endif
+                {
+                        XF86VidModeGamma gamma;
+
+                        gamma.red = MAX (screen->gamma.red * alpha, GAMMA_MIN);
+                        gamma.green = MAX (screen->gamma.green * alpha, GAMMA_MIN);
+                        gamma.blue = MAX (screen->gamma.blue * alpha, GAMMA_MIN);
+
+                        XF86VidModeSetGamma (xdisplay, screen->number, &gamma);
+                }
+        }
+}
+
+static void
+vidmode_restore (GSFade  *fade,
+                 Display *xdisplay)
+{
+        int i;
+
+        for (i = 0; i < fade->n_screens; i++) {
+                FadeScreen *screen = &fade->screens [i];
+
+                if (! screen->usable) {
+                        /* Nothing was read, so nothing was changed. */
+#ifdef HAVE_XF86VMODE_GAMMA_RAMP
+                } else if (screen->size > 0) {
+                        XF86VidModeSetGammaRamp (xdisplay, screen->number, screen->size,
+                                                 screen->ramps,
+                                                 screen->ramps + screen->size,
+                                                 screen->ramps + screen->size * 2);
+#endif
+                } else {
+                        XF86VidModeSetGamma (xdisplay, screen->number, &screen->gamma);
+                }
+
+                g_free (screen->ramps);
+        }
+
+        g_clear_pointer (&fade->screens, g_free);
+        fade->n_screens = 0;
+}
+#endif
+
+#if defined(HAVE_XRANDR_GAMMA) || defined(HAVE_XF86VMODE_GAMMA)
+static gboolean
+gamma_save (GSFade *fade)
+{
+        GdkDisplay *display;
+        gboolean    usable = FALSE;
+
+        if (fade->saved)
+                return TRUE;
+
+        display = gdk_display_get_default ();
+
+#ifdef HAVE_XRANDR_GAMMA
+        usable = randr_save (fade, display);
+#endif
+#ifdef HAVE_XF86VMODE_GAMMA
+        /* Without RandR 1.2 there is one ramp per screen. */
+        if (! usable)
+                usable = vidmode_save (fade, display);
+#endif
+
+        if (! usable) {
+                gs_debug ("Unable to read the gamma, not fading");
+                return FALSE;
+        }
+
+        fade->saved = TRUE;
+
+        return TRUE;
+}
+
+static void
+gamma_apply (GSFade *fade,
+             gdouble alpha)
+{
+        Display *xdisplay;
+        guint32  scale;
+
+        xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+        /* 16.16 fixed point, so a frame is only integer math. */
+        scale = (guint32) (CLAMP (alpha, 0.0, 1.0) * 65536.0);
+
+        gdk_error_trap_push ();
+#ifdef HAVE_XRANDR_GAMMA
+        randr_apply (fade, xdisplay, scale);
+#endif
+#ifdef HAVE_XF86VMODE_GAMMA
+        vidmode_apply (fade, xdisplay, alpha, scale);
+#endif
+        gdk_flush ();
+        gdk_error_trap_pop_ignored ();
+}
+
+/* Writes back exactly what was read, not a computed ramp. */
+static void
+gamma_restore (GSFade *fade)
+{
+        Display *xdisplay;
+
+        if (! fade->saved)
+                return;
+
+        xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+        gdk_error_trap_push ();
+#ifdef HAVE_XRANDR_GAMMA
+        randr_restore (fade, xdisplay);
+#endif
+#ifdef HAVE_XF86VMODE_GAMMA
+        vidmode_restore (fade, xdisplay);
+#endif
+        gdk_flush ();
+        gdk_error_trap_pop_ignored ();
+
+        fade->saved = FALSE;
+
+        gs_debug ("Gamma restored");
+}
+#else
+static gboolean
+gamma_save (GSFade *fade)
+{
+        gs_debug ("Gamma fading not supported");
+
+        return FALSE;
+}
+
+static void
+gamma_apply (GSFade *fade,
+             gdouble alpha)
+{
+}
+
+static void
+gamma_restore (GSFade *fade)
+{
+}
+#endif
+
+static void
+fade_stop (GSFade *fade)
+{
+        if (fade->timer_id != 0) {
+                g_source_remove (fade->timer_id);
+                fade->timer_id = 0;
+        }
+}
+
+static gboolean
+fade_timer (GSFade *fade)
+{
+        gdouble t;
+
+        t = (gdouble) (g_get_monotonic_time () - fade->start_time) / fade->duration;
+        if (t > 1.0)
+                t = 1.0;
+
+        fade->alpha = fade->from + (fade->to - fade->from) * t;
+
+        if (t < 1.0) {
+                gamma_apply (fade, fade->alpha);
+                return G_SOURCE_CONTINUE;
+        }
+
+        fade->timer_id = 0;
+
+        gs_debug ("Fade finished at %.2f", fade->alpha);
+
+        if (fade->alpha >= 1.0) {
+                gamma_restore (fade);
+        } else {
+                gamma_apply (fade, fade->alpha);
+        }
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+fade_start (GSFade *fade,
+            gdouble to,
+            guint   timeout)
+{
+        fade_stop (fade);
+
+        if (! gamma_save (fade))
+                return;
+
+        fade->from = fade->alpha;
+        fade->to = to;
+        fade->start_time = g_get_monotonic_time ();
+        /* A fade that was cut short is undone in proportion. */
+        fade->duration = MAX (timeout * ABS (to - fade->from) * 1000, 1);
+
+        gs_debug ("Fading from %.2f to %.2f in %" G_GINT64_FORMAT " ms",
+                  fade->from, fade->to, fade->duration / 1000);
+
+        fade->timer_id = g_timeout_add (FADE_FRAME, (GSourceFunc) fade_timer, fade);
+}
+
+/* Dims the screens to black over timeout ms. */
+void
+gs_fade_out (GSFade *fade,
+             guint   timeout)
+{
+        g_return_if_fail (GS_IS_FADE (fade));
+
+        fade_start (fade, 0.0, timeout);
+}
+
+/* Brings a dimmed screen back, ending with the original gamma. */
+void
+gs_fade_in (GSFade *fade,
+            guint   timeout)
+{
+        g_return_if_fail (GS_IS_FADE (fade));
+
+        if (! fade->saved)
+                return;
+
+        fade_start (fade, 1.0, timeout);
+}
+
+/* Stops any fade and puts back the original gamma right away. */
+void
+gs_fade_reset (GSFade *fade)
+{
+        g_return_if_fail (GS_IS_FADE (fade));
+
+        fade_stop (fade);
+        gamma_restore (fade);
+
+        fade->alpha = 1.0;
+}
+
+gboolean
+gs_fade_get_active (GSFade *fade)
+{
+        g_return_val_if_fail (GS_IS_FADE (fade), FALSE);
+
+        return fade->saved;
+}
+
+static void
+gs_fade_class_init (GSFadeClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = gs_fade_finalize;
+}
+
+static void
+gs_fade_init (GSFade *fade)
+{
+        fade->alpha = 1.0;
+}
+
+static void
+gs_fade_finalize (GObject *object)
+{
+        GSFade *fade = GS_FADE (object);
+
+        gs_fade_reset (fade);
+
+        G_OBJECT_CLASS (gs_fade_parent_class)->finalize (object);
+}
+
+GSFade *
+gs_fade_new (void)
+{
+        return GS_FADE (g_object_new (GS_TYPE_FADE, NULL));
+}
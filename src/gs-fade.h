@@ -0,0 +1,41 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_FADE_H
+#define __GS_FADE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_FADE gs_fade_get_type ()
+G_DECLARE_FINAL_TYPE (GSFade, gs_fade, GS, FADE, GObject)
+
+GSFade   * gs_fade_new        (void);
+
+void       gs_fade_out        (GSFade *fade,
+                               guint   timeout);
+void       gs_fade_in         (GSFade *fade,
+                               guint   timeout);
+void       gs_fade_reset      (GSFade *fade);
+
+gboolean   gs_fade_get_active (GSFade *fade);
+
+G_END_DECLS
+
+#endif /* __GS_FADE_H */
@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_FLIGHT_H
+#define __GS_FLIGHT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The file written when the flight recorder is dumped, read back by
+ * light-locker-flight. A GSFlightHeader is followed by n_records
+ * entries, each a GSFlightEntry, its n_args 64 bit arguments and then
+ * the func, format and chars strings, none of them NUL terminated.
+ *
+ * Arguments are stored in the order the format consumes them: integers
+ * and pointers as their value, doubles as their bits and strings as the
+ * next NUL terminated piece of chars.
+ */
+
+#define GS_FLIGHT_MAGIC   0x52464c4cu /* "LLFR" */
+#define GS_FLIGHT_VERSION 1
+
+/* At most this many arguments and string bytes are kept per call. */
+#define GS_FLIGHT_ARGS  6
+#define GS_FLIGHT_CHARS 48
+
+typedef struct {
+        guint32 magic;
+        guint32 version;
+        guint32 n_records;
+        guint32 dropped;
+} GSFlightHeader;
+
+typedef struct {
+        guint64 time;
+        guint32 seq;
+        guint32 line;
+        guint32 n_args;
+        guint32 func_len;
+        guint32 format_len;
+        guint32 chars_len;
+} GSFlightEntry;
+
+G_END_DECLS
+
+#endif /* __GS_FLIGHT_H */
@@ -35,12 +35,33 @@
 
 #include "gs-window.h"
 #include "gs-grab.h"
+#include "gs-probe.h"
 #include "gs-debug.h"
 
 static void     gs_grab_class_init (GSGrabClass *klass);
 static void     gs_grab_init       (GSGrab      *grab);
 static void     gs_grab_finalize   (GObject        *object);
 
+/* Failed grabs are retried from a timeout, starting after
+ * GRAB_RETRY_INITIAL ms and doubling up to GRAB_RETRY_MAX ms.
+ * A new grab gives up on a device after GRAB_RETRIES attempts,
+ * which adds up to about 2.6 seconds.
+ */
+#define GRAB_RETRY_INITIAL 20
+#define GRAB_RETRY_MAX     500
+#define GRAB_RETRIES       10
+
+typedef enum {
+        GRAB_REQUEST_NONE,
+        GRAB_REQUEST_GRAB,
+        GRAB_REQUEST_MOVE
+} GrabRequest;
+
+typedef enum {
+        GRAB_STAGE_KEYBOARD,
+        GRAB_STAGE_MOUSE
+} GrabStage;
+
 struct _GSGrab
 {
         GDBusConnection *session_bus;
@@ -52,6 +73,32 @@ struct _GSGrab
         GdkScreen *keyboard_grab_screen;
 
         GtkWidget *invisible;
+
+        /* Master devices, kept up to date from the device manager */
+        GdkDeviceManager *device_manager;
+        GList            *pointers;
+        GList            *keyboards;
+        GdkDevice        *client_pointer;
+        gulong            device_added_id;
+        gulong            device_removed_id;
+
+        /* Pointer position, valid until the main loop goes idle */
+        GdkScreen  *pointer_screen;
+        gint        pointer_x;
+        gint        pointer_y;
+        guint       pointer_clear_id;
+
+        /* Pending request */
+        GrabRequest request;
+        GrabStage   request_stage;
+        GdkWindow  *request_window;
+        GdkScreen  *request_screen;
+        gboolean    request_hide_cursor;
+        gboolean    request_nuked_focus;
+        guint       request_attempts;
+        guint       request_retry_id;
+        GSGrabFunc  request_func;
+        gpointer    request_data;
 };
 
 G_DEFINE_TYPE (GSGrab, gs_grab, G_TYPE_OBJECT)
@@ -148,17 +195,11 @@ gs_grab_get_keyboard (GSGrab    *grab,
 
         gs_debug ("Grabbing keyboard widget=%X", (guint32) GDK_WINDOW_XID (window));
 
-        GList *list, *link;
-        GdkDisplay *display = gdk_window_get_display (window);
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        list = gdk_device_manager_list_devices (device_manager, GDK_DEVICE_TYPE_MASTER);
+        GList *link;
 
-        for (link = list; link != NULL; link = g_list_next (link)) {
+        for (link = grab->keyboards; link != NULL; link = g_list_next (link)) {
                 GdkDevice *device = GDK_DEVICE (link->data);
 
-                if (gdk_device_get_source (device) != GDK_SOURCE_KEYBOARD)
-                        continue;
-
                 status = gdk_device_grab (device,
                                           window,
                                           GDK_OWNERSHIP_NONE,
@@ -168,7 +209,6 @@ gs_grab_get_keyboard (GSGrab    *grab,
                                           NULL,
                                           GDK_CURRENT_TIME);
         }
-        g_list_free(list);
 
         if (status == GDK_GRAB_SUCCESS) {
                 if (grab->keyboard_grab_window != NULL) {
@@ -203,17 +243,11 @@ gs_grab_get_mouse (GSGrab    *grab,
         cursor = gdk_cursor_new (GDK_BLANK_CURSOR);
 
         gs_debug ("Grabbing mouse widget=%X", (guint32) GDK_WINDOW_XID (window));
-        GList *list, *link;
-        GdkDisplay *display = gdk_window_get_display (window);
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        list = gdk_device_manager_list_devices (device_manager, GDK_DEVICE_TYPE_MASTER);
+        GList *link;
 
-        for (link = list; link != NULL; link = g_list_next (link)) {
+        for (link = grab->pointers; link != NULL; link = g_list_next (link)) {
                 GdkDevice *device = GDK_DEVICE (link->data);
 
-                if (gdk_device_get_source (device) != GDK_SOURCE_MOUSE)
-                        continue;
-
                 status = gdk_device_grab (device,
                                           window,
                                           GDK_OWNERSHIP_NONE,
@@ -223,7 +257,6 @@ gs_grab_get_mouse (GSGrab    *grab,
                                           (hide_cursor ? cursor : NULL),
                                           GDK_CURRENT_TIME);
         }
-        g_list_free(list);
 
         if (status == GDK_GRAB_SUCCESS) {
                 if (grab->mouse_grab_window != NULL) {
@@ -260,20 +293,11 @@ gs_grab_release_keyboard (GSGrab *grab)
 {
         gs_debug ("Ungrabbing keyboard");
 
-        GList *list, *link;
-        GdkDisplay *display = gdk_display_get_default ();
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        list = gdk_device_manager_list_devices (device_manager, GDK_DEVICE_TYPE_MASTER);
-
-        for (link = list; link != NULL; link = g_list_next (link)) {
-                GdkDevice *device = GDK_DEVICE (link->data);
-
-                if (gdk_device_get_source (device) != GDK_SOURCE_KEYBOARD)
-                        continue;
+        GList *link;
 
-                gdk_device_ungrab(device, GDK_CURRENT_TIME);
+        for (link = grab->keyboards; link != NULL; link = g_list_next (link)) {
+                gdk_device_ungrab (GDK_DEVICE (link->data), GDK_CURRENT_TIME);
         }
-        g_list_free(list);
 
         gs_grab_keyboard_reset (grab);
 
@@ -297,20 +321,11 @@ gs_grab_release_mouse (GSGrab *grab)
 {
         gs_debug ("Ungrabbing pointer");
 
-        GList *list, *link;
-        GdkDisplay *display = gdk_display_get_default ();
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        list = gdk_device_manager_list_devices (device_manager, GDK_DEVICE_TYPE_MASTER);
-
-        for (link = list; link != NULL; link = g_list_next (link)) {
-                GdkDevice *device = GDK_DEVICE (link->data);
-
-                if (gdk_device_get_source (device) != GDK_SOURCE_MOUSE)
-                        continue;
+        GList *link;
 
-                gdk_device_ungrab(device, GDK_CURRENT_TIME);
+        for (link = grab->pointers; link != NULL; link = g_list_next (link)) {
+                gdk_device_ungrab (GDK_DEVICE (link->data), GDK_CURRENT_TIME);
         }
-        g_list_free(list);
 
         gs_grab_mouse_reset (grab);
 
@@ -330,21 +345,13 @@ gs_grab_move_mouse (GSGrab    *grab,
 
         /* if the pointer is not grabbed and we have a
            mouse_grab_window defined then we lost the grab */
-        GList *list, *link;
+        GList *link;
         GdkDisplay *display = gdk_display_get_default ();
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        list = gdk_device_manager_list_devices (device_manager, GDK_DEVICE_TYPE_MASTER);
-        for (link = list; link != NULL; link = g_list_next (link)) {
-                GdkDevice *device = GDK_DEVICE (link->data);
-
-                if (gdk_device_get_source (device) != GDK_SOURCE_MOUSE)
-                        continue;
-
-                if (! gdk_display_device_is_grabbed(display, device)) {
+        for (link = grab->pointers; link != NULL; link = g_list_next (link)) {
+                if (! gdk_display_device_is_grabbed (display, GDK_DEVICE (link->data))) {
                         gs_grab_mouse_reset (grab);
                 }
         }
-        g_list_free(list);
 
         if (grab->mouse_grab_window == window) {
                 gs_debug ("Window %X is already grabbed, skipping",
@@ -380,11 +387,6 @@ gs_grab_move_mouse (GSGrab    *grab,
 
         result = gs_grab_get_mouse (grab, window, screen, hide_cursor);
 
-        if (result != GDK_GRAB_SUCCESS) {
-                sleep (1);
-                result = gs_grab_get_mouse (grab, window, screen, hide_cursor);
-        }
-
         if ((result != GDK_GRAB_SUCCESS) && old_window) {
                 gs_debug ("Could not grab mouse for new window.  Resuming previous grab.");
                 gs_grab_get_mouse (grab, old_window, old_screen, old_hide_cursor);
@@ -434,11 +436,6 @@ gs_grab_move_keyboard (GSGrab    *grab,
 
         result = gs_grab_get_keyboard (grab, window, screen);
 
-        if (result != GDK_GRAB_SUCCESS) {
-                sleep (1);
-                result = gs_grab_get_keyboard (grab, window, screen);
-        }
-
         if ((result != GDK_GRAB_SUCCESS) && old_window) {
                 gs_debug ("Could not grab keyboard for new window.  Resuming previous grab.");
                 gs_grab_get_keyboard (grab, old_window, old_screen);
@@ -468,11 +465,209 @@ gs_grab_nuke_focus (void)
         gdk_error_trap_pop_ignored ();
 }
 
+static void
+gs_grab_request_clear (GSGrab *grab)
+{
+        if (grab->request_retry_id != 0) {
+                g_source_remove (grab->request_retry_id);
+                grab->request_retry_id = 0;
+        }
+
+        g_clear_object (&grab->request_window);
+        grab->request_screen = NULL;
+        grab->request = GRAB_REQUEST_NONE;
+        grab->request_func = NULL;
+        grab->request_data = NULL;
+}
+
+static void
+gs_grab_request_finish (GSGrab  *grab,
+                        gboolean success)
+{
+        GSGrabFunc func;
+        gpointer   data;
+
+        gs_debug ("Grab request %s", success ? "succeeded" : "failed");
+
+        if (success) {
+                GS_PROBE2 (grab_success, grab->request, grab->request_attempts);
+        } else {
+                GS_PROBE2 (grab_failure, grab->request, grab->request_attempts);
+        }
+
+        func = grab->request_func;
+        data = grab->request_data;
+
+        gs_grab_request_clear (grab);
+
+        if (func != NULL) {
+                func (grab, success, data);
+        }
+}
+
+static gboolean gs_grab_request_retry (GSGrab *grab);
+
+static void
+gs_grab_request_step (GSGrab *grab)
+{
+        gboolean ok;
+        guint    delay;
+
+        while (grab->request != GRAB_REQUEST_NONE) {
+                if (grab->request_stage == GRAB_STAGE_KEYBOARD) {
+                        if (grab->request == GRAB_REQUEST_GRAB) {
+                                ok = gs_grab_get_keyboard (grab,
+                                                           grab->request_window,
+                                                           grab->request_screen) == GDK_GRAB_SUCCESS;
+                        } else {
+                                ok = gs_grab_move_keyboard (grab,
+                                                            grab->request_window,
+                                                            grab->request_screen);
+                        }
+                } else {
+                        if (grab->request == GRAB_REQUEST_GRAB) {
+                                ok = gs_grab_get_mouse (grab,
+                                                        grab->request_window,
+                                                        grab->request_screen,
+                                                        grab->request_hide_cursor) == GDK_GRAB_SUCCESS;
+                        } else {
+                                ok = gs_grab_move_mouse (grab,
+                                                         grab->request_window,
+                                                         grab->request_screen,
+                                                         grab->request_hide_cursor);
+                        }
+                }
+
+                gdk_flush ();
+
+                if (ok) {
+                        if (grab->request_stage == GRAB_STAGE_KEYBOARD) {
+                                grab->request_stage = GRAB_STAGE_MOUSE;
+                                grab->request_attempts = 0;
+                                continue;
+                        }
+
+                        gs_grab_request_finish (grab, TRUE);
+                        return;
+                }
+
+                grab->request_attempts++;
+
+                /* Moving an existing grab never gives up. */
+                if (grab->request == GRAB_REQUEST_GRAB
+                    && grab->request_attempts >= GRAB_RETRIES) {
+                        if (grab->request_stage == GRAB_STAGE_KEYBOARD
+                            && ! grab->request_nuked_focus) {
+                                grab->request_nuked_focus = TRUE;
+                                grab->request_attempts = 0;
+                                gs_grab_nuke_focus ();
+                                continue;
+                        }
+
+                        /* When should we allow blanking to proceed?  The current theory
+                           is that both a keyboard grab and a mouse grab are mandatory
+
+                           - If we don't have a keyboard grab, then we won't be able to
+                           read a password to unlock, so the kbd grab is manditory.
+
+                           - If we don't have a mouse grab, then we might not see mouse
+                           clicks as a signal to unblank, on-screen widgets won't work ideally,
+                           and gs_grab_move_to_window() will spin forever when it gets called.
+                        */
+                        if (grab->request_stage == GRAB_STAGE_KEYBOARD) {
+                                gs_debug ("Couldn't grab keyboard!");
+                        } else {
+                                gs_debug ("Couldn't grab pointer!");
+                                gs_grab_release_keyboard (grab);
+                        }
+
+                        gs_grab_request_finish (grab, FALSE);
+                        return;
+                }
+
+                delay = MIN (GRAB_RETRY_INITIAL << MIN (grab->request_attempts - 1, 8),
+                             GRAB_RETRY_MAX);
+
+                gs_debug ("Retrying %s grab in %u ms",
+                          grab->request_stage == GRAB_STAGE_KEYBOARD ? "keyboard" : "pointer",
+                          delay);
+
+                grab->request_retry_id = g_timeout_add (delay,
+                                                        (GSourceFunc)gs_grab_request_retry,
+                                                        grab);
+                return;
+        }
+}
+
+static gboolean
+gs_grab_request_retry (GSGrab *grab)
+{
+        grab->request_retry_id = 0;
+
+        gs_grab_request_step (grab);
+
+        return FALSE;
+}
+
+static void
+gs_grab_request_start (GSGrab     *grab,
+                       GrabRequest request,
+                       GdkWindow  *window,
+                       GdkScreen  *screen,
+                       gboolean    hide_cursor,
+                       GSGrabFunc  func,
+                       gpointer    user_data)
+{
+        if (grab->request != GRAB_REQUEST_NONE) {
+                gs_debug ("Replacing pending grab request");
+        }
+
+        g_object_ref (window);
+        gs_grab_request_clear (grab);
+
+        grab->request = request;
+        grab->request_stage = GRAB_STAGE_KEYBOARD;
+        grab->request_window = window;
+        grab->request_screen = screen;
+        grab->request_hide_cursor = hide_cursor;
+        grab->request_nuked_focus = FALSE;
+        grab->request_attempts = 0;
+        grab->request_func = func;
+        grab->request_data = user_data;
+
+        gs_grab_request_step (grab);
+}
+
+/* Drops the pending request without calling its callback */
+void
+gs_grab_cancel (GSGrab *grab)
+{
+        g_return_if_fail (GS_IS_GRAB (grab));
+
+        if (grab->request != GRAB_REQUEST_NONE) {
+                gs_debug ("Cancelling pending grab request");
+        }
+
+        gs_grab_request_clear (grab);
+}
+
+/* Whether both the keyboard and the mouse are grabbed */
+gboolean
+gs_grab_get_held (GSGrab *grab)
+{
+        g_return_val_if_fail (GS_IS_GRAB (grab), FALSE);
+
+        return grab->keyboard_grab_window != NULL
+                && grab->mouse_grab_window != NULL;
+}
+
 void
 gs_grab_release (GSGrab *grab)
 {
         gs_debug ("Releasing all grabs");
 
+        gs_grab_cancel (grab);
+
         gs_grab_release_mouse (grab);
         gs_grab_release_keyboard (grab);
 
@@ -514,158 +709,191 @@ request_shell_exit_overview (GSGrab *grab)
         g_object_unref (message);
 }
 
-gboolean
+/* Grabs the keyboard and then the mouse, retrying from the main loop.
+ * func is called once both are held, or with FALSE when giving up.
+ * When the first attempt succeeds func is called before this returns.
+ * A pending request is replaced without calling its callback.
+ */
+void
 gs_grab_grab_window (GSGrab    *grab,
                      GdkWindow *window,
                      GdkScreen *screen,
-                     gboolean   hide_cursor)
+                     gboolean   hide_cursor,
+                     GSGrabFunc func,
+                     gpointer   user_data)
 {
-        gboolean mstatus = FALSE;
-        gboolean kstatus = FALSE;
-        int      i;
-        int      retries = 4;
-        gboolean focus_fuckus = FALSE;
-
-        g_return_val_if_fail (GS_IS_GRAB (grab), FALSE);
+        g_return_if_fail (GS_IS_GRAB (grab));
 
         /* First, have stuff we control in GNOME un-grab */
         request_shell_exit_overview (grab);
 
- AGAIN:
+        gs_grab_request_start (grab, GRAB_REQUEST_GRAB,
+                               window, screen, hide_cursor,
+                               func, user_data);
+}
 
-        for (i = 0; i < retries; i++) {
-                kstatus = gs_grab_get_keyboard (grab, window, screen);
-                if (kstatus == GDK_GRAB_SUCCESS) {
-                        break;
-                }
+/* this is used to grab the keyboard and mouse to the root */
+void
+gs_grab_grab_root (GSGrab    *grab,
+                   gboolean   hide_cursor,
+                   GSGrabFunc func,
+                   gpointer   user_data)
+{
+        GdkWindow  *root;
+        GdkScreen  *screen;
 
-                /* else, wait a second and try to grab again. */
-                sleep (1);
-        }
+        g_return_if_fail (GS_IS_GRAB (grab));
 
-        if (kstatus != GDK_GRAB_SUCCESS) {
-                if (!focus_fuckus) {
-                        focus_fuckus = TRUE;
-                        gs_grab_nuke_focus ();
-                        goto AGAIN;
-                }
-        }
+        gs_debug ("Grabbing the root window");
 
-        for (i = 0; i < retries; i++) {
-                mstatus = gs_grab_get_mouse (grab, window, screen, hide_cursor);
-                if (mstatus == GDK_GRAB_SUCCESS) {
-                        break;
-                }
+        gs_grab_get_pointer_position (grab, &screen, NULL, NULL);
+        root = gdk_screen_get_root_window (screen);
 
-                /* else, wait a second and try to grab again. */
-                sleep (1);
-        }
+        gs_grab_grab_window (grab, root, screen, hide_cursor, func, user_data);
+}
 
-        if (mstatus != GDK_GRAB_SUCCESS) {
-                gs_debug ("Couldn't grab pointer!  (%s)",
-                          grab_string (mstatus));
-        }
+/* this is used to grab the keyboard and mouse to an offscreen window */
+void
+gs_grab_grab_offscreen (GSGrab    *grab,
+                        gboolean   hide_cursor,
+                        GSGrabFunc func,
+                        gpointer   user_data)
+{
+        GdkScreen *screen;
 
-#if 0
-        /* FIXME: release the pointer grab so GTK will work */
-        gs_grab_release_mouse (grab);
-#endif
+        g_return_if_fail (GS_IS_GRAB (grab));
 
-        /* When should we allow blanking to proceed?  The current theory
-           is that both a keyboard grab and a mouse grab are mandatory
+        gs_debug ("Grabbing an offscreen window");
 
-           - If we don't have a keyboard grab, then we won't be able to
-           read a password to unlock, so the kbd grab is manditory.
+        screen = gtk_invisible_get_screen (GTK_INVISIBLE (grab->invisible));
+        gs_grab_grab_window (grab, gtk_widget_get_window (grab->invisible), screen,
+                             hide_cursor, func, user_data);
+}
 
-           - If we don't have a mouse grab, then we might not see mouse
-           clicks as a signal to unblank, on-screen widgets won't work ideally,
-           and gs_grab_move_to_window() will spin forever when it gets called.
-        */
+/* This is similar to gs_grab_grab_window but doesn't fail,
+ * it keeps retrying until the grab moved or the request is replaced.
+ */
+void
+gs_grab_move_to_window (GSGrab    *grab,
+                        GdkWindow *window,
+                        GdkScreen *screen,
+                        gboolean   hide_cursor,
+                        GSGrabFunc func,
+                        gpointer   user_data)
+{
+        g_return_if_fail (GS_IS_GRAB (grab));
 
-        if (kstatus != GDK_GRAB_SUCCESS || mstatus != GDK_GRAB_SUCCESS) {
-                /* Do not blank without a keyboard and mouse grabs. */
+        xorg_lock_smasher_set_active (grab, FALSE);
 
-                /* Release keyboard or mouse which was grabbed. */
-                if (kstatus == GDK_GRAB_SUCCESS) {
-                        gs_grab_release_keyboard (grab);
-                }
-                if (mstatus == GDK_GRAB_SUCCESS) {
-                        gs_grab_release_mouse (grab);
-                }
+        gs_grab_request_start (grab, GRAB_REQUEST_MOVE,
+                               window, screen, hide_cursor,
+                               func, user_data);
+}
 
-                return FALSE;
-        }
+static gboolean
+pointer_position_clear (GSGrab *grab)
+{
+        grab->pointer_clear_id = 0;
+        grab->pointer_screen = NULL;
 
-        /* Grab is good, go ahead and blank.  */
-        return TRUE;
+        return G_SOURCE_REMOVE;
 }
 
-/* this is used to grab the keyboard and mouse to the root */
-gboolean
-gs_grab_grab_root (GSGrab  *grab,
-                   gboolean hide_cursor)
+/* Windows are mapped in bursts, so the position is queried once
+ * and reused until the main loop goes idle.
+ */
+void
+gs_grab_get_pointer_position (GSGrab     *grab,
+                              GdkScreen **screen,
+                              gint       *x,
+                              gint       *y)
 {
-        GdkDisplay *display;
-        GdkWindow  *root;
-        GdkScreen  *screen;
-        gboolean    res;
+        g_return_if_fail (GS_IS_GRAB (grab));
 
-        g_return_val_if_fail (GS_IS_GRAB (grab), FALSE);
+        if (grab->pointer_screen == NULL) {
+                grab->pointer_x = -1;
+                grab->pointer_y = -1;
+                gdk_device_get_position (grab->client_pointer,
+                                         &grab->pointer_screen,
+                                         &grab->pointer_x,
+                                         &grab->pointer_y);
+                if (grab->pointer_clear_id == 0)
+                        grab->pointer_clear_id = g_idle_add ((GSourceFunc) pointer_position_clear, grab);
+        }
 
-        gs_debug ("Grabbing the root window");
+        if (screen != NULL)
+                *screen = grab->pointer_screen;
+        if (x != NULL)
+                *x = grab->pointer_x;
+        if (y != NULL)
+                *y = grab->pointer_y;
+}
 
-        display = gdk_display_get_default ();
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        GdkDevice *pointer = gdk_device_manager_get_client_pointer (device_manager);
-        gint x = -1, y = -1;
-        gdk_device_get_position (pointer, &screen, &x, &y);
-        root = gdk_screen_get_root_window (screen);
+static void
+device_added_cb (GdkDeviceManager *device_manager,
+                 GdkDevice        *device,
+                 GSGrab           *grab)
+{
+        if (gdk_device_get_device_type (device) != GDK_DEVICE_TYPE_MASTER)
+                return;
+
+        switch (gdk_device_get_source (device)) {
+        case GDK_SOURCE_MOUSE:
+                grab->pointers = g_list_prepend (grab->pointers, g_object_ref (device));
+                break;
+        case GDK_SOURCE_KEYBOARD:
+                grab->keyboards = g_list_prepend (grab->keyboards, g_object_ref (device));
+                break;
+        default:
+                return;
+        }
 
-        res = gs_grab_grab_window (grab, root, screen, hide_cursor);
+        gs_debug ("Master device added: %s", gdk_device_get_name (device));
 
-        return res;
+        grab->client_pointer = gdk_device_manager_get_client_pointer (device_manager);
 }
 
-/* this is used to grab the keyboard and mouse to an offscreen window */
-gboolean
-gs_grab_grab_offscreen (GSGrab *grab,
-                        gboolean hide_cursor)
+static void
+device_removed_cb (GdkDeviceManager *device_manager,
+                   GdkDevice        *device,
+                   GSGrab           *grab)
 {
-        GdkScreen *screen;
-        gboolean   res;
-
-        g_return_val_if_fail (GS_IS_GRAB (grab), FALSE);
+        GList *link;
 
-        gs_debug ("Grabbing an offscreen window");
+        if ((link = g_list_find (grab->pointers, device)) != NULL) {
+                grab->pointers = g_list_delete_link (grab->pointers, link);
+        } else if ((link = g_list_find (grab->keyboards, device)) != NULL) {
+                grab->keyboards = g_list_delete_link (grab->keyboards, link);
+        } else {
+                return;
+        }
 
-        screen = gtk_invisible_get_screen (GTK_INVISIBLE (grab->invisible));
-        res = gs_grab_grab_window (grab, gtk_widget_get_window (grab->invisible), screen, hide_cursor);
+        gs_debug ("Master device removed: %s", gdk_device_get_name (device));
 
-        return res;
+        g_object_unref (device);
+        grab->client_pointer = gdk_device_manager_get_client_pointer (device_manager);
+        grab->pointer_screen = NULL;
 }
 
-/* This is similar to gs_grab_grab_window but doesn't fail */
-void
-gs_grab_move_to_window (GSGrab    *grab,
-                        GdkWindow *window,
-                        GdkScreen *screen,
-                        gboolean   hide_cursor)
+static void
+devices_init (GSGrab *grab)
 {
-        gboolean result = FALSE;
+        GList *list, *link;
 
-        g_return_if_fail (GS_IS_GRAB (grab));
+        grab->device_manager = gdk_display_get_device_manager (gdk_display_get_default ());
 
-        xorg_lock_smasher_set_active (grab, FALSE);
+        list = gdk_device_manager_list_devices (grab->device_manager, GDK_DEVICE_TYPE_MASTER);
+        for (link = list; link != NULL; link = g_list_next (link)) {
+                device_added_cb (grab->device_manager, GDK_DEVICE (link->data), grab);
+        }
+        g_list_free (list);
 
-        do {
-                result = gs_grab_move_keyboard (grab, window, screen);
-                gdk_flush ();
-        } while (!result);
+        grab->client_pointer = gdk_device_manager_get_client_pointer (grab->device_manager);
 
-        do {
-                result = gs_grab_move_mouse (grab, window, screen, hide_cursor);
-                gdk_flush ();
-        } while (!result);
+        grab->device_added_id = g_signal_connect (grab->device_manager, "device-added",
+                                                  G_CALLBACK (device_added_cb), grab);
+        grab->device_removed_id = g_signal_connect (grab->device_manager, "device-removed",
+                                                    G_CALLBACK (device_removed_cb), grab);
 }
 
 static void
@@ -684,6 +912,8 @@ gs_grab_init (GSGrab *grab)
         grab->mouse_hide_cursor = FALSE;
         grab->invisible = gtk_invisible_new ();
         gtk_widget_show (grab->invisible);
+
+        devices_init (grab);
 }
 
 static void
@@ -691,6 +921,15 @@ gs_grab_finalize (GObject *object)
 {
         GSGrab *grab = GS_GRAB (object);
 
+        gs_grab_request_clear (grab);
+
+        g_signal_handler_disconnect (grab->device_manager, grab->device_added_id);
+        g_signal_handler_disconnect (grab->device_manager, grab->device_removed_id);
+        g_list_free_full (grab->pointers, g_object_unref);
+        g_list_free_full (grab->keyboards, g_object_unref);
+        if (grab->pointer_clear_id != 0)
+                g_source_remove (grab->pointer_clear_id);
+
         g_clear_object (&grab->session_bus);
         gtk_widget_destroy (grab->invisible);
 
@@ -31,25 +31,44 @@ G_BEGIN_DECLS
 #define GS_TYPE_GRAB gs_grab_get_type ()
 G_DECLARE_FINAL_TYPE (GSGrab, gs_grab, GS, GRAB, GObject)
 
+typedef void (* GSGrabFunc) (GSGrab   *grab,
+                             gboolean  success,
+                             gpointer  user_data);
+
 GSGrab  * gs_grab_new              (void);
 
 void      gs_grab_release          (GSGrab    *grab);
 gboolean  gs_grab_release_mouse    (GSGrab    *grab);
+void      gs_grab_cancel           (GSGrab    *grab);
+gboolean  gs_grab_get_held         (GSGrab    *grab);
 
-gboolean  gs_grab_grab_window      (GSGrab    *grab,
+void      gs_grab_grab_window      (GSGrab    *grab,
                                     GdkWindow *window,
                                     GdkScreen *screen,
-                                    gboolean   hide_cursor);
+                                    gboolean   hide_cursor,
+                                    GSGrabFunc func,
+                                    gpointer   user_data);
 
-gboolean  gs_grab_grab_root        (GSGrab    *grab,
-                                    gboolean   hide_cursor);
-gboolean  gs_grab_grab_offscreen   (GSGrab    *grab,
-                                    gboolean   hide_cursor);
+void      gs_grab_grab_root        (GSGrab    *grab,
+                                    gboolean   hide_cursor,
+                                    GSGrabFunc func,
+                                    gpointer   user_data);
+void      gs_grab_grab_offscreen   (GSGrab    *grab,
+                                    gboolean   hide_cursor,
+                                    GSGrabFunc func,
+                                    gpointer   user_data);
 
 void      gs_grab_move_to_window   (GSGrab    *grab,
                                     GdkWindow *window,
                                     GdkScreen *screen,
-                                    gboolean   hide_cursor);
+                                    gboolean   hide_cursor,
+                                    GSGrabFunc func,
+                                    gpointer   user_data);
+
+void      gs_grab_get_pointer_position (GSGrab     *grab,
+                                        GdkScreen **screen,
+                                        gint       *x,
+                                        gint       *y);
 
 void      gs_grab_mouse_reset      (GSGrab    *grab);
 void      gs_grab_keyboard_reset   (GSGrab    *grab);
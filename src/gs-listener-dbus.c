@@ -28,10 +28,11 @@
 #include <unistd.h>
 
 #include <glib/gi18n.h>
+#include <gio/gio.h>
 
-#include <dbus/dbus.h>
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
+#ifdef WITH_SYSTEMD
+#include <gio/gunixfdlist.h>
+#endif
 
 #ifdef HAVE_MIT_SAVER_EXTENSION
 #include <gtk/gtk.h>
@@ -46,30 +47,70 @@
 #include "gs-listener-dbus.h"
 #include "gs-marshal.h"
 #include "gs-debug.h"
+#include "gs-trace.h"
+#include "gs-probe.h"
 #include "gs-bus.h"
 
-/* this is for dbus < 0.3 */
-#if ((DBUS_VERSION_MAJOR == 0) && (DBUS_VERSION_MINOR < 30))
-#define dbus_bus_name_has_owner(connection, name, err)      dbus_bus_service_exists(connection, name, err)
-#define dbus_bus_request_name(connection, name, flags, err) dbus_bus_acquire_service(connection, name, flags, err)
-#endif
+/* From the D-Bus specification, RequestName */
+#define DBUS_NAME_FLAG_DO_NOT_QUEUE        0x4
+#define DBUS_REQUEST_NAME_REPLY_EXISTS     3
 
 static void              gs_listener_class_init         (GSListenerClass *klass);
 static void              gs_listener_init               (GSListener      *listener);
 static void              gs_listener_finalize           (GObject         *object);
 
-static DBusHandlerResult gs_listener_message_handler    (DBusConnection  *connection,
-                                                         DBusMessage     *message,
-                                                         void            *user_data);
+static void              inhibit_owner_vanished         (GDBusConnection *connection,
+                                                         const char      *name,
+                                                         gpointer         user_data);
+
+/* How long to wait for an answer on the system bus, in ms. */
+#define SYSTEM_BUS_TIMEOUT   5000
+
+/* GetSessionByPID is retried when logind is too slow to answer,
+ * after SESSION_ID_RETRY_INITIAL ms and doubling up to
+ * SESSION_ID_RETRY_MAX ms.
+ */
+#define SESSION_ID_RETRY_INITIAL 250
+#define SESSION_ID_RETRY_MAX     8000
+
+/* Most inhibitors a single client can hold at once. */
+#define MAX_INHIBITORS_PER_OWNER 64
+
+/* Longest we hold up a suspend, in ms. Below the 5 seconds logind
+ * waits for delay inhibitors by default. */
+#define DELAY_DEADLINE 3000
 
-#define TYPE_MISMATCH_ERROR  GS_INTERFACE ".TypeMismatch"
+/* Hold times of the last suspends, kept for the diagnostics. */
+#define DELAY_HISTORY 16
 
 #define GS_LISTENER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GS_TYPE_LISTENER, GSListenerPrivate))
 
+/* The objects we export and the interfaces on them. */
+static const struct {
+        const char *path;
+        const char *interface;
+} exported_objects [] = {
+        { GS_PATH,       GS_INTERFACE },
+        { GS_PATH,       LL_DIAGNOSTICS_INTERFACE },
+        { GS_PATH,       DBUS_INTROSPECTABLE_INTERFACE },
+        { GS_PATH_KDE,   GS_INTERFACE },
+        { GS_PATH_KDE,   DBUS_INTROSPECTABLE_INTERFACE },
+        { GS_PATH_GNOME, GS_INTERFACE_GNOME },
+        { GS_PATH_GNOME, DBUS_INTROSPECTABLE_INTERFACE },
+};
+
 struct GSListenerPrivate
 {
-        DBusConnection *connection;
-        DBusConnection *system_connection;
+        GDBusConnection *connection;
+        GDBusConnection *system_connection;
+
+        guint           object_ids [G_N_ELEMENTS (exported_objects)];
+        GSList         *system_subscriptions;
+        guint           acquired : 1;
+        guint           session_subscribed : 1;
+        guint           seat_subscribed : 1;
+        /* Signals delivered to us, to check how well the matches filter. */
+        guint           signal_wakeups;
 
         guint           active : 1;
         guint           lid_closed : 1;
@@ -78,14 +119,46 @@ struct GSListenerPrivate
         char           *session_id;
         char           *seat_path;
 
+        /* Cancels all outstanding calls on the system bus. */
+        GCancellable   *cancellable;
+
 #ifdef WITH_SYSTEMD
         gboolean        have_systemd;
         char           *sd_session_id;
+        char           *logind_seat;
+        guint           session_id_retry_id;
+        guint           session_id_retry_delay;
         int             delay_fd;
+        GCancellable   *delay_cancellable;
+        /* When logind started waiting for us, 0 while it isn't. */
+        gint64          delay_wait_start;
+        guint           delay_deadline_id;
 #endif
 
-        dbus_uint32_t   inhibit_last_cookie;
+        /* Suspends held up by the delay, those released by the deadline
+         * and the hold times in microseconds. */
+        guint           delay_holds;
+        guint           delay_expired;
+        guint64         delay_hold_max;
+        guint64         delay_hold_sum;
+        guint64         delay_hold_history [DELAY_HISTORY];
+
+        guint32         inhibit_last_cookie;
+        /* cookie -> Inhibitor */
         GHashTable     *inhibit_list;
+        /* unique name -> InhibitOwner */
+        GHashTable     *inhibit_owners;
+
+        /* PropertiesChanged signals answered from their payload,
+         * and those that still needed a Get round trip. */
+        guint           queries_saved;
+        guint           queries_made;
+
+        /* interface -> member -> MethodEntry */
+        GHashTable     *methods;
+
+        /* Owned by the monitor, exposed in the diagnostics. */
+        GSLockMachine  *lock_machine;
 };
 
 enum {
@@ -108,18 +181,262 @@ enum {
         PROP_LID_CLOSED,
 };
 
-static DBusObjectPathVTable
-gs_listener_vtable = { NULL,
-                       &gs_listener_message_handler,
-                       NULL,
-                       NULL,
-                       NULL,
-                       NULL };
+static const char introspection_xml [] =
+        "<node>\n"
+        "  <interface name=\""GS_INTERFACE"\">\n"
+        "    <method name=\"Lock\">\n"
+        "    </method>\n"
+        "    <method name=\"SimulateUserActivity\">\n"
+        "    </method>\n"
+        "    <method name=\"GetActive\">\n"
+        "      <arg direction=\"out\" type=\"b\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetActiveTime\">\n"
+        "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetSessionIdleTime\">\n"
+        "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <method name=\"SetActive\">\n"
+        "      <arg direction=\"out\" type=\"b\"/>\n"
+        "      <arg name=\"e\" direction=\"in\" type=\"b\"/>\n"
+        "    </method>\n"
+        "    <method name=\"Inhibit\">\n"
+        "      <arg direction=\"out\" type=\"u\"/>\n"
+        "      <arg name=\"application_name\" direction=\"in\" type=\"s\"/>\n"
+        "      <arg name=\"reason_for_inhibit\" direction=\"in\" type=\"s\"/>\n"
+        "    </method>\n"
+        "    <method name=\"UnInhibit\">\n"
+        "      <arg name=\"cookie\" direction=\"in\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <signal name=\"ActiveChanged\">\n"
+        "      <arg type=\"b\"/>\n"
+        "    </signal>\n"
+        "  </interface>\n"
+        "  <interface name=\""GS_INTERFACE_GNOME"\">\n"
+        "    <method name=\"Lock\">\n"
+        "    </method>\n"
+        "    <method name=\"SimulateUserActivity\">\n"
+        "    </method>\n"
+        "    <method name=\"GetActive\">\n"
+        "      <arg direction=\"out\" type=\"b\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetActiveTime\">\n"
+        "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <method name=\"SetActive\">\n"
+        "      <arg name=\"e\" direction=\"in\" type=\"b\"/>\n"
+        "    </method>\n"
+        "    <signal name=\"ActiveChanged\">\n"
+        "      <arg type=\"b\"/>\n"
+        "    </signal>\n"
+        "  </interface>\n"
+        "  <interface name=\""LL_DIAGNOSTICS_INTERFACE"\">\n"
+        "    <method name=\"GetLockLatency\">\n"
+        "      <arg name=\"histograms\" direction=\"out\" type=\"a(ssutttau)\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetMethodStats\">\n"
+        "      <arg name=\"calls\" direction=\"out\" type=\"a(ssu)\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetQueryStats\">\n"
+        "      <arg name=\"saved\" direction=\"out\" type=\"u\"/>\n"
+        "      <arg name=\"made\" direction=\"out\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetSignalWakeups\">\n"
+        "      <arg name=\"wakeups\" direction=\"out\" type=\"u\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetInhibitors\">\n"
+        "      <arg name=\"inhibitors\" direction=\"out\" type=\"a(usssu)\"/>\n"
+        "    </method>\n"
+        "    <method name=\"DumpFlightRecorder\">\n"
+        "      <arg name=\"path\" direction=\"out\" type=\"s\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetLockStates\">\n"
+        "      <arg name=\"current\" direction=\"out\" type=\"s\"/>\n"
+        "      <arg name=\"states\" direction=\"out\" type=\"a(sutx)\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetLockEvents\">\n"
+        "      <arg name=\"events\" direction=\"out\" type=\"a(xsssb)\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetSuspendDelays\">\n"
+        "      <arg name=\"holds\" direction=\"out\" type=\"u\"/>\n"
+        "      <arg name=\"expired\" direction=\"out\" type=\"u\"/>\n"
+        "      <arg name=\"max\" direction=\"out\" type=\"t\"/>\n"
+        "      <arg name=\"total\" direction=\"out\" type=\"t\"/>\n"
+        "      <arg name=\"recent\" direction=\"out\" type=\"at\"/>\n"
+        "    </method>\n"
+        "  </interface>\n"
+        "  <interface name=\""DBUS_INTROSPECTABLE_INTERFACE"\">\n"
+        "    <method name=\"Introspect\">\n"
+        "      <arg name=\"data\" direction=\"out\" type=\"s\"/>\n"
+        "    </method>\n"
+        "  </interface>\n"
+        "</node>\n";
+
+/* Parsed once, shared by all the exported objects. */
+static GDBusNodeInfo *introspection_data = NULL;
+
+/* object path -> Introspect reply, built on first use and never changed. */
+static GHashTable    *introspect_replies = NULL;
 
 static guint         signals [LAST_SIGNAL] = { 0, };
 
 G_DEFINE_TYPE (GSListener, gs_listener, G_TYPE_OBJECT)
 
+typedef void (* MethodFunc) (GSListener            *listener,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation);
+
+enum {
+        /* Called too often to be logged every time. */
+        METHOD_QUIET = 1 << 0
+};
+
+typedef struct {
+        const char *interface;
+        const char *member;
+        MethodFunc  func;
+        guint       flags;
+        guint       calls;
+} MethodEntry;
+
+typedef void (* SystemReplyFunc) (GSListener *listener,
+                                  GVariant   *reply);
+
+typedef struct {
+        GSListener      *listener;
+        SystemReplyFunc  func;
+} SystemCallData;
+
+static void
+system_call_done (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+        SystemCallData *data = user_data;
+        GVariant       *reply;
+        GError         *error = NULL;
+
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+
+        if (reply == NULL) {
+                /* The listener may be gone already. */
+                if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_error_free (error);
+                        g_free (data);
+                        return;
+                }
+
+                gs_debug ("%s", error->message);
+                g_error_free (error);
+        }
+
+        /* A NULL reply means the call failed or timed out. */
+        data->func (data->listener, reply);
+
+        if (reply != NULL) {
+                g_variant_unref (reply);
+        }
+
+        g_free (data);
+}
+
+/* Calls a method on the system bus without blocking,
+ * func is called from the main loop with the reply.
+ */
+static void
+send_system_call (GSListener         *listener,
+                  const char         *service,
+                  const char         *path,
+                  const char         *interface,
+                  const char         *method,
+                  GVariant           *parameters,
+                  const GVariantType *reply_type,
+                  SystemReplyFunc     func)
+{
+        SystemCallData *data;
+
+        data = g_new (SystemCallData, 1);
+        data->listener = listener;
+        data->func = func;
+
+        g_dbus_connection_call (listener->priv->system_connection,
+                                service,
+                                path,
+                                interface,
+                                method,
+                                parameters,
+                                reply_type,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                SYSTEM_BUS_TIMEOUT,
+                                listener->priv->cancellable,
+                                system_call_done,
+                                data);
+}
+
+static void
+send_property_get (GSListener      *listener,
+                   const char      *service,
+                   const char      *path,
+                   const char      *interface,
+                   const char      *property,
+                   SystemReplyFunc  func)
+{
+        send_system_call (listener,
+                          service,
+                          path,
+                          DBUS_PROPERTIES_INTERFACE,
+                          "Get",
+                          g_variant_new ("(ss)", interface, property),
+                          G_VARIANT_TYPE ("(v)"),
+                          func);
+}
+
+/* Returns the value in a Properties.Get reply, if it has the given type. */
+static GVariant *
+property_get_reply_value (GVariant           *reply,
+                          const GVariantType *type)
+{
+        GVariant *value;
+
+        if (reply == NULL)
+                return NULL;
+
+        g_variant_get (reply, "(v)", &value);
+
+        if (g_variant_is_of_type (value, type)) {
+                return value;
+        }
+
+        gs_debug ("Unexpected return type");
+        g_variant_unref (value);
+
+        return NULL;
+}
+
+/* Sends a method call on the system bus without waiting for an answer. */
+static void
+send_system_message (GSListener *listener,
+                     const char *service,
+                     const char *path,
+                     const char *interface,
+                     const char *method,
+                     GVariant   *parameters)
+{
+        g_dbus_connection_call (listener->priv->system_connection,
+                                service,
+                                path,
+                                interface,
+                                method,
+                                parameters,
+                                NULL,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                NULL,
+                                NULL,
+                                NULL);
+}
+
 gboolean
 gs_listener_is_lid_closed (GSListener *listener)
 {
@@ -129,9 +446,6 @@ gs_listener_is_lid_closed (GSListener *listener)
 void
 gs_listener_send_switch_greeter (GSListener *listener)
 {
-        dbus_bool_t sent;
-        DBusMessage *message;
-
         gs_debug ("Send switch greeter");
 
 #ifdef WITH_SYSTEMD
@@ -149,30 +463,22 @@ gs_listener_send_switch_greeter (GSListener *listener)
                 return;
         }
 
-        message = dbus_message_new_method_call (DM_SERVICE,
-                                                listener->priv->seat_path,
-                                                DM_SEAT_INTERFACE,
-                                                "SwitchToGreeter");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
+        if (listener->priv->seat_path == NULL) {
+                gs_debug ("Seat not known yet");
                 return;
         }
 
-        sent = dbus_connection_send (listener->priv->system_connection, message, NULL);
-        dbus_message_unref (message);
-
-        if (sent == FALSE) {
-                gs_debug ("Couldn't send the dbus message");
-                return;
-        }
+        send_system_message (listener,
+                             DM_SERVICE,
+                             listener->priv->seat_path,
+                             DM_SEAT_INTERFACE,
+                             "SwitchToGreeter",
+                             NULL);
 }
 
 void
 gs_listener_send_lock_session (GSListener *listener)
 {
-        dbus_bool_t sent;
-        DBusMessage *message;
-
         gs_debug ("Send lock session");
 
 #ifdef WITH_SYSTEMD
@@ -190,22 +496,12 @@ gs_listener_send_lock_session (GSListener *listener)
                 return;
         }
 
-        message = dbus_message_new_method_call (DM_SERVICE,
-                                                DM_SESSION_PATH,
-                                                DM_SESSION_INTERFACE,
-                                                "Lock");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
-                return;
-        }
-
-        sent = dbus_connection_send (listener->priv->system_connection, message, NULL);
-        dbus_message_unref (message);
-
-        if (sent == FALSE) {
-                gs_debug ("Couldn't send the dbus message");
-                return;
-        }
+        send_system_message (listener,
+                             DM_SERVICE,
+                             DM_SESSION_PATH,
+                             DM_SESSION_INTERFACE,
+                             "Lock",
+                             NULL);
 }
 
 GQuark
@@ -219,81 +515,42 @@ gs_listener_error_quark (void)
         return quark;
 }
 
-static gboolean
-send_dbus_message (DBusConnection *connection,
-                   DBusMessage    *message)
-{
-        gboolean is_connected;
-        gboolean sent;
-
-        g_return_val_if_fail (message != NULL, FALSE);
-
-        if (! connection) {
-                gs_debug ("There is no valid connection to the message bus");
-                return FALSE;
-        }
-
-        is_connected = dbus_connection_get_is_connected (connection);
-        if (! is_connected) {
-                gs_debug ("Not connected to the message bus");
-                return FALSE;
-        }
-
-        sent = dbus_connection_send (connection, message, NULL);
-
-        return sent;
-}
-
 static void
 send_dbus_boolean_signal (GSListener *listener,
                           const char *name,
                           gboolean    value)
 {
-        DBusMessage    *message;
-        DBusMessageIter iter;
+        guint i;
 
         g_return_if_fail (listener != NULL);
 
-        message = dbus_message_new_signal (GS_PATH,
-                                           GS_INTERFACE,
-                                           name);
-
-        dbus_message_iter_init_append (message, &iter);
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &value);
-
-        if (! send_dbus_message (listener->priv->connection, message)) {
-                gs_debug ("Could not send %s signal", name);
-        }
-
-        dbus_message_unref (message);
-
-        /* Emit the signal on the KDE path */
-        message = dbus_message_new_signal (GS_PATH_KDE,
-                                           GS_INTERFACE,
-                                           name);
-
-        dbus_message_iter_init_append (message, &iter);
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &value);
-
-        if (! send_dbus_message (listener->priv->connection, message)) {
-                gs_debug ("Could not send %s signal", name);
+        if (listener->priv->connection == NULL) {
+                gs_debug ("There is no valid connection to the message bus");
+                return;
         }
 
-        dbus_message_unref (message);
-
-        /* Emit the signal on the GNOME interface */
-        message = dbus_message_new_signal (GS_PATH_GNOME,
-                                           GS_INTERFACE_GNOME,
-                                           name);
+        /* Emit the signal on every path, including KDE and GNOME */
+        for (i = 0; i < G_N_ELEMENTS (exported_objects); i++) {
+                GDBusInterfaceInfo *info;
+                GError             *error = NULL;
 
-        dbus_message_iter_init_append (message, &iter);
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &value);
+                info = g_dbus_node_info_lookup_interface (introspection_data,
+                                                          exported_objects [i].interface);
+                if (g_dbus_interface_info_lookup_signal (info, name) == NULL) {
+                        continue;
+                }
 
-        if (! send_dbus_message (listener->priv->connection, message)) {
-                gs_debug ("Could not send %s signal", name);
+                if (! g_dbus_connection_emit_signal (listener->priv->connection,
+                                                     NULL,
+                                                     exported_objects [i].path,
+                                                     exported_objects [i].interface,
+                                                     name,
+                                                     g_variant_new ("(b)", value),
+                                                     &error)) {
+                        gs_debug ("Could not send %s signal: %s", name, error->message);
+                        g_error_free (error);
+                }
         }
-
-        dbus_message_unref (message);
 }
 
 static void
@@ -354,9 +611,6 @@ gs_listener_set_active (GSListener *listener,
 void
 gs_listener_set_idle_hint (GSListener *listener, gboolean idle)
 {
-        dbus_bool_t sent;
-        DBusMessage *message;
-
         gs_debug ("Send idle hint: %d", idle);
 
 #ifdef WITH_SYSTEMD
@@ -367,30 +621,17 @@ gs_listener_set_idle_hint (GSListener *listener, gboolean idle)
                         return;
                 }
 
-                message = dbus_message_new_method_call (SYSTEMD_LOGIND_SERVICE,
-                                                        listener->priv->session_id,
-                                                        SYSTEMD_LOGIND_SESSION_INTERFACE,
-                                                        "SetIdleHint");
-                if (message == NULL) {
-                        gs_debug ("Couldn't allocate the dbus message");
-                        return;
-                }
-
-                if (dbus_message_append_args (message,
-                                              DBUS_TYPE_BOOLEAN, &idle,
-                                              DBUS_TYPE_INVALID) == FALSE) {
-                        gs_debug ("Couldn't add args to the dbus message");
-                        dbus_message_unref (message);
+                if (listener->priv->session_id == NULL) {
+                        gs_debug ("Session id not known yet");
                         return;
                 }
 
-                sent = dbus_connection_send (listener->priv->system_connection, message, NULL);
-                dbus_message_unref (message);
-
-                if (sent == FALSE) {
-                        gs_debug ("Couldn't send the dbus message");
-                        return;
-                }
+                send_system_message (listener,
+                                     SYSTEMD_LOGIND_SERVICE,
+                                     listener->priv->session_id,
+                                     SYSTEMD_LOGIND_SESSION_INTERFACE,
+                                     "SetIdleHint",
+                                     g_variant_new ("(b)", idle));
 
                 return;
         }
@@ -398,75 +639,144 @@ gs_listener_set_idle_hint (GSListener *listener, gboolean idle)
 }
 
 void
-gs_listener_delay_suspend (GSListener *listener)
+gs_listener_set_lock_machine (GSListener    *listener,
+                              GSLockMachine *machine)
 {
-#ifdef WITH_SYSTEMD
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       error;
-        const char     *what;
-        const char     *who;
-        const char     *why;
-        const char     *mode;
-        int             fd;
+        g_return_if_fail (GS_IS_LISTENER (listener));
 
-        gs_debug ("Delay suspend");
+        g_set_object (&listener->priv->lock_machine, machine);
+}
 
-        if (listener->priv->system_connection == NULL) {
-                gs_debug ("No connection to the system bus");
+#ifdef WITH_SYSTEMD
+static void
+delay_suspend_done (GObject      *source,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+        GSListener  *listener = user_data;
+        GUnixFDList *fd_list = NULL;
+        GVariant    *reply;
+        GError      *error = NULL;
+        gint32       index;
+        int          fd;
+
+        reply = g_dbus_connection_call_with_unix_fd_list_finish (G_DBUS_CONNECTION (source),
+                                                                 &fd_list,
+                                                                 result,
+                                                                 &error);
+
+        if (reply == NULL) {
+                /* Either resumed before logind answered or finalized. */
+                if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        gs_debug ("%s", error->message);
+                        g_clear_object (&listener->priv->delay_cancellable);
+                }
+                g_error_free (error);
                 return;
         }
 
-        dbus_error_init (&error);
+        g_clear_object (&listener->priv->delay_cancellable);
+
+        g_variant_get (reply, "(h)", &index);
+        g_variant_unref (reply);
 
-        message = dbus_message_new_method_call (SYSTEMD_LOGIND_SERVICE, SYSTEMD_LOGIND_PATH, SYSTEMD_LOGIND_INTERFACE, "Inhibit");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
+        fd = g_unix_fd_list_get (fd_list, index, &error);
+        g_object_unref (fd_list);
+
+        if (fd < 0) {
+                gs_debug ("%s", error->message);
+                g_error_free (error);
                 return;
         }
 
-        what = "sleep";
-        who  = _("Screen Locker");
-        why  = _("Lock the screen on suspend/resume");
-        mode = "delay";
+        gs_debug ("Got suspend delay: fd=%d", fd);
+
+        listener->priv->delay_fd = fd;
+}
+
+static void
+delay_record_hold (GSListener *listener)
+{
+        guint64 hold;
 
-        if (dbus_message_append_args (message,
-                                      DBUS_TYPE_STRING, &what,
-                                      DBUS_TYPE_STRING, &who,
-                                      DBUS_TYPE_STRING, &why,
-                                      DBUS_TYPE_STRING, &mode,
-                                      DBUS_TYPE_INVALID) == FALSE) {
-                gs_debug ("Couldn't add args to the dbus message");
-                dbus_message_unref (message);
+        if (listener->priv->delay_wait_start == 0)
                 return;
-        }
 
-        reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-                                                           message,
-                                                           -1, &error);
-        dbus_message_unref (message);
+        hold = g_get_monotonic_time () - listener->priv->delay_wait_start;
+        listener->priv->delay_wait_start = 0;
+
+        gs_debug ("Held up suspend for %" G_GUINT64_FORMAT " ms", hold / 1000);
+
+        listener->priv->delay_hold_history [listener->priv->delay_holds % DELAY_HISTORY] = hold;
+        listener->priv->delay_holds++;
+        listener->priv->delay_hold_sum += hold;
+        if (hold > listener->priv->delay_hold_max)
+                listener->priv->delay_hold_max = hold;
+}
+
+#ifdef WITH_LOCK_ON_SUSPEND
+static gboolean
+delay_deadline_cb (GSListener *listener)
+{
+        listener->priv->delay_deadline_id = 0;
+
+        gs_debug ("Lock screen not up in time, releasing the suspend delay");
+        listener->priv->delay_expired++;
+        gs_listener_resume_suspend (listener);
 
-        if (dbus_error_is_set (&error)) {
-                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                dbus_error_free (&error);
+        return G_SOURCE_REMOVE;
+}
+
+/* logind waits for the delay from now on, bound how long. */
+static void
+delay_wait_begin (GSListener *listener)
+{
+        if (listener->priv->delay_fd < 0 || listener->priv->delay_wait_start != 0)
                 return;
-        }
 
-        if (dbus_message_get_args (reply, &error,
-                                   DBUS_TYPE_UNIX_FD, &fd,
-                                   DBUS_TYPE_INVALID) == FALSE) {
-                fd = -1;
-        }
+        listener->priv->delay_wait_start = g_get_monotonic_time ();
+        listener->priv->delay_deadline_id = g_timeout_add (DELAY_DEADLINE,
+                                                           (GSourceFunc) delay_deadline_cb,
+                                                           listener);
+}
+#endif
+#endif
 
-        dbus_message_unref (reply);
+void
+gs_listener_delay_suspend (GSListener *listener)
+{
+#ifdef WITH_SYSTEMD
+        gs_debug ("Delay suspend");
 
-        if (dbus_error_is_set (&error)) {
-                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                dbus_error_free (&error);
+        if (listener->priv->system_connection == NULL) {
+                gs_debug ("No connection to the system bus");
                 return;
         }
 
-        listener->priv->delay_fd = fd;
+        if (listener->priv->delay_fd >= 0 || listener->priv->delay_cancellable != NULL) {
+                gs_debug ("Suspend is already delayed");
+                return;
+        }
+
+        listener->priv->delay_cancellable = g_cancellable_new ();
+
+        g_dbus_connection_call_with_unix_fd_list (listener->priv->system_connection,
+                                                  SYSTEMD_LOGIND_SERVICE,
+                                                  SYSTEMD_LOGIND_PATH,
+                                                  SYSTEMD_LOGIND_INTERFACE,
+                                                  "Inhibit",
+                                                  g_variant_new ("(ssss)",
+                                                                 "sleep",
+                                                                 _("Screen Locker"),
+                                                                 _("Lock the screen on suspend/resume"),
+                                                                 "delay"),
+                                                  G_VARIANT_TYPE ("(h)"),
+                                                  G_DBUS_CALL_FLAGS_NONE,
+                                                  SYSTEM_BUS_TIMEOUT,
+                                                  NULL,
+                                                  listener->priv->delay_cancellable,
+                                                  delay_suspend_done,
+                                                  listener);
 #endif
 }
 
@@ -476,988 +786,1097 @@ gs_listener_resume_suspend (GSListener *listener)
 #ifdef WITH_SYSTEMD
         gs_debug ("Resume suspend: fd=%d", listener->priv->delay_fd);
 
+        /* The delay we asked for isn't wanted anymore. */
+        if (listener->priv->delay_cancellable != NULL) {
+                g_cancellable_cancel (listener->priv->delay_cancellable);
+                g_clear_object (&listener->priv->delay_cancellable);
+        }
+
         if (listener->priv->delay_fd >= 0) {
                 close (listener->priv->delay_fd);
                 listener->priv->delay_fd = -1;
+
+                gs_trace_mark (GS_TRACE_DELAY_RELEASED);
+                delay_record_hold (listener);
+        }
+
+        if (listener->priv->delay_deadline_id != 0) {
+                g_source_remove (listener->priv->delay_deadline_id);
+                listener->priv->delay_deadline_id = 0;
         }
 #endif
 }
 
-static dbus_uint32_t
+typedef struct {
+        char       *name;
+        /* set of the cookies this owner holds */
+        GHashTable *cookies;
+        guint       watch_id;
+} InhibitOwner;
+
+typedef struct {
+        guint32       cookie;
+        InhibitOwner *owner;
+        char         *application;
+        char         *reason;
+        gint64        since;
+} Inhibitor;
+
+static void
+inhibitor_free (Inhibitor *inhibitor)
+{
+        g_free (inhibitor->application);
+        g_free (inhibitor->reason);
+        g_free (inhibitor);
+}
+
+static void
+inhibit_owner_free (InhibitOwner *owner)
+{
+        if (owner->watch_id != 0)
+                g_bus_unwatch_name (owner->watch_id);
+
+        g_hash_table_destroy (owner->cookies);
+        g_free (owner->name);
+        g_free (owner);
+}
+
+/* Only the owners holding a cookie are watched for disconnects.  The
+ * watch asks the bus for the current owner, so a client that went away
+ * before its Inhibit call was handled is still noticed. */
+static InhibitOwner *
+inhibit_owner_get (GSListener *listener,
+                   const char *name)
+{
+        InhibitOwner *owner;
+
+        owner = g_hash_table_lookup (listener->priv->inhibit_owners, name);
+        if (owner != NULL)
+                return owner;
+
+        owner = g_new0 (InhibitOwner, 1);
+        owner->name = g_strdup (name);
+        owner->cookies = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+        if (listener->priv->connection != NULL) {
+                owner->watch_id = g_bus_watch_name_on_connection (listener->priv->connection,
+                                                                  name,
+                                                                  G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                                  NULL,
+                                                                  inhibit_owner_vanished,
+                                                                  listener,
+                                                                  NULL);
+        }
+
+        g_hash_table_insert (listener->priv->inhibit_owners, owner->name, owner);
+
+        return owner;
+}
+
+static void
+inhibit_owner_remove (GSListener   *listener,
+                      InhibitOwner *owner)
+{
+        g_hash_table_remove (listener->priv->inhibit_owners, owner->name);
+}
+
+/* Returns 0 when the owner already holds too many cookies. */
+static guint32
 gs_listener_add_inhibit (GSListener *listener,
-                         const char *owner)
+                         const char *name,
+                         const char *application,
+                         const char *reason)
 {
-        dbus_uint32_t *cookie;
+        InhibitOwner *owner;
+        Inhibitor    *inhibitor;
 
-        cookie = g_new (dbus_uint32_t, 1);
-        if (cookie == NULL) {
-                g_error ("No memory");
+        owner = g_hash_table_lookup (listener->priv->inhibit_owners, name);
+        if (owner != NULL && g_hash_table_size (owner->cookies) >= MAX_INHIBITORS_PER_OWNER) {
+                gs_debug ("Refusing inhibitor, %s already holds %u", name, g_hash_table_size (owner->cookies));
+                return 0;
         }
 
-        *cookie = ++listener->priv->inhibit_last_cookie;
+        owner = inhibit_owner_get (listener, name);
+
+        inhibitor = g_new (Inhibitor, 1);
+        inhibitor->cookie = ++listener->priv->inhibit_last_cookie;
+        if (inhibitor->cookie == 0)
+                inhibitor->cookie = ++listener->priv->inhibit_last_cookie;
+        inhibitor->owner = owner;
+        inhibitor->application = g_strdup (application);
+        inhibitor->reason = g_strdup (reason);
+        inhibitor->since = g_get_monotonic_time ();
 
         if (g_hash_table_size (listener->priv->inhibit_list) == 0) {
                 g_signal_emit (listener, signals [INHIBIT], 0, TRUE);
         }
 
-        g_hash_table_insert (listener->priv->inhibit_list, cookie, g_strdup (owner));
+        g_hash_table_insert (listener->priv->inhibit_list, GUINT_TO_POINTER (inhibitor->cookie), inhibitor);
+        g_hash_table_add (owner->cookies, GUINT_TO_POINTER (inhibitor->cookie));
 
-        return *cookie;
+        return inhibitor->cookie;
 }
 
 static void
-gs_listener_remove_inhibit (GSListener    *listener,
-                            dbus_uint32_t  cookie,
-                            const char    *owner)
+gs_listener_remove_inhibit (GSListener *listener,
+                            guint32     cookie,
+                            const char *name)
 {
-        const gchar *owned;
+        Inhibitor    *inhibitor;
+        InhibitOwner *owner;
 
-        owned = g_hash_table_lookup (listener->priv->inhibit_list, &cookie);
+        inhibitor = g_hash_table_lookup (listener->priv->inhibit_list, GUINT_TO_POINTER (cookie));
 
-        if (owned == NULL) {
+        if (inhibitor == NULL) {
                 return;
         }
 
-        if (strcmp (owner, owned) != 0) {
+        owner = inhibitor->owner;
+        if (strcmp (name, owner->name) != 0) {
                 return;
         }
 
-        g_hash_table_remove (listener->priv->inhibit_list, &cookie);
+        g_hash_table_remove (owner->cookies, GUINT_TO_POINTER (cookie));
+        g_hash_table_remove (listener->priv->inhibit_list, GUINT_TO_POINTER (cookie));
+
+        if (g_hash_table_size (owner->cookies) == 0) {
+                inhibit_owner_remove (listener, owner);
+        }
 
         if (g_hash_table_size (listener->priv->inhibit_list) == 0) {
                 g_signal_emit (listener, signals [INHIBIT], 0, FALSE);
         }
 }
 
-static gboolean
-compare_owner (gpointer key,
-               gpointer value,
-               gpointer user_data)
-{
-        const gchar *oa = value;
-        const char *ob = user_data;
-
-        return strcmp (oa, ob) == 0;;
-}
-
 static void
 gs_listener_disonnect_inhibit (GSListener  *listener,
-                               const char  *owner)
+                               const char  *name)
 {
-        guint count;
+        InhibitOwner  *owner;
+        GHashTableIter iter;
+        gpointer       cookie;
+        guint          count;
+
+        owner = g_hash_table_lookup (listener->priv->inhibit_owners, name);
+        if (owner == NULL) {
+                return;
+        }
 
-        count = g_hash_table_foreach_remove (listener->priv->inhibit_list, compare_owner, (gpointer)owner);
+        g_hash_table_iter_init (&iter, owner->cookies);
+        while (g_hash_table_iter_next (&iter, &cookie, NULL)) {
+                g_hash_table_remove (listener->priv->inhibit_list, cookie);
+        }
+
+        count = g_hash_table_size (owner->cookies);
+        inhibit_owner_remove (listener, owner);
 
-        gs_debug ("Inhibitor disconnected: %s (%u)", owner, count);
+        gs_debug ("Inhibitor disconnected: %s (%u)", name, count);
 
         if (count > 0 && g_hash_table_size (listener->priv->inhibit_list) == 0) {
                 g_signal_emit (listener, signals [INHIBIT], 0, FALSE);
         }
 }
 
+/* The owners were names on a bus connection that is gone. */
 static void
-raise_property_type_error (DBusConnection *connection,
-                           DBusMessage    *in_reply_to,
-                           const char     *device_id)
+gs_listener_clear_inhibit (GSListener *listener)
 {
-        char         buf [512];
-        DBusMessage *reply;
+        gboolean inhibited;
 
-        snprintf (buf, 511,
-                  "Type mismatch setting property with id %s",
-                  device_id);
-        gs_debug (buf);
+        inhibited = g_hash_table_size (listener->priv->inhibit_list) > 0;
 
-        reply = dbus_message_new_error (in_reply_to,
-                                        TYPE_MISMATCH_ERROR,
-                                        buf);
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
+        g_hash_table_remove_all (listener->priv->inhibit_list);
+        g_hash_table_remove_all (listener->priv->inhibit_owners);
+
+        if (inhibited) {
+                g_signal_emit (listener, signals [INHIBIT], 0, FALSE);
         }
+}
 
-        dbus_message_unref (reply);
+static void
+listener_lock (GSListener            *listener,
+               GVariant              *parameters,
+               GDBusMethodInvocation *invocation)
+{
+        g_signal_emit (listener, signals [LOCK], 0);
+        g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
-static DBusHandlerResult
-send_success_reply (DBusConnection  *connection,
-                    DBusMessage     *message)
+static void
+listener_simulate_user_activity (GSListener            *listener,
+                                 GVariant              *parameters,
+                                 GDBusMethodInvocation *invocation)
 {
-        DBusMessage *reply;
+        g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+}
 
-        if (dbus_message_get_no_reply (message)) {
-                return DBUS_HANDLER_RESULT_HANDLED;
-        }
+static gboolean
+listener_set_active (GSListener *listener,
+                     GVariant   *parameters)
+{
+        gboolean new_state;
+        gboolean res;
 
-        reply = dbus_message_new_method_return (message);
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+        g_variant_get (parameters, "(b)", &new_state);
+        g_signal_emit (listener, signals [BLANKING], 0, new_state, &res);
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
-        }
+        return res;
+}
 
-        dbus_message_unref (reply);
+static void
+listener_set_active_with_reply (GSListener            *listener,
+                                GVariant              *parameters,
+                                GDBusMethodInvocation *invocation)
+{
+        gboolean res;
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        res = listener_set_active (listener, parameters);
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", res));
 }
 
-static DBusHandlerResult
-listener_set_active (GSListener     *listener,
-                     DBusConnection *connection,
-                     DBusMessage    *message,
-                     gboolean        send_reply)
+/* The GNOME interface doesn't return the new state. */
+static void
+listener_set_active_no_reply (GSListener            *listener,
+                              GVariant              *parameters,
+                              GDBusMethodInvocation *invocation)
 {
-        const char     *path;
-        int             type;
-        DBusMessageIter iter;
-        DBusMessage    *reply;
-        gboolean        new_state, res;
-        dbus_bool_t     v;
+        listener_set_active (listener, parameters);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+}
 
-        path = dbus_message_get_path (message);
+static void
+listener_get_active (GSListener            *listener,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation)
+{
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(b)", (gboolean) listener->priv->blanked));
+}
 
-        dbus_message_iter_init (message, &iter);
-        type = dbus_message_iter_get_arg_type (&iter);
+static void
+listener_get_active_time (GSListener            *listener,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+        guint32 secs = 0;
+        time_t  now;
+        time_t  t = listener->priv->blanked_start;
 
-        if (type != DBUS_TYPE_BOOLEAN) {
-                gs_debug ("Unsupported property type %d", type);
-                raise_property_type_error (connection, message, path);
-                return DBUS_HANDLER_RESULT_HANDLED;
+        now = time (NULL);
+        if (G_UNLIKELY (now < t)) {
+                gs_debug ("Time is in the future");
+        } else if (G_UNLIKELY (t<= 0)) {
+                //gs_debug ("Time was not set");
+        } else {
+                secs = now - t;
         }
 
-        dbus_message_iter_get_basic (&iter, &v);
-        new_state = v;
-        g_signal_emit (listener, signals [BLANKING], 0, new_state, &res);
-        v = res;
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", secs));
+}
 
-        if (send_reply == FALSE) {
-            return DBUS_HANDLER_RESULT_HANDLED;
-        }
+static void
+listener_get_session_idle_time (GSListener            *listener,
+                                GVariant              *parameters,
+                                GDBusMethodInvocation *invocation)
+{
+        gulong res = 0;
 
-        reply = dbus_message_new_method_return (message);
+        g_signal_emit (listener, signals [IDLE_TIME], 0, &res);
 
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", (guint32) res));
+}
 
-        dbus_message_iter_init_append (reply, &iter);
+static void
+listener_inhibit (GSListener            *listener,
+                  GVariant              *parameters,
+                  GDBusMethodInvocation *invocation)
+{
+        guint32     cookie;
+        const char *application;
+        const char *reason;
 
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &v);
+        g_variant_get (parameters, "(&s&s)", &application, &reason);
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
-        }
+        gs_debug ("Inhibit requested: %s '%s'", application, reason);
 
-        dbus_message_unref (reply);
+        cookie = gs_listener_add_inhibit (listener,
+                                          g_dbus_method_invocation_get_sender (invocation),
+                                          application,
+                                          reason);
+        if (cookie == 0) {
+                g_dbus_method_invocation_return_error (invocation,
+                                                       G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                                       "Too many inhibitors held by %s",
+                                                       g_dbus_method_invocation_get_sender (invocation));
+                return;
+        }
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        gs_debug ("Returning inhibit cookie %u", cookie);
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", cookie));
 }
 
-static DBusHandlerResult
-listener_get_bool (GSListener     *listener,
-                   DBusConnection *connection,
-                   DBusMessage    *message,
-                   dbus_bool_t     v)
+static void
+listener_uninhibit (GSListener            *listener,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation)
 {
-        DBusMessageIter iter;
-        DBusMessage    *reply;
-
-        reply = dbus_message_new_method_return (message);
-
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+        guint32 cookie;
 
-        dbus_message_iter_init_append (reply, &iter);
+        g_variant_get (parameters, "(u)", &cookie);
 
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &v);
-
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
-        }
+        gs_debug ("Uninhibit requested: %u", cookie);
 
-        dbus_message_unref (reply);
+        gs_listener_remove_inhibit (listener, cookie, g_dbus_method_invocation_get_sender (invocation));
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
-static DBusHandlerResult
-listener_get_time (GSListener     *listener,
-                   DBusConnection *connection,
-                   DBusMessage    *message,
-                   time_t          t)
+static void
+listener_get_inhibitors (GSListener            *listener,
+                         GVariant              *parameters,
+                         GDBusMethodInvocation *invocation)
 {
-        DBusMessageIter iter;
-        DBusMessage    *reply;
-        dbus_uint32_t   secs = 0;
-        time_t          now;
+        GVariantBuilder builder;
+        GHashTableIter  iter;
+        gpointer        value;
+        gint64          now;
 
-        reply = dbus_message_new_method_return (message);
-
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+        now = g_get_monotonic_time ();
 
-        dbus_message_iter_init_append (reply, &iter);
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(usssu)"));
 
-        now = time (NULL);
-        if (G_UNLIKELY (now < t)) {
-                gs_debug ("Time is in the future");
-        } else if (G_UNLIKELY (t<= 0)) {
-                //gs_debug ("Time was not set");
-        } else {
-                secs = now - t;
-        }
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &secs);
+        g_hash_table_iter_init (&iter, listener->priv->inhibit_list);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                Inhibitor *inhibitor = value;
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
+                g_variant_builder_add (&builder, "(usssu)",
+                                       inhibitor->cookie,
+                                       inhibitor->owner->name,
+                                       inhibitor->application,
+                                       inhibitor->reason,
+                                       (guint32) ((now - inhibitor->since) / G_USEC_PER_SEC));
         }
 
-        dbus_message_unref (reply);
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(usssu))", &builder));
+}
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+static void
+add_latency_histogram (GVariantBuilder        *builder,
+                       const char             *point,
+                       const char             *kind,
+                       const GSTraceHistogram *histogram)
+{
+        g_variant_builder_add (builder, "(ssuttt@au)",
+                               point,
+                               kind,
+                               histogram->count,
+                               histogram->sum,
+                               histogram->min,
+                               histogram->max,
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                          histogram->buckets,
+                                                          GS_TRACE_N_BUCKETS,
+                                                          sizeof (guint32)));
 }
 
-static DBusHandlerResult
-listener_get_info (GSListener     *listener,
-                   DBusConnection *connection,
-                   DBusMessage    *message,
-                   int             signal)
+static void
+listener_get_lock_latency (GSListener            *listener,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
 {
-        DBusMessageIter iter;
-        DBusMessage    *reply;
+        GVariantBuilder builder;
+        int             i;
 
-        reply = dbus_message_new_method_return (message);
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssutttau)"));
 
-        if (reply == NULL) {
-                g_error ("No memory");
+        for (i = 0; i < GS_TRACE_N_POINTS; i++) {
+                add_latency_histogram (&builder, gs_trace_point_name (i), "step",
+                                       gs_trace_get_step (i));
+                add_latency_histogram (&builder, gs_trace_point_name (i), "since-sleep",
+                                       gs_trace_get_since_sleep (i));
         }
 
-        dbus_message_iter_init_append (reply, &iter);
-
-        switch (signal) {
-        case IDLE_TIME:
-                {
-                        dbus_uint32_t v;
-                        gulong        res;
-                        g_signal_emit (listener, signals [signal], 0, &res);
-                        v = res;
-                        dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &v);
-                        break;
-                }
-
-        default:
-                gs_debug ("Unsupported signal id %d", signal);
-                break;
-        }
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(ssutttau))", &builder));
+}
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
-        }
+static void
+add_method_stats (gpointer key,
+                  gpointer value,
+                  gpointer user_data)
+{
+        MethodEntry *entry = value;
 
-        dbus_message_unref (reply);
+        g_variant_builder_add (user_data, "(ssu)", entry->interface, entry->member, entry->calls);
+}
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+static void
+add_interface_stats (gpointer key,
+                     gpointer value,
+                     gpointer user_data)
+{
+        g_hash_table_foreach (value, add_method_stats, user_data);
 }
 
-static DBusHandlerResult
-listener_inhibit (GSListener     *listener,
-                  DBusConnection *connection,
-                  DBusMessage    *message)
+static void
+listener_get_method_stats (GSListener            *listener,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
 {
-        const char     *path;
-        int             type;
-        DBusMessageIter iter;
-        DBusMessage    *reply;
-        dbus_uint32_t   cookie;
-        const char     *application;
-        const char     *reason;
+        GVariantBuilder builder;
 
-        path = dbus_message_get_path (message);
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssu)"));
+        g_hash_table_foreach (listener->priv->methods, add_interface_stats, &builder);
 
-        dbus_message_iter_init (message, &iter);
-        type = dbus_message_iter_get_arg_type (&iter);
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(ssu))", &builder));
+}
 
-        if (type != DBUS_TYPE_STRING) {
-                gs_debug ("Unsupported property type %d", type);
-                raise_property_type_error (connection, message, path);
-                return DBUS_HANDLER_RESULT_HANDLED;
-        }
+static void
+listener_get_signal_wakeups (GSListener            *listener,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
+{
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(u)", listener->priv->signal_wakeups));
+}
 
-        dbus_message_iter_get_basic (&iter, &application);
+static void
+listener_dump_flight_recorder (GSListener            *listener,
+                               GVariant              *parameters,
+                               GDBusMethodInvocation *invocation)
+{
+        if (! gs_debug_flight_dump (NULL)) {
+                g_dbus_method_invocation_return_error (invocation,
+                                                       G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_FAILED,
+                                                       "Unable to write %s",
+                                                       gs_debug_flight_path ());
+                return;
+        }
 
-        dbus_message_iter_next (&iter);
-        type = dbus_message_iter_get_arg_type (&iter);
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(s)", gs_debug_flight_path ()));
+}
 
-        if (type != DBUS_TYPE_STRING) {
-                gs_debug ("Unsupported property type %d", type);
-                raise_property_type_error (connection, message, path);
-                return DBUS_HANDLER_RESULT_HANDLED;
+/* Per state how often it was entered, the time spent in it and
+ * when it was last entered, in monotonic microseconds. */
+static void
+listener_get_lock_states (GSListener            *listener,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+        GSLockMachine  *machine = listener->priv->lock_machine;
+        GVariantBuilder builder;
+        gint64          now;
+        int             i;
+
+        if (machine == NULL) {
+                g_dbus_method_invocation_return_error (invocation,
+                                                       G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_FAILED,
+                                                       "No lock state");
+                return;
         }
 
-        dbus_message_iter_get_basic (&iter, &reason);
-
-        gs_debug ("Inhibit requested: %s '%s'", application, reason);
+        now = g_get_monotonic_time ();
 
-        cookie = gs_listener_add_inhibit (listener, dbus_message_get_sender (message));
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sutx)"));
 
-        reply = dbus_message_new_method_return (message);
+        for (i = 0; i < GS_LOCK_N_STATES; i++) {
+                g_variant_builder_add (&builder, "(sutx)",
+                                       gs_lock_state_name (i),
+                                       gs_lock_machine_get_entries (machine, i),
+                                       (guint64) gs_lock_machine_get_time_in (machine, i, now),
+                                       gs_lock_machine_get_entered (machine, i));
+        }
 
-        dbus_message_iter_init_append (reply, &iter);
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(sa(sutx))",
+                                                              gs_lock_state_name (gs_lock_machine_get_state (machine)),
+                                                              &builder));
+}
 
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+static void
+add_lock_event (const GSLockLogEntry *entry,
+                gpointer              user_data)
+{
+        g_variant_builder_add (user_data, "(xsssb)",
+                               entry->time,
+                               gs_lock_event_name (entry->event),
+                               gs_lock_state_name (entry->from),
+                               gs_lock_state_name (entry->to),
+                               entry->ignored);
+}
 
-        gs_debug ("Returning inhibit cookie %u", cookie);
-        dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &cookie);
+static void
+listener_get_lock_events (GSListener            *listener,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+        GVariantBuilder builder;
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
-        }
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xsssb)"));
 
-        dbus_message_unref (reply);
+        if (listener->priv->lock_machine != NULL)
+                gs_lock_machine_foreach_log (listener->priv->lock_machine, add_lock_event, &builder);
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(xsssb))", &builder));
 }
 
-static DBusHandlerResult
-listener_uninhibit (GSListener     *listener,
-                    DBusConnection *connection,
-                    DBusMessage    *message)
+/* The hold times of the most recent suspends, oldest first. */
+static void
+listener_get_suspend_delays (GSListener            *listener,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation)
 {
-        const char     *path;
-        int             type;
-        DBusMessageIter iter;
-        dbus_uint32_t   cookie = 0;
+        GVariantBuilder builder;
+        guint           n;
+        guint           i;
 
-        path = dbus_message_get_path (message);
+        n = MIN (listener->priv->delay_holds, DELAY_HISTORY);
 
-        dbus_message_iter_init (message, &iter);
-        type = dbus_message_iter_get_arg_type (&iter);
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("at"));
 
-        if (type != DBUS_TYPE_UINT32) {
-                gs_debug ("Unsupported property type %d", type);
-                raise_property_type_error (connection, message, path);
-                return DBUS_HANDLER_RESULT_HANDLED;
+        for (i = listener->priv->delay_holds - n; i < listener->priv->delay_holds; i++) {
+                g_variant_builder_add (&builder, "t",
+                                       listener->priv->delay_hold_history [i % DELAY_HISTORY]);
         }
 
-        dbus_message_iter_get_basic (&iter, &cookie);
-
-        gs_debug ("Uninhibit requested: %u", cookie);
-
-        gs_listener_remove_inhibit (listener, cookie, dbus_message_get_sender (message));
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(uuttat)",
+                                                              listener->priv->delay_holds,
+                                                              listener->priv->delay_expired,
+                                                              listener->priv->delay_hold_max,
+                                                              listener->priv->delay_hold_sum,
+                                                              &builder));
+}
 
-        return send_success_reply (connection, message);
+static void
+listener_get_query_stats (GSListener            *listener,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(uu)",
+                                                              listener->priv->queries_saved,
+                                                              listener->priv->queries_made));
 }
 
-static DBusHandlerResult
-do_introspect (DBusConnection *connection,
-               DBusMessage    *message,
-               dbus_bool_t     local_interface)
+static GVariant *
+build_introspect_reply (const char *path)
 {
-        DBusMessage *reply;
-        GString     *xml;
-        char        *xml_string;
+        GString *xml;
+        guint    i;
 
         /* standard header */
         xml = g_string_new ("<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
                             "\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
-                            "<node>\n"
-                            "  <interface name=\"org.freedesktop.DBus.Introspectable\">\n"
-                            "    <method name=\"Introspect\">\n"
-                            "      <arg name=\"data\" direction=\"out\" type=\"s\"/>\n"
-                            "    </method>\n"
-                            "  </interface>\n");
-
-        /* ScreenSaver interface */
-        xml = g_string_append (xml,
-                               "  <interface name=\""GS_INTERFACE"\">\n"
-                               "    <method name=\"Lock\">\n"
-                               "    </method>\n"
-                               "    <method name=\"SimulateUserActivity\">\n"
-                               "    </method>\n"
-                               "    <method name=\"GetActive\">\n"
-                               "      <arg direction=\"out\" type=\"b\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"GetActiveTime\">\n"
-                               "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"GetSessionIdleTime\">\n"
-                               "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"SetActive\">\n"
-                               "      <arg direction=\"out\" type=\"b\"/>\n"
-                               "      <arg name=\"e\" direction=\"in\" type=\"b\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"Inhibit\">\n"
-                               "      <arg direction=\"out\" type=\"u\"/>\n"
-                               "      <arg name=\"application_name\" direction=\"in\" type=\"s\"/>\n"
-                               "      <arg name=\"reason_for_inhibit\" direction=\"in\" type=\"s\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"UnInhibit\">\n"
-                               "      <arg name=\"cookie\" direction=\"in\" type=\"u\"/>\n"
-                               "    </method>\n"
-                               "    <signal name=\"ActiveChanged\">\n"
-                               "      <arg type=\"b\"/>\n"
-                               "    </signal>\n"
-                               "  </interface>\n");
-
-        /* ScreenSaver interface GNOME */
-        xml = g_string_append (xml,
-                               "  <interface name=\""GS_INTERFACE_GNOME"\">\n"
-                               "    <method name=\"Lock\">\n"
-                               "    </method>\n"
-                               "    <method name=\"SimulateUserActivity\">\n"
-                               "    </method>\n"
-                               "    <method name=\"GetActive\">\n"
-                               "      <arg direction=\"out\" type=\"b\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"GetActiveTime\">\n"
-                               "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
-                               "    </method>\n"
-                               "    <method name=\"SetActive\">\n"
-                               "      <arg name=\"e\" direction=\"in\" type=\"b\"/>\n"
-                               "    </method>\n"
-                               "    <signal name=\"ActiveChanged\">\n"
-                               "      <arg type=\"b\"/>\n"
-                               "    </signal>\n"
-                               "  </interface>\n");
-
-        reply = dbus_message_new_method_return (message);
-
-        xml = g_string_append (xml, "</node>\n");
-        xml_string = g_string_free (xml, FALSE);
-
-        dbus_message_append_args (reply,
-                                  DBUS_TYPE_STRING, &xml_string,
-                                  DBUS_TYPE_INVALID);
-
-        g_free (xml_string);
+                            "<node>\n");
 
-        if (reply == NULL) {
-                g_error ("No memory");
-        }
+        for (i = 0; i < G_N_ELEMENTS (exported_objects); i++) {
+                if (strcmp (exported_objects [i].path, path) != 0) {
+                        continue;
+                }
 
-        if (! dbus_connection_send (connection, reply, NULL)) {
-                g_error ("No memory");
+                g_dbus_interface_info_generate_xml (g_dbus_node_info_lookup_interface (introspection_data,
+                                                                                       exported_objects [i].interface),
+                                                    2,
+                                                    xml);
         }
 
-        dbus_message_unref (reply);
+        g_string_append (xml, "</node>\n");
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        return g_variant_ref_sink (g_variant_new ("(@s)",
+                                                  g_variant_new_take_string (g_string_free (xml, FALSE))));
 }
 
-static DBusHandlerResult
-listener_dbus_handle_session_message (GSListener     *listener,
-                                      DBusConnection *connection,
-                                      DBusMessage    *message,
-                                      dbus_bool_t     local_interface)
+/* Every reply for a path references the same document. */
+static void
+listener_introspect (GSListener            *listener,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation)
 {
-#if 0
-        g_message ("obj_path=%s interface=%s method=%s destination=%s",
-                   dbus_message_get_path (message),
-                   dbus_message_get_interface (message),
-                   dbus_message_get_member (message),
-                   dbus_message_get_destination (message));
-#endif
+        const char *path;
+        GVariant   *reply;
 
-        g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-        g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
+        path = g_dbus_method_invocation_get_object_path (invocation);
 
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "Lock")) {
-                gs_debug ("Received Lock request");
-                g_signal_emit (listener, signals [LOCK], 0);
-                return send_success_reply (connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "SetActive")) {
-                gs_debug ("Received SetActive request");
-                return listener_set_active (listener, connection, message, TRUE);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "GetActive")) {
-                gs_debug ("Received GetActive request: %d", listener->priv->blanked);
-                return listener_get_bool (listener, connection, message, listener->priv->blanked);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "GetActiveTime")) {
-                gs_debug ("Received GetActiveTime request: %d", listener->priv->blanked_start);
-                return listener_get_time (listener, connection, message, listener->priv->blanked_start);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "GetSessionIdleTime")) {
-                gs_debug ("Received GetSessionIdleTime request");
-                return listener_get_info (listener, connection, message, IDLE_TIME);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "SimulateUserActivity")) {
-                gs_debug ("Received SimulateUserActivity request");
-                g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
-                return send_success_reply (connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "Inhibit")) {
-                gs_debug ("Received Inhibit request");
-                return listener_inhibit (listener, connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE, "UnInhibit")) {
-                gs_debug ("Received UnInhibit request");
-                return listener_uninhibit (listener, connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE_GNOME, "Lock")) {
-                gs_debug ("Received Lock request");
-                g_signal_emit (listener, signals [LOCK], 0);
-                return send_success_reply (connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE_GNOME, "SetActive")) {
-                gs_debug ("Received SetActive request");
-                listener_set_active (listener, connection, message, FALSE);
-                return send_success_reply (connection, message);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE_GNOME, "GetActive")) {
-                gs_debug ("Received GetActive request: %d", listener->priv->blanked);
-                return listener_get_bool (listener, connection, message, listener->priv->blanked);
-        }
-        if (dbus_message_is_method_call (message, GS_INTERFACE_GNOME, "GetActiveTime")) {
-                gs_debug ("Received GetActiveTime request: %d", listener->priv->blanked_start);
-                return listener_get_time (listener, connection, message, listener->priv->blanked_start);
+        if (introspect_replies == NULL) {
+                introspect_replies = g_hash_table_new (g_str_hash, g_str_equal);
         }
-        if (dbus_message_is_method_call (message, GS_INTERFACE_GNOME, "SimulateUserActivity")) {
-                gs_debug ("Received SimulateUserActivity request");
-                g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
-                return send_success_reply (connection, message);
-        }
-        if (dbus_message_is_method_call (message, DBUS_INTROSPECTABLE_INTERFACE, "Introspect")) {
-                return do_introspect (connection, message, local_interface);
+
+        reply = g_hash_table_lookup (introspect_replies, path);
+        if (reply == NULL) {
+                reply = build_introspect_reply (path);
+                g_hash_table_insert (introspect_replies, g_strdup (path), reply);
         }
 
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        g_dbus_method_invocation_return_value (invocation, reply);
 }
 
 static void
-listener_dbus_handle_owner_changed (GSListener     *listener,
-                                    DBusConnection *connection,
-                                    DBusMessage    *message)
+gs_listener_register_method (GSListener *listener,
+                             const char *interface,
+                             const char *member,
+                             MethodFunc  func,
+                             guint       flags)
 {
-        DBusMessageIter  iter;
-        int              type;
-        const char      *old_owner;
+        GHashTable  *members;
+        MethodEntry *entry;
+
+        members = g_hash_table_lookup (listener->priv->methods, interface);
+        if (members == NULL) {
+                members = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+                g_hash_table_insert (listener->priv->methods, (gpointer) interface, members);
+        }
+
+        entry = g_new0 (MethodEntry, 1);
+        entry->interface = interface;
+        entry->member = member;
+        entry->func = func;
+        entry->flags = flags;
+
+        g_hash_table_replace (members, (gpointer) member, entry);
+}
 
-        dbus_message_iter_init (message, &iter);
-        dbus_message_iter_next (&iter);
-        type = dbus_message_iter_get_arg_type (&iter);
+/* The same table serves GS_PATH, GS_PATH_KDE and GS_PATH_GNOME. */
+static void
+gs_listener_register_methods (GSListener *listener)
+{
+        listener->priv->methods = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                                         (GDestroyNotify) g_hash_table_destroy);
+
+        gs_listener_register_method (listener, GS_INTERFACE, "Lock", listener_lock, 0);
+        gs_listener_register_method (listener, GS_INTERFACE, "SetActive", listener_set_active_with_reply, 0);
+        gs_listener_register_method (listener, GS_INTERFACE, "GetActive", listener_get_active, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE, "GetActiveTime", listener_get_active_time, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE, "GetSessionIdleTime", listener_get_session_idle_time, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE, "SimulateUserActivity", listener_simulate_user_activity, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE, "Inhibit", listener_inhibit, 0);
+        gs_listener_register_method (listener, GS_INTERFACE, "UnInhibit", listener_uninhibit, 0);
+
+        gs_listener_register_method (listener, GS_INTERFACE_GNOME, "Lock", listener_lock, 0);
+        gs_listener_register_method (listener, GS_INTERFACE_GNOME, "SetActive", listener_set_active_no_reply, 0);
+        gs_listener_register_method (listener, GS_INTERFACE_GNOME, "GetActive", listener_get_active, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE_GNOME, "GetActiveTime", listener_get_active_time, METHOD_QUIET);
+        gs_listener_register_method (listener, GS_INTERFACE_GNOME, "SimulateUserActivity", listener_simulate_user_activity, METHOD_QUIET);
+
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetLockLatency", listener_get_lock_latency, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetMethodStats", listener_get_method_stats, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetQueryStats", listener_get_query_stats, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetSignalWakeups", listener_get_signal_wakeups, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "DumpFlightRecorder", listener_dump_flight_recorder, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetInhibitors", listener_get_inhibitors, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetLockStates", listener_get_lock_states, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetLockEvents", listener_get_lock_events, 0);
+        gs_listener_register_method (listener, LL_DIAGNOSTICS_INTERFACE, "GetSuspendDelays", listener_get_suspend_delays, 0);
+
+        gs_listener_register_method (listener, DBUS_INTROSPECTABLE_INTERFACE, "Introspect", listener_introspect, METHOD_QUIET);
+}
 
-        if (type != DBUS_TYPE_STRING) {
-                gs_debug ("Invalid NameOwnerChanged message");
+/* GDBus has already checked the arguments against the introspection data. */
+static void
+listener_handle_method_call (GDBusConnection       *connection,
+                             const char            *sender,
+                             const char            *object_path,
+                             const char            *interface_name,
+                             const char            *method_name,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer               user_data)
+{
+        GSListener  *listener = GS_LISTENER (user_data);
+        GHashTable  *members;
+        MethodEntry *entry;
+
+        members = g_hash_table_lookup (listener->priv->methods, interface_name);
+        entry = members != NULL ? g_hash_table_lookup (members, method_name) : NULL;
+        if (entry == NULL) {
+                g_dbus_method_invocation_return_error (invocation,
+                                                       G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_UNKNOWN_METHOD,
+                                                       "Unknown method %s.%s",
+                                                       interface_name,
+                                                       method_name);
                 return;
         }
 
-        dbus_message_iter_get_basic (&iter, &old_owner);
+        entry->calls++;
+        if (! (entry->flags & METHOD_QUIET)) {
+                gs_debug ("Received %s request", method_name);
+        }
+
+        GS_PROBE2 (method_entry, interface_name, method_name);
+        entry->func (listener, parameters, invocation);
+        GS_PROBE2 (method_return, interface_name, method_name);
+}
+
+static const GDBusInterfaceVTable gs_listener_vtable = {
+        listener_handle_method_call,
+        NULL,
+        NULL
+};
+
+static void
+inhibit_owner_vanished (GDBusConnection *connection,
+                        const char      *name,
+                        gpointer         user_data)
+{
+        GSListener *listener = GS_LISTENER (user_data);
+
+        listener->priv->signal_wakeups++;
 
-        gs_listener_disonnect_inhibit (listener, old_owner);
+        gs_listener_disonnect_inhibit (listener, name);
 }
 
 static gboolean
-_listener_message_path_is_our_session (GSListener  *listener,
-                                       DBusMessage *message)
+_listener_path_is_our_session (GSListener *listener,
+                               const char *path)
 {
-        const char *ssid;
-
-        ssid = dbus_message_get_path (message);
-        if (ssid == NULL)
+        if (path == NULL)
                 return FALSE;
 
         if (listener->priv->session_id == NULL)
                 return FALSE;
 
-        if (strcmp (ssid, listener->priv->session_id) == 0)
+        if (strcmp (path, listener->priv->session_id) == 0)
                 return TRUE;
 
         return FALSE;
 }
 
 #ifdef WITH_SYSTEMD
-static gboolean
-query_session_active (GSListener *listener)
+static void
+query_session_active_reply (GSListener *listener,
+                            GVariant   *reply)
 {
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       error;
-        DBusMessageIter reply_iter;
-        DBusMessageIter sub_iter;
-        dbus_bool_t     active = FALSE;
-        const char     *interface;
-        const char     *property;
-
-        if (listener->priv->system_connection == NULL) {
-                gs_debug ("No connection to the system bus");
-                return FALSE;
-        }
-
-        dbus_error_init (&error);
-
-        message = dbus_message_new_method_call (SYSTEMD_LOGIND_SERVICE, listener->priv->session_id, DBUS_PROPERTIES_INTERFACE, "Get");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
-                return FALSE;
-        }
-
-        interface = SYSTEMD_LOGIND_SESSION_INTERFACE;
-        property = "Active";
+        GVariant *value;
+        gboolean  active = FALSE;
 
-        if (dbus_message_append_args (message, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID) == FALSE) {
-                gs_debug ("Couldn't add args to the dbus message");
-                dbus_message_unref (message);
-                return FALSE;
+        value = property_get_reply_value (reply, G_VARIANT_TYPE_BOOLEAN);
+        if (value != NULL) {
+                active = g_variant_get_boolean (value);
+                g_variant_unref (value);
         }
 
-        /* FIXME: use async? */
-        reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-                                                           message,
-                                                           -1, &error);
-        dbus_message_unref (message);
+        gs_debug ("systemd notified ActiveSession %d", active);
+        g_signal_emit (listener, signals [SESSION_SWITCHED], 0, active);
+}
 
-        if (dbus_error_is_set (&error)) {
-                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                dbus_error_free (&error);
-                return FALSE;
+static void
+query_session_active (GSListener *listener)
+{
+        if (listener->priv->system_connection == NULL) {
+                gs_debug ("No connection to the system bus");
+                return;
         }
 
-        if (dbus_message_iter_init (reply, &reply_iter) == TRUE
-            && dbus_message_iter_get_arg_type (&reply_iter) == DBUS_TYPE_VARIANT) {
-
-                dbus_message_iter_recurse (&reply_iter, &sub_iter);
-
-                if (dbus_message_iter_get_arg_type (&sub_iter) == DBUS_TYPE_BOOLEAN) {
-                        dbus_message_iter_get_basic (&sub_iter, &active);
-                } else {
-                        gs_debug ("Unexpected return type");
-                }
-        } else {
-                gs_debug ("Unexpected return type");
+        if (listener->priv->session_id == NULL) {
+                gs_debug ("Session id not known yet");
+                return;
         }
 
-        dbus_message_unref (reply);
-
-        return active;
+        send_property_get (listener,
+                           SYSTEMD_LOGIND_SERVICE,
+                           listener->priv->session_id,
+                           SYSTEMD_LOGIND_SESSION_INTERFACE,
+                           "Active",
+                           query_session_active_reply);
 }
 #endif
 
 #ifdef WITH_UPOWER
 #ifdef WITH_LOCK_ON_LID
-static gboolean
-query_lid_closed (GSListener *listener)
+static void
+set_lid_closed (GSListener *listener,
+                gboolean    closed)
 {
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       error;
-        DBusMessageIter reply_iter;
-        DBusMessageIter sub_iter;
-        dbus_bool_t     active = FALSE;
-        const char     *interface;
-        const char     *property;
-
-        if (listener->priv->system_connection == NULL) {
-                gs_debug ("No connection to the system bus");
-                return FALSE;
-        }
-
-        dbus_error_init (&error);
-
-        message = dbus_message_new_method_call (UP_SERVICE, UP_PATH, DBUS_PROPERTIES_INTERFACE, "Get");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
-                return FALSE;
-        }
-
-        interface = UP_INTERFACE;
-        property = "LidIsClosed";
-
-        if (dbus_message_append_args (message, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID) == FALSE) {
-                gs_debug ("Couldn't add args to the dbus message");
-                dbus_message_unref (message);
-                return FALSE;
-        }
+        listener->priv->lid_closed = closed;
+        gs_debug ("UPower notified LidIsClosed %d", (int)listener->priv->lid_closed);
+        g_object_notify (G_OBJECT (listener), "lid-closed");
+}
 
-        /* FIXME: use async? */
-        reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-                                                           message,
-                                                           -1, &error);
-        dbus_message_unref (message);
+static void
+query_lid_closed_reply (GSListener *listener,
+                        GVariant   *reply)
+{
+        GVariant *value;
+        gboolean  closed = FALSE;
 
-        if (dbus_error_is_set (&error)) {
-                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                dbus_error_free (&error);
-                return FALSE;
+        value = property_get_reply_value (reply, G_VARIANT_TYPE_BOOLEAN);
+        if (value != NULL) {
+                closed = g_variant_get_boolean (value);
+                g_variant_unref (value);
         }
 
-        if (dbus_message_iter_init (reply, &reply_iter) == TRUE
-            && dbus_message_iter_get_arg_type (&reply_iter) == DBUS_TYPE_VARIANT) {
-
-                dbus_message_iter_recurse (&reply_iter, &sub_iter);
+        set_lid_closed (listener, closed);
+}
 
-                if (dbus_message_iter_get_arg_type (&sub_iter) == DBUS_TYPE_BOOLEAN) {
-                        dbus_message_iter_get_basic (&sub_iter, &active);
-                } else {
-                        gs_debug ("Unexpected return type");
-                }
-        } else {
-                gs_debug ("Unexpected return type");
+static void
+query_lid_closed (GSListener *listener)
+{
+        if (listener->priv->system_connection == NULL) {
+                gs_debug ("No connection to the system bus");
+                return;
         }
 
-        dbus_message_unref (reply);
-
-        return active;
+        send_property_get (listener, UP_SERVICE, UP_PATH, UP_INTERFACE, "LidIsClosed",
+                           query_lid_closed_reply);
 }
 #endif
 #endif
 
 #if defined(WITH_SYSTEMD) || (defined(WITH_UPOWER) && defined(WITH_LOCK_ON_LID))
-static gboolean
-properties_changed_match (DBusMessage *message,
-                          const char  *property)
+typedef enum {
+        PROPERTY_UNCHANGED,
+        PROPERTY_CHANGED,
+        PROPERTY_INVALIDATED
+} PropertyChange;
+
+/* Looks a property up in a PropertiesChanged message. When the new
+ * value is in the message it is returned in value, otherwise it has to
+ * be queried. */
+static PropertyChange
+properties_changed_lookup (GVariant           *parameters,
+                           const char         *property,
+                           const GVariantType *type,
+                           GVariant          **value)
 {
-        DBusMessageIter iter, sub, sub2;
+        GVariant       *changed;
+        const char    **invalidated;
+        PropertyChange  change = PROPERTY_UNCHANGED;
 
-        /* Checks whether a certain property is listed in the
-         * specified PropertiesChanged message */
+        *value = NULL;
 
-        if (!dbus_message_iter_init (message, &iter))
-                goto failure;
+        if (! g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)"))) {
+                gs_debug ("Failed to decode PropertiesChanged message.");
+                return PROPERTY_UNCHANGED;
+        }
 
-        /* Jump over interface name */
-        if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_STRING)
-                goto failure;
+        g_variant_get (parameters, "(&s@a{sv}^a&s)", NULL, &changed, &invalidated);
 
-        if (dbus_message_iter_next (&iter) == FALSE)
-                goto failure;
+        *value = g_variant_lookup_value (changed, property, NULL);
+        if (*value != NULL && g_variant_is_of_type (*value, type)) {
+                change = PROPERTY_CHANGED;
+        } else if (*value != NULL || g_strv_contains (invalidated, property)) {
+                /* An unexpected type is treated like an invalidation. */
+                change = PROPERTY_INVALIDATED;
+                g_clear_pointer (value, g_variant_unref);
+        }
 
-        /* First, iterate through the changed properties array */
-        if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY ||
-            dbus_message_iter_get_element_type (&iter) != DBUS_TYPE_DICT_ENTRY)
-                goto failure;
+        g_variant_unref (changed);
+        g_free (invalidated);
 
-        dbus_message_iter_recurse (&iter, &sub);
-        while (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_INVALID) {
-                const char *name = NULL;
+        return change;
+}
+#endif
 
-                if (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_DICT_ENTRY)
-                        goto failure;
+#ifdef WITH_SYSTEMD
+static void
+session_active_changed (GSListener *listener,
+                        const char *object_path,
+                        GVariant   *parameters)
+{
+        GVariant       *value;
+        const char     *active_session;
+        gboolean        active;
+        PropertyChange  change;
 
-                dbus_message_iter_recurse (&sub, &sub2);
+        /* Use the seat property ActiveSession.
+         * The session property Active only seems to be signalled when it becomes active.
+         */
+        change = properties_changed_lookup (parameters, "ActiveSession", G_VARIANT_TYPE ("(so)"), &value);
+        if (change == PROPERTY_UNCHANGED)
+                return;
 
-                if (dbus_message_iter_get_arg_type (&sub2) != DBUS_TYPE_STRING)
-                        goto failure;
+        if (change == PROPERTY_CHANGED
+            && listener->priv->logind_seat != NULL
+            && listener->priv->session_id != NULL) {
+                listener->priv->queries_saved++;
 
-                dbus_message_iter_get_basic (&sub2, &name);
+                if (g_strcmp0 (object_path, listener->priv->logind_seat) != 0) {
+                        gs_debug ("Ignoring ActiveSession of %s", object_path);
+                        g_variant_unref (value);
+                        return;
+                }
 
-                if (g_strcmp0 (name, property) == 0)
-                        return TRUE;
+                g_variant_get (value, "(&s&o)", NULL, &active_session);
+                active = strcmp (active_session, listener->priv->session_id) == 0;
+                g_variant_unref (value);
 
-                dbus_message_iter_next (&sub);
+                gs_debug ("systemd notified ActiveSession %d", active);
+                g_signal_emit (listener, signals [SESSION_SWITCHED], 0, active);
+                return;
         }
 
-        if (dbus_message_iter_next (&iter) == FALSE)
-                goto failure;
-
-        /* Second, iterate through the invalidated properties array */
-        if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY ||
-            dbus_message_iter_get_element_type (&iter) != DBUS_TYPE_STRING)
-                goto failure;
+        if (value != NULL)
+                g_variant_unref (value);
 
-        dbus_message_iter_recurse (&iter, &sub);
-        while (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_INVALID) {
-                const char *name = NULL;
-
-                if (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_STRING)
-                        goto failure;
-
-                dbus_message_iter_get_basic (&sub, &name);
-
-                if (g_strcmp0 (name, property) == 0)
-                        return TRUE;
+        /* Do a DBus query, since the sd_session_is_active isn't up to date. */
+        listener->priv->queries_made++;
+        query_session_active (listener);
+}
+#endif
 
-                dbus_message_iter_next (&sub);
+#ifdef WITH_UPOWER
+#ifdef WITH_LOCK_ON_LID
+static void
+lid_closed_changed (GSListener *listener,
+                    GVariant   *parameters)
+{
+        GVariant       *value;
+        PropertyChange  change;
+
+        change = properties_changed_lookup (parameters, "LidIsClosed", G_VARIANT_TYPE_BOOLEAN, &value);
+        if (change == PROPERTY_CHANGED) {
+                listener->priv->queries_saved++;
+                set_lid_closed (listener, g_variant_get_boolean (value));
+                g_variant_unref (value);
+        } else if (change == PROPERTY_INVALIDATED) {
+                listener->priv->queries_made++;
+                query_lid_closed (listener);
         }
-
-        return FALSE;
-
-failure:
-        gs_debug ("Failed to decode PropertiesChanged message.");
-        return FALSE;
 }
 #endif
+#endif
 
-static DBusHandlerResult
-listener_dbus_handle_system_message (DBusConnection *connection,
-                                     DBusMessage    *message,
-                                     void           *user_data,
-                                     dbus_bool_t     local_interface)
+static void
+listener_system_signal (GDBusConnection *connection,
+                        const char      *sender_name,
+                        const char      *object_path,
+                        const char      *interface_name,
+                        const char      *signal_name,
+                        GVariant        *parameters,
+                        gpointer         user_data)
 {
         GSListener *listener = GS_LISTENER (user_data);
 
-        g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-        g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
+        listener->priv->signal_wakeups++;
 
-#if 1
-        gs_debug ("obj_path=%s interface=%s method=%s destination=%s",
-                  dbus_message_get_path (message),
-                  dbus_message_get_interface (message),
-                  dbus_message_get_member (message),
-                  dbus_message_get_destination (message));
-#endif
+        gs_debug ("obj_path=%s interface=%s method=%s",
+                  object_path,
+                  interface_name,
+                  signal_name);
 
 #ifdef WITH_SYSTEMD
 
         if (listener->priv->have_systemd) {
 
-                if (dbus_message_is_signal (message, SYSTEMD_LOGIND_SESSION_INTERFACE, "Unlock")) {
-                        if (_listener_message_path_is_our_session (listener, message)) {
+                if (g_strcmp0 (interface_name, SYSTEMD_LOGIND_SESSION_INTERFACE) == 0
+                    && g_strcmp0 (signal_name, "Unlock") == 0) {
+                        if (_listener_path_is_our_session (listener, object_path)) {
                                 gs_debug ("systemd requested session unlock");
                                 gs_listener_set_active (listener, FALSE);
                         }
 
-                        return DBUS_HANDLER_RESULT_HANDLED;
-                } else if (dbus_message_is_signal (message, SYSTEMD_LOGIND_SESSION_INTERFACE, "Lock")) {
-                        if (_listener_message_path_is_our_session (listener, message)) {
+                        return;
+                } else if (g_strcmp0 (interface_name, SYSTEMD_LOGIND_SESSION_INTERFACE) == 0
+                           && g_strcmp0 (signal_name, "Lock") == 0) {
+                        if (_listener_path_is_our_session (listener, object_path)) {
                                 gs_debug ("systemd requested session lock");
                                 g_signal_emit (listener, signals [LOCKED], 0);
                         }
 
-                        return DBUS_HANDLER_RESULT_HANDLED;
-                } else if (dbus_message_is_signal (message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged")) {
-
-                        /* Use the seat property ActiveSession.
-                         * The session property Active only seems to be signalled when it becomes active.
-                         */
-                        if (properties_changed_match (message, "ActiveSession")) {
-                                gboolean new_active;
+                        return;
+                } else if (g_strcmp0 (interface_name, DBUS_PROPERTIES_INTERFACE) == 0
+                           && g_strcmp0 (signal_name, "PropertiesChanged") == 0) {
 
-                                /* Do a DBus query, since the sd_session_is_active isn't up to date. */
-                                new_active = query_session_active (listener);
-                                gs_debug ("systemd notified ActiveSession %d", new_active);
-                                g_signal_emit (listener, signals [SESSION_SWITCHED], 0, new_active);
-                        }
+                        session_active_changed (listener, object_path, parameters);
 
 #ifdef WITH_UPOWER
 #ifdef WITH_LOCK_ON_LID
-                        if (properties_changed_match (message, "LidIsClosed")) {
-                                listener->priv->lid_closed = query_lid_closed (listener);
-                                gs_debug ("UPower notified LidIsClosed %d", (int)listener->priv->lid_closed);
-                                g_object_notify (G_OBJECT (listener), "lid-closed");
-                        }
+                        lid_closed_changed (listener, parameters);
 #endif
 #endif
 
-                        return DBUS_HANDLER_RESULT_HANDLED;
+                        return;
                 }
 
 #ifdef WITH_LOCK_ON_SUSPEND
-                if (dbus_message_is_signal (message, SYSTEMD_LOGIND_INTERFACE, "PrepareForSleep")) {
-                        DBusError   error;
-                        dbus_bool_t new_active;
-
-                        dbus_error_init (&error);
-                        if (dbus_message_get_args (message, &error,
-                                                   DBUS_TYPE_BOOLEAN, &new_active,
-                                                   DBUS_TYPE_INVALID)) {
-                                gs_debug ("systemd initiating %s", new_active ? "sleep" : "resume");
+                if (g_strcmp0 (interface_name, SYSTEMD_LOGIND_INTERFACE) == 0
+                    && g_strcmp0 (signal_name, "PrepareForSleep") == 0) {
+                        gboolean new_active;
 
-                                g_signal_emit (listener, signals [new_active ? SUSPEND : RESUME], 0);
+                        if (! g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+                                gs_debug ("Invalid PrepareForSleep message");
+                                return;
                         }
 
-                        if (dbus_error_is_set (&error)) {
-                                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                                dbus_error_free (&error);
+                        g_variant_get (parameters, "(b)", &new_active);
+
+                        gs_debug ("systemd initiating %s", new_active ? "sleep" : "resume");
+
+                        if (new_active) {
+                                gs_trace_begin (GS_TRACE_PREPARE_FOR_SLEEP);
+                                delay_wait_begin (listener);
                         }
 
-                        return DBUS_HANDLER_RESULT_HANDLED;
+                        g_signal_emit (listener, signals [new_active ? SUSPEND : RESUME], 0);
+
+                        return;
                 }
 #endif
 
-                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+                return;
         }
 #endif
 
 #ifdef WITH_UPOWER
 #ifdef WITH_LOCK_ON_LID
-        if (dbus_message_is_signal (message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged")) {
-
-                if (properties_changed_match (message, "LidIsClosed")) {
-                        listener->priv->lid_closed = query_lid_closed (listener);
-                        gs_debug ("UPower notified LidIsClosed %d", (int)listener->priv->lid_closed);
-                        g_object_notify (G_OBJECT (listener), "lid-closed");
-                }
+        if (g_strcmp0 (interface_name, DBUS_PROPERTIES_INTERFACE) == 0
+            && g_strcmp0 (signal_name, "PropertiesChanged") == 0) {
 
-                return DBUS_HANDLER_RESULT_HANDLED;
+                lid_closed_changed (listener, parameters);
         }
 #endif
 #endif
-
-       return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-static DBusHandlerResult
-gs_listener_message_handler (DBusConnection *connection,
-                             DBusMessage    *message,
-                             void           *user_data)
+static void
+listener_connection_closed (GDBusConnection *connection,
+                            gboolean         remote_peer_vanished,
+                            GError          *error,
+                            GSListener      *listener);
+
+static GDBusConnection *
+listener_bus_get (GSListener *listener,
+                  GBusType    bus_type)
 {
-        g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-        g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-
-#if 0
-        g_message ("obj_path=%s interface=%s method=%s destination=%s",
-                   dbus_message_get_path (message),
-                   dbus_message_get_interface (message),
-                   dbus_message_get_member (message),
-                   dbus_message_get_destination (message));
-#endif
+        GDBusConnection *connection;
+        GError          *error = NULL;
+
+        connection = g_bus_get_sync (bus_type, NULL, &error);
+        if (connection == NULL) {
+                gs_debug ("couldn't connect to %s bus: %s",
+                          bus_type == G_BUS_TYPE_SESSION ? "session" : "system",
+                          error->message);
+                g_error_free (error);
+                return NULL;
+        }
 
-        if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected") &&
-                   strcmp (dbus_message_get_path (message), DBUS_PATH_LOCAL) == 0) {
-                dbus_connection_unref (connection);
+        g_dbus_connection_set_exit_on_close (connection, FALSE);
+        g_signal_connect (connection, "closed",
+                          G_CALLBACK (listener_connection_closed), listener);
 
-                return DBUS_HANDLER_RESULT_HANDLED;
-        } else {
-                return listener_dbus_handle_session_message (GS_LISTENER (user_data), connection, message, TRUE);
-        }
+        return connection;
 }
 
 static gboolean
 gs_listener_dbus_init (GSListener *listener)
 {
-        DBusError error;
-
-        dbus_error_init (&error);
-
         if (listener->priv->connection == NULL) {
-                listener->priv->connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+                listener->priv->connection = listener_bus_get (listener, G_BUS_TYPE_SESSION);
                 if (listener->priv->connection == NULL) {
-                        if (dbus_error_is_set (&error)) {
-                                gs_debug ("couldn't connect to session bus: %s",
-                                          error.message);
-                                dbus_error_free (&error);
-                        }
                         return FALSE;
                 }
-
-                dbus_connection_setup_with_g_main (listener->priv->connection, NULL);
-                dbus_connection_set_exit_on_disconnect (listener->priv->connection, FALSE);
         }
 
         if (listener->priv->system_connection == NULL) {
-                listener->priv->system_connection = dbus_bus_get (DBUS_BUS_SYSTEM, &error);
+                listener->priv->system_connection = listener_bus_get (listener, G_BUS_TYPE_SYSTEM);
                 if (listener->priv->system_connection == NULL) {
-                        if (dbus_error_is_set (&error)) {
-                                gs_debug ("couldn't connect to system bus: %s",
-                                          error.message);
-                                dbus_error_free (&error);
-                        }
                         return FALSE;
                 }
-
-                dbus_connection_setup_with_g_main (listener->priv->system_connection, NULL);
-                dbus_connection_set_exit_on_disconnect (listener->priv->system_connection, FALSE);
         }
 
         return TRUE;
@@ -1481,64 +1900,41 @@ reinit_dbus (GSListener *listener)
         return try_again;
 }
 
-static DBusHandlerResult
-listener_dbus_filter_function (DBusConnection *connection,
-                               DBusMessage    *message,
-                               void           *user_data)
+static void
+listener_connection_closed (GDBusConnection *connection,
+                            gboolean         remote_peer_vanished,
+                            GError          *error,
+                            GSListener      *listener)
 {
-        GSListener *listener = GS_LISTENER (user_data);
-        const char *path;
-
-        path = dbus_message_get_path (message);
-
-        if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected")
-            && strcmp (path, DBUS_PATH_LOCAL) == 0) {
-
+        if (connection == listener->priv->connection) {
                 g_message ("Got disconnected from the session message bus; "
                            "retrying to reconnect every 10 seconds");
 
-                dbus_connection_unref (connection);
                 listener->priv->connection = NULL;
-
-                g_timeout_add (10000, (GSourceFunc)reinit_dbus, listener);
-        } else if (dbus_message_is_signal (message,
-                                           DBUS_INTERFACE_DBUS,
-                                           "NameOwnerChanged")) {
-                if (g_hash_table_size (listener->priv->inhibit_list) > 0)
-                        listener_dbus_handle_owner_changed (listener, connection, message);
-        } else {
-                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-        }
-
-
-        return DBUS_HANDLER_RESULT_HANDLED;
-}
-
-static DBusHandlerResult
-listener_dbus_system_filter_function (DBusConnection *connection,
-                                      DBusMessage    *message,
-                                      void           *user_data)
-{
-        GSListener *listener = GS_LISTENER (user_data);
-        const char *path;
-
-        path = dbus_message_get_path (message);
-
-        if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected") == TRUE
-            && g_strcmp0 (path, DBUS_PATH_LOCAL) == 0) {
-
+                gs_listener_clear_inhibit (listener);
+        } else if (connection == listener->priv->system_connection) {
                 g_message ("Got disconnected from the system message bus; "
                            "retrying to reconnect every 10 seconds");
 
-                dbus_connection_unref (connection);
                 listener->priv->system_connection = NULL;
-
-                g_timeout_add (10000, (GSourceFunc)reinit_dbus, listener);
+                g_slist_free (listener->priv->system_subscriptions);
+                listener->priv->system_subscriptions = NULL;
+                listener->priv->session_subscribed = FALSE;
+                listener->priv->seat_subscribed = FALSE;
+#ifdef WITH_SYSTEMD
+                if (listener->priv->session_id_retry_id != 0) {
+                        g_source_remove (listener->priv->session_id_retry_id);
+                        listener->priv->session_id_retry_id = 0;
+                }
+#endif
         } else {
-                return listener_dbus_handle_system_message (connection, message, user_data, FALSE);
+                return;
         }
 
-        return DBUS_HANDLER_RESULT_HANDLED;
+        g_signal_handlers_disconnect_by_func (connection, listener_connection_closed, listener);
+        g_object_unref (connection);
+
+        g_timeout_add (10000, (GSourceFunc)reinit_dbus, listener);
 }
 
 static void
@@ -1714,42 +2110,165 @@ gs_listener_class_init (GSListenerClass *klass)
                                                                G_PARAM_READABLE));
 
         g_type_class_add_private (klass, sizeof (GSListenerPrivate));
-}
 
+        introspection_data = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+        g_assert (introspection_data != NULL);
+}
 
 static gboolean
-screensaver_is_running (DBusConnection *connection)
+name_has_owner (GDBusConnection *connection,
+                const char      *name)
 {
-        DBusError error;
-        gboolean  exists;
+        GVariant *reply;
+        gboolean  exists = FALSE;
+
+        reply = g_dbus_connection_call_sync (connection,
+                                             DBUS_SERVICE,
+                                             DBUS_PATH,
+                                             DBUS_INTERFACE,
+                                             "NameHasOwner",
+                                             g_variant_new ("(s)", name),
+                                             G_VARIANT_TYPE ("(b)"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             -1,
+                                             NULL,
+                                             NULL);
+        if (reply != NULL) {
+                g_variant_get (reply, "(b)", &exists);
+                g_variant_unref (reply);
+        }
+
+        return exists;
+}
 
+static gboolean
+screensaver_is_running (GDBusConnection *connection)
+{
         g_return_val_if_fail (connection != NULL, FALSE);
 
-        dbus_error_init (&error);
-        exists = dbus_bus_name_has_owner (connection, GS_SERVICE, &error);
-        if (dbus_error_is_set (&error)) {
-                dbus_error_free (&error);
+        /* Also check for the GNOME screensaver */
+        return name_has_owner (connection, GS_SERVICE)
+                || name_has_owner (connection, GS_SERVICE_GNOME);
+}
+
+static gboolean
+request_name (GSListener *listener,
+              const char *name,
+              const char *exists_message,
+              GError    **error)
+{
+        GVariant *reply;
+        GError   *buserror = NULL;
+        guint32   res;
+
+        reply = g_dbus_connection_call_sync (listener->priv->connection,
+                                             DBUS_SERVICE,
+                                             DBUS_PATH,
+                                             DBUS_INTERFACE,
+                                             "RequestName",
+                                             g_variant_new ("(su)", name, DBUS_NAME_FLAG_DO_NOT_QUEUE),
+                                             G_VARIANT_TYPE ("(u)"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             -1,
+                                             NULL,
+                                             &buserror);
+        if (reply == NULL) {
+                g_set_error (error,
+                             GS_LISTENER_ERROR,
+                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
+                             "%s",
+                             buserror->message);
+                g_error_free (buserror);
+                return FALSE;
         }
 
-        if (exists == FALSE) {
-                /* Also check for the GNOME screensaver */
-                dbus_error_init (&error);
-                exists = dbus_bus_name_has_owner (connection, GS_SERVICE_GNOME, &error);
-                if (dbus_error_is_set (&error)) {
-                        dbus_error_free (&error);
-                }
+        g_variant_get (reply, "(u)", &res);
+        g_variant_unref (reply);
+
+        if (res == DBUS_REQUEST_NAME_REPLY_EXISTS) {
+                g_set_error (error,
+                             GS_LISTENER_ERROR,
+                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
+                             "%s",
+                             exists_message);
+                return FALSE;
         }
 
-        return exists;
+        return TRUE;
+}
+
+static void
+subscribe_system_signal (GSListener *listener,
+                         const char *sender,
+                         const char *interface,
+                         const char *member,
+                         const char *path,
+                         const char *arg0)
+{
+        guint id;
+
+        id = g_dbus_connection_signal_subscribe (listener->priv->system_connection,
+                                                 sender,
+                                                 interface,
+                                                 member,
+                                                 path,
+                                                 arg0,
+                                                 G_DBUS_SIGNAL_FLAGS_NONE,
+                                                 listener_system_signal,
+                                                 listener,
+                                                 NULL);
+
+        listener->priv->system_subscriptions = g_slist_prepend (listener->priv->system_subscriptions,
+                                                                GUINT_TO_POINTER (id));
+}
+
+#ifdef WITH_SYSTEMD
+/* The session and seat paths come from logind after startup,
+ * their signals are subscribed to once both the path is known
+ * and the name has been acquired. */
+static void
+subscribe_logind_signals (GSListener *listener)
+{
+        if (! listener->priv->acquired || ! listener->priv->have_systemd)
+                return;
+
+        if (listener->priv->system_connection == NULL)
+                return;
+
+        if (listener->priv->session_id != NULL && ! listener->priv->session_subscribed) {
+                subscribe_system_signal (listener,
+                                         SYSTEMD_LOGIND_SERVICE,
+                                         SYSTEMD_LOGIND_SESSION_INTERFACE,
+                                         "Unlock",
+                                         listener->priv->session_id,
+                                         NULL);
+                subscribe_system_signal (listener,
+                                         SYSTEMD_LOGIND_SERVICE,
+                                         SYSTEMD_LOGIND_SESSION_INTERFACE,
+                                         "Lock",
+                                         listener->priv->session_id,
+                                         NULL);
+                listener->priv->session_subscribed = TRUE;
+        }
+
+        if (listener->priv->logind_seat != NULL && ! listener->priv->seat_subscribed) {
+                subscribe_system_signal (listener,
+                                         SYSTEMD_LOGIND_SERVICE,
+                                         DBUS_PROPERTIES_INTERFACE,
+                                         "PropertiesChanged",
+                                         listener->priv->logind_seat,
+                                         SYSTEMD_LOGIND_SEAT_INTERFACE);
+                listener->priv->seat_subscribed = TRUE;
+        }
 }
+#endif
 
 gboolean
 gs_listener_acquire (GSListener *listener,
                      GError    **error)
 {
-        int       res;
-        DBusError buserror;
-        gboolean  is_connected;
+        GError *regerror = NULL;
+        guint   i;
 
         g_return_val_if_fail (listener != NULL, FALSE);
 
@@ -1762,8 +2281,7 @@ gs_listener_acquire (GSListener *listener,
                 return FALSE;
         }
 
-        is_connected = dbus_connection_get_is_connected (listener->priv->connection);
-        if (! is_connected) {
+        if (g_dbus_connection_is_closed (listener->priv->connection)) {
                 g_set_error (error,
                              GS_LISTENER_ERROR,
                              GS_LISTENER_ERROR_ACQUISITION_FAILURE,
@@ -1781,218 +2299,227 @@ gs_listener_acquire (GSListener *listener,
                 return FALSE;
         }
 
-        dbus_error_init (&buserror);
-
-        if (dbus_connection_register_object_path (listener->priv->connection,
-                                                  GS_PATH,
-                                                  &gs_listener_vtable,
-                                                  listener) == FALSE) {
-                g_critical ("out of memory registering object path");
-                return FALSE;
-        }
-
-        /* Register KDE path */
-        if (dbus_connection_register_object_path (listener->priv->connection,
-                                                  GS_PATH_KDE,
-                                                  &gs_listener_vtable,
-                                                  listener) == FALSE) {
-                g_critical ("out of memory registering object path");
-                return FALSE;
-        }
-
-        /* Register GNOME interface */
-        if (dbus_connection_register_object_path (listener->priv->connection,
-                                                  GS_PATH_GNOME,
-                                                  &gs_listener_vtable,
-                                                  listener) == FALSE) {
-                g_critical ("out of memory registering object path");
-                return FALSE;
+        /* Register the paths, including the KDE and GNOME ones */
+        for (i = 0; i < G_N_ELEMENTS (exported_objects); i++) {
+                GDBusInterfaceInfo *info;
+
+                info = g_dbus_node_info_lookup_interface (introspection_data,
+                                                          exported_objects [i].interface);
+
+                listener->priv->object_ids [i] =
+                        g_dbus_connection_register_object (listener->priv->connection,
+                                                           exported_objects [i].path,
+                                                           info,
+                                                           &gs_listener_vtable,
+                                                           listener,
+                                                           NULL,
+                                                           &regerror);
+                if (listener->priv->object_ids [i] == 0) {
+                        g_critical ("couldn't register %s on %s: %s",
+                                    exported_objects [i].interface,
+                                    exported_objects [i].path,
+                                    regerror->message);
+                        g_error_free (regerror);
+                        return FALSE;
+                }
         }
 
-        res = dbus_bus_request_name (listener->priv->connection,
-                                     GS_SERVICE,
-                                     DBUS_NAME_FLAG_DO_NOT_QUEUE,
-                                     &buserror);
-        if (dbus_error_is_set (&buserror)) {
-                g_set_error (error,
-                             GS_LISTENER_ERROR,
-                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-                             "%s",
-                             buserror.message);
-        }
-        if (res == DBUS_REQUEST_NAME_REPLY_EXISTS) {
-                g_set_error (error,
-                             GS_LISTENER_ERROR,
-                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-                             "%s",
-                             _("screensaver already running in this session"));
+        if (! request_name (listener, GS_SERVICE,
+                            _("screensaver already running in this session"), error)) {
                 return FALSE;
         }
 
-        dbus_error_free (&buserror);
-
-        res = dbus_bus_request_name (listener->priv->connection,
-                                     GS_SERVICE_GNOME,
-                                     DBUS_NAME_FLAG_DO_NOT_QUEUE,
-                                     &buserror);
-        if (dbus_error_is_set (&buserror)) {
-                g_set_error (error,
-                             GS_LISTENER_ERROR,
-                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-                             "%s",
-                             buserror.message);
-        }
-        if (res == DBUS_REQUEST_NAME_REPLY_EXISTS) {
-                g_set_error (error,
-                             GS_LISTENER_ERROR,
-                             GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-                             "%s",
-                             _("GNOME screensaver already running in this session"));
+        if (! request_name (listener, GS_SERVICE_GNOME,
+                            _("GNOME screensaver already running in this session"), error)) {
                 return FALSE;
         }
 
-        dbus_error_free (&buserror);
-
-        dbus_connection_add_filter (listener->priv->connection, listener_dbus_filter_function, listener, NULL);
-
-        dbus_bus_add_match (listener->priv->connection,
-                            "type='signal'"
-                            ",interface='"DBUS_INTERFACE_DBUS"'"
-                            ",sender='"DBUS_SERVICE_DBUS"'"
-                            ",member='NameOwnerChanged'",
-                            NULL);
+        listener->priv->acquired = TRUE;
 
         if (listener->priv->system_connection != NULL) {
-                dbus_connection_add_filter (listener->priv->system_connection,
-                                            listener_dbus_system_filter_function,
-                                            listener,
-                                            NULL);
 #ifdef WITH_SYSTEMD
                 if (listener->priv->have_systemd) {
-                        dbus_bus_add_match (listener->priv->system_connection,
-                                            "type='signal'"
-                                            ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-                                            ",interface='"SYSTEMD_LOGIND_SESSION_INTERFACE"'"
-                                            ",member='Unlock'",
-                                            NULL);
-                        dbus_bus_add_match (listener->priv->system_connection,
-                                            "type='signal'"
-                                            ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-                                            ",interface='"SYSTEMD_LOGIND_SESSION_INTERFACE"'"
-                                            ",member='Lock'",
-                                            NULL);
-                        dbus_bus_add_match (listener->priv->system_connection,
-                                            "type='signal'"
-                                            ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-                                            ",interface='"DBUS_INTERFACE_PROPERTIES"'"
-                                            ",member='PropertiesChanged'",
-                                            NULL);
+                        subscribe_logind_signals (listener);
 
 #ifdef WITH_LOCK_ON_SUSPEND
-                        dbus_bus_add_match (listener->priv->system_connection,
-                                            "type='signal'"
-                                            ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-                                            ",interface='"SYSTEMD_LOGIND_INTERFACE"'"
-                                            ",member='PrepareForSleep'",
-                                            NULL);
+                        subscribe_system_signal (listener,
+                                                 SYSTEMD_LOGIND_SERVICE,
+                                                 SYSTEMD_LOGIND_INTERFACE,
+                                                 "PrepareForSleep",
+                                                 SYSTEMD_LOGIND_PATH,
+                                                 NULL);
 #endif
 
 #ifdef WITH_UPOWER
 #ifdef WITH_LOCK_ON_LID
-                        dbus_bus_add_match (listener->priv->system_connection,
-                                            "type='signal'"
-                                            ",sender='"UP_SERVICE"'"
-                                            ",interface='"DBUS_INTERFACE_PROPERTIES"'"
-                                            ",member='PropertiesChanged'",
-                                            NULL);
+                        subscribe_system_signal (listener,
+                                                 UP_SERVICE,
+                                                 DBUS_PROPERTIES_INTERFACE,
+                                                 "PropertiesChanged",
+                                                 UP_PATH,
+                                                 UP_INTERFACE);
 #endif
 #endif
 
-                        return (res != -1);
+                        return TRUE;
                 }
 #endif
 
 #ifdef WITH_UPOWER
 #ifdef WITH_LOCK_ON_LID
-                dbus_bus_add_match (listener->priv->system_connection,
-                                    "type='signal'"
-                                    ",sender='"UP_SERVICE"'"
-                                    ",interface='"DBUS_INTERFACE_PROPERTIES"'"
-                                    ",member='PropertiesChanged'",
-                                    NULL);
+                subscribe_system_signal (listener,
+                                         UP_SERVICE,
+                                         DBUS_PROPERTIES_INTERFACE,
+                                         "PropertiesChanged",
+                                         UP_PATH,
+                                         UP_INTERFACE);
 #endif
 #endif
         }
 
-        return (res != -1);
+        return TRUE;
 }
 
-static char *
-query_session_id (GSListener *listener)
+#ifdef WITH_SYSTEMD
+static void
+query_logind_seat_reply (GSListener *listener,
+                         GVariant   *reply)
 {
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       error;
-        char           *ssid;
+        GVariant *value;
 
-        if (listener->priv->system_connection == NULL) {
-                gs_debug ("No connection to the system bus");
-                return NULL;
-        }
+        value = property_get_reply_value (reply, G_VARIANT_TYPE ("(so)"));
+        if (value == NULL)
+                return;
 
-        ssid = NULL;
+        g_free (listener->priv->logind_seat);
+        g_variant_get (value, "(so)", NULL, &listener->priv->logind_seat);
+        g_variant_unref (value);
+        gs_debug ("Got logind seat: %s", listener->priv->logind_seat);
 
-        dbus_error_init (&error);
+        subscribe_logind_signals (listener);
+}
 
-#ifdef WITH_SYSTEMD
-        if (listener->priv->have_systemd) {
-                dbus_uint32_t pid = getpid();
+static void
+query_session_id_reply (GSListener *listener,
+                        GVariant   *reply)
+{
+        g_free (listener->priv->session_id);
+        g_variant_get (reply, "(o)", &listener->priv->session_id);
+        gs_debug ("Got session-id: %s", listener->priv->session_id);
+
+        subscribe_logind_signals (listener);
+
+        /* ActiveSession is only taken from the signals of our seat. */
+        send_property_get (listener,
+                           SYSTEMD_LOGIND_SERVICE,
+                           listener->priv->session_id,
+                           SYSTEMD_LOGIND_SESSION_INTERFACE,
+                           "Seat",
+                           query_logind_seat_reply);
+}
 
-                message = dbus_message_new_method_call (SYSTEMD_LOGIND_SERVICE, SYSTEMD_LOGIND_PATH, SYSTEMD_LOGIND_INTERFACE, "GetSessionByPID");
-                if (message == NULL) {
-                        gs_debug ("Couldn't allocate the dbus message");
-                        return NULL;
-                }
+static void send_session_id_call (GSListener *listener);
 
-                if (dbus_message_append_args (message, DBUS_TYPE_UINT32, &pid, DBUS_TYPE_INVALID) == FALSE) {
-                        gs_debug ("Couldn't add args to the dbus message");
-                        dbus_message_unref (message);
-                        return NULL;
-                }
+static gboolean
+query_session_id_retry (GSListener *listener)
+{
+        listener->priv->session_id_retry_id = 0;
 
-                /* FIXME: use async? */
-                reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-                                                                   message,
-                                                                   -1, &error);
-                dbus_message_unref (message);
+        send_session_id_call (listener);
 
-                if (dbus_error_is_set (&error)) {
-                        gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                        dbus_error_free (&error);
-                        return NULL;
-                }
+        return G_SOURCE_REMOVE;
+}
+
+static void
+query_session_id_done (GObject      *source,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+        GSListener *listener = user_data;
+        GVariant   *reply;
+        GError     *error = NULL;
 
-                if (dbus_message_get_args (reply, &error,
-                                           DBUS_TYPE_OBJECT_PATH, &ssid,
-                                           DBUS_TYPE_INVALID)) {
-                        ssid = g_strdup (ssid);
-                } else {
-                        ssid = NULL;
+        reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+
+        if (reply == NULL) {
+                /* The listener may be gone already. */
+                if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        g_error_free (error);
+                        return;
                 }
 
-                dbus_message_unref (reply);
+                /* Asking again waits for a new connection. */
+                if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED)) {
+                        gs_debug ("%s, not asking for the session", error->message);
+                        g_error_free (error);
+                        return;
+                }
 
-                if (dbus_error_is_set (&error)) {
-                        gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                        dbus_error_free (&error);
-                        return NULL;
+                /* Only a definitive answer means we can't find our session. */
+                if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)
+                    && ! g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT)
+                    && ! g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_TIMED_OUT)
+                    && ! g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY)) {
+                        g_error ("session_id is not set, is /proc mounted with hidepid>0? %s",
+                                 error->message);
                 }
 
-                return ssid;
+                gs_debug ("%s, asking for the session again in %u ms",
+                          error->message, listener->priv->session_id_retry_delay);
+                g_error_free (error);
+
+                listener->priv->session_id_retry_id = g_timeout_add (listener->priv->session_id_retry_delay,
+                                                                     (GSourceFunc) query_session_id_retry,
+                                                                     listener);
+                listener->priv->session_id_retry_delay = MIN (listener->priv->session_id_retry_delay * 2,
+                                                              SESSION_ID_RETRY_MAX);
+                return;
+        }
+
+        query_session_id_reply (listener, reply);
+        g_variant_unref (reply);
+}
+
+static void
+send_session_id_call (GSListener *listener)
+{
+        if (listener->priv->system_connection == NULL) {
+                gs_debug ("No connection to the system bus");
+                return;
         }
+
+        g_dbus_connection_call (listener->priv->system_connection,
+                                SYSTEMD_LOGIND_SERVICE,
+                                SYSTEMD_LOGIND_PATH,
+                                SYSTEMD_LOGIND_INTERFACE,
+                                "GetSessionByPID",
+                                g_variant_new ("(u)", (guint32) getpid ()),
+                                G_VARIANT_TYPE ("(o)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                SYSTEM_BUS_TIMEOUT,
+                                listener->priv->cancellable,
+                                query_session_id_done,
+                                listener);
+}
 #endif
 
-        return NULL;
+static gboolean
+query_session_id (GSListener *listener)
+{
+        if (listener->priv->system_connection == NULL) {
+                gs_debug ("No connection to the system bus");
+                return FALSE;
+        }
+
+#ifdef WITH_SYSTEMD
+        if (listener->priv->have_systemd) {
+                listener->priv->session_id_retry_delay = SESSION_ID_RETRY_INITIAL;
+                send_session_id_call (listener);
+                return TRUE;
+        }
+#endif
+
+        return FALSE;
 }
 
 #ifdef WITH_SYSTEMD
@@ -2019,12 +2546,9 @@ query_sd_session_id (GSListener *listener)
 static void
 init_session_id (GSListener *listener)
 {
-        g_free (listener->priv->session_id);
-        listener->priv->session_id = query_session_id (listener);
-        if (listener->priv->session_id == NULL)
+        /* The session id is filled in once logind answers. */
+        if (! query_session_id (listener))
                 g_error ("session_id is not set, is /proc mounted with hidepid>0?");
-        else
-                gs_debug ("Got session-id: %s", listener->priv->session_id);
 
 #ifdef WITH_SYSTEMD
         g_free (listener->priv->sd_session_id);
@@ -2038,84 +2562,36 @@ init_session_id (GSListener *listener)
 #endif
 }
 
-static char *
-query_seat_path (GSListener *listener)
+static void
+query_seat_path_reply (GSListener *listener,
+                       GVariant   *reply)
 {
-        DBusMessage    *message;
-        DBusMessage    *reply;
-        DBusError       error;
-        DBusMessageIter reply_iter;
-        DBusMessageIter sub_iter;
-        char           *seat;
-        const char     *interface;
-        const char     *property;
+        GVariant *value;
+
+        value = property_get_reply_value (reply, G_VARIANT_TYPE_OBJECT_PATH);
+        if (value == NULL)
+                return;
 
+        g_free (listener->priv->seat_path);
+        listener->priv->seat_path = g_variant_dup_string (value, NULL);
+        g_variant_unref (value);
+        gs_debug ("Got seat: %s", listener->priv->seat_path);
+}
+
+static void
+init_seat_path (GSListener *listener)
+{
         if (listener->priv->system_connection == NULL) {
                 gs_debug ("No connection to the system bus");
-                return NULL;
+                return;
         }
 
         if (DM_SESSION_PATH == NULL) {
                 g_error ("Environment variable XDG_SESSION_PATH not set. Is LightDM running?");
         }
 
-        seat = NULL;
-
-        dbus_error_init (&error);
-
-        message = dbus_message_new_method_call (DM_SERVICE, DM_SESSION_PATH, DBUS_PROPERTIES_INTERFACE, "Get");
-        if (message == NULL) {
-                gs_debug ("Couldn't allocate the dbus message");
-                return NULL;
-        }
-
-        interface = DM_SESSION_INTERFACE;
-        property = "Seat";
-
-        if (dbus_message_append_args (message, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID) == FALSE) {
-                gs_debug ("Couldn't add args to the dbus message");
-                dbus_message_unref (message);
-                return NULL;
-        }
-
-        /* FIXME: use async? */
-        reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-                                                           message,
-                                                           -1, &error);
-        dbus_message_unref (message);
-
-        if (dbus_error_is_set (&error)) {
-                gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-                dbus_error_free (&error);
-                return NULL;
-        }
-
-        if (dbus_message_iter_init (reply, &reply_iter) == TRUE
-            && dbus_message_iter_get_arg_type (&reply_iter) == DBUS_TYPE_VARIANT) {
-
-                dbus_message_iter_recurse (&reply_iter, &sub_iter);
-
-                if (dbus_message_iter_get_arg_type (&sub_iter) == DBUS_TYPE_OBJECT_PATH) {
-                        dbus_message_iter_get_basic (&sub_iter, &seat);
-                        seat = g_strdup (seat);
-                } else {
-                        gs_debug ("Unexpected return type");
-                }
-        } else {
-                gs_debug ("Unexpected return type");
-        }
-
-        dbus_message_unref (reply);
-
-        return seat;
-}
-
-static void
-init_seat_path (GSListener *listener)
-{
-        g_free (listener->priv->seat_path);
-        listener->priv->seat_path = query_seat_path (listener);
-        gs_debug ("Got seat: %s", listener->priv->seat_path);
+        send_property_get (listener, DM_SERVICE, DM_SESSION_PATH, DM_SESSION_INTERFACE, "Seat",
+                           query_seat_path_reply);
 }
 
 static void
@@ -2129,18 +2605,27 @@ gs_listener_init (GSListener *listener)
         listener->priv->delay_fd = -1;
 #endif
 
+        listener->priv->cancellable = g_cancellable_new ();
+
+        gs_listener_register_methods (listener);
+
         gs_listener_dbus_init (listener);
 
         init_session_id (listener);
         init_seat_path (listener);
 
-        listener->priv->inhibit_list = g_hash_table_new_full (g_int_hash, g_int_equal, g_free, g_free);
+        listener->priv->inhibit_list = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                                              (GDestroyNotify) inhibitor_free);
+        listener->priv->inhibit_owners = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                                                (GDestroyNotify) inhibit_owner_free);
 }
 
 static void
 gs_listener_finalize (GObject *object)
 {
-        GSListener *listener;
+        GSListener    *listener;
+        GSList        *l;
+        guint          i;
 
         g_return_if_fail (object != NULL);
         g_return_if_fail (GS_IS_LISTENER (object));
@@ -2149,11 +2634,55 @@ gs_listener_finalize (GObject *object)
 
         g_return_if_fail (listener->priv != NULL);
 
+        g_cancellable_cancel (listener->priv->cancellable);
+        g_object_unref (listener->priv->cancellable);
+
+#ifdef WITH_SYSTEMD
+        if (listener->priv->session_id_retry_id != 0)
+                g_source_remove (listener->priv->session_id_retry_id);
+#endif
+
+        gs_listener_resume_suspend (listener);
+
+        if (listener->priv->connection != NULL) {
+                for (i = 0; i < G_N_ELEMENTS (exported_objects); i++) {
+                        if (listener->priv->object_ids [i] != 0) {
+                                g_dbus_connection_unregister_object (listener->priv->connection,
+                                                                     listener->priv->object_ids [i]);
+                        }
+                }
+
+                g_signal_handlers_disconnect_by_func (listener->priv->connection,
+                                                      listener_connection_closed,
+                                                      listener);
+                g_object_unref (listener->priv->connection);
+        }
+
+        if (listener->priv->system_connection != NULL) {
+                for (l = listener->priv->system_subscriptions; l != NULL; l = l->next) {
+                        g_dbus_connection_signal_unsubscribe (listener->priv->system_connection,
+                                                              GPOINTER_TO_UINT (l->data));
+                }
+
+                g_signal_handlers_disconnect_by_func (listener->priv->system_connection,
+                                                      listener_connection_closed,
+                                                      listener);
+                g_object_unref (listener->priv->system_connection);
+        }
+        g_slist_free (listener->priv->system_subscriptions);
+
         g_free (listener->priv->session_id);
         g_free (listener->priv->seat_path);
 
+        g_hash_table_destroy (listener->priv->methods);
+        g_hash_table_destroy (listener->priv->inhibit_list);
+        g_hash_table_destroy (listener->priv->inhibit_owners);
+
+        g_clear_object (&listener->priv->lock_machine);
+
 #ifdef WITH_SYSTEMD
         g_free (listener->priv->sd_session_id);
+        g_free (listener->priv->logind_seat);
 #endif
 
         G_OBJECT_CLASS (gs_listener_parent_class)->finalize (object);
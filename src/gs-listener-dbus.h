@@ -23,6 +23,8 @@
 #ifndef __GS_LISTENER_H
 #define __GS_LISTENER_H
 
+#include "gs-lock-machine.h"
+
 G_BEGIN_DECLS
 
 #define GS_TYPE_LISTENER         (gs_listener_get_type ())
@@ -91,6 +93,9 @@ void        gs_listener_resume_suspend          (GSListener *listener);
 void        gs_listener_set_idle_hint           (GSListener *listener,
                                                  gboolean    idle);
 
+void        gs_listener_set_lock_machine        (GSListener    *listener,
+                                                 GSLockMachine *machine);
+
 G_END_DECLS
 
 #endif /* __GS_LISTENER_H */
@@ -39,6 +39,10 @@
 #include <X11/extensions/dpms.h>
 #endif
 
+#ifdef HAVE_XSYNC_EXTENSION
+#include <X11/extensions/sync.h>
+#endif
+
 #include "gs-listener-x11.h"
 #include "gs-marshal.h"
 #include "gs-debug.h"
@@ -55,11 +59,41 @@ struct GSListenerX11Private
         int scrnsaver_event_base;
 #endif
 
+#ifdef HAVE_XSYNC_EXTENSION
+        int          sync_event_base;
+        XSyncCounter idle_counter;
+        /* Fire when IDLETIME rises above and falls below idle_threshold. */
+        XSyncAlarm   idle_alarm;
+        XSyncAlarm   activity_alarm;
+        gint64       idle_threshold;
+        /* Fires once on the first activity after IDLETIME reached
+         * watch_value, None when not armed. */
+        XSyncAlarm   watch_alarm;
+        gint64       watch_value;
+        /* How long to be idle before input emits activity, 0 if
+         * nobody is waiting for it. */
+        gint64       activity_idle;
+        /* Without the MIT extension the server can't be told to
+         * hold off, so the idle alarm is ignored instead. */
+        gboolean     inhibited;
+#endif
+
         gboolean active;
+
+        /* The idle time last read from the server, in ms, and when.
+         * It keeps growing until there is activity, so it is
+         * extrapolated until it gets older than idle_max_age, as
+         * long as activity is reported to us. */
+        gulong   idle_snapshot;
+        gint64   idle_snapshot_time;
+        guint    idle_max_age;
+        guint    idle_queries;
+        guint    idle_extrapolated;
 };
 
 enum {
         BLANKING_CHANGED,
+        ACTIVITY,
         LAST_SIGNAL
 };
 
@@ -85,16 +119,271 @@ gs_listener_x11_class_init (GSListenerX11Class *klass)
                               G_TYPE_NONE,
                               1,
                               G_TYPE_BOOLEAN);
+        signals [ACTIVITY] =
+                g_signal_new ("activity",
+                              G_TYPE_FROM_CLASS (object_class),
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (GSListenerX11Class, activity),
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__VOID,
+                              G_TYPE_NONE,
+                              0);
 
         g_type_class_add_private (klass, sizeof (GSListenerX11Private));
 }
 
+#ifdef HAVE_XSYNC_EXTENSION
+static gboolean xsync_watch (GSListenerX11 *listener,
+                             gint64         value);
+#endif
+
+static void
+set_idle_snapshot (GSListenerX11 *listener,
+                   gulong         idle)
+{
+        listener->priv->idle_snapshot = idle;
+        listener->priv->idle_snapshot_time = g_get_monotonic_time ();
+
+#ifdef HAVE_XSYNC_EXTENSION
+        /* Drop the snapshot on the next activity, or now if there
+         * already was some since it was read. */
+        if (! xsync_watch (listener, idle))
+                listener->priv->idle_snapshot_time = 0;
+#endif
+}
+
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION)
+static void
+clear_idle_snapshot (GSListenerX11 *listener)
+{
+        listener->priv->idle_snapshot_time = 0;
+}
+
+/* Whether activity would drop the snapshot. Without XSync activity
+ * is only reported once the screensaver is on. */
+static gboolean
+idle_snapshot_watched (GSListenerX11 *listener)
+{
+#ifdef HAVE_XSYNC_EXTENSION
+        if (listener->priv->watch_alarm != None)
+                return TRUE;
+#endif
+        return listener->priv->active;
+}
+#endif
+
+static void
+set_active (GSListenerX11 *listener,
+            gboolean       active)
+{
+        if (listener->priv->active != active)
+                g_signal_emit (listener, signals [BLANKING_CHANGED], 0, active);
+        listener->priv->active = active;
+}
+
+#ifdef HAVE_XSYNC_EXTENSION
+static gint64
+xsync_value_to_int64 (XSyncValue value)
+{
+        return ((gint64) XSyncValueHigh32 (value) << 32) | XSyncValueLow32 (value);
+}
+
+static XSyncAlarm
+xsync_alarm_set (Display       *xdisplay,
+                 XSyncAlarm     alarm,
+                 XSyncCounter   counter,
+                 XSyncTestType  test,
+                 gint64         value)
+{
+        XSyncAlarmAttributes attr;
+        unsigned int         flags;
+
+        /* A transition alarm with a zero delta stays armed after firing. */
+        attr.trigger.counter = counter;
+        attr.trigger.value_type = XSyncAbsolute;
+        attr.trigger.test_type = test;
+        XSyncIntsToValue (&attr.trigger.wait_value, value & 0xffffffff, value >> 32);
+        XSyncIntToValue (&attr.delta, 0);
+        attr.events = True;
+
+        flags = XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue | XSyncCADelta | XSyncCAEvents;
+
+        if (alarm == None)
+                return XSyncCreateAlarm (xdisplay, flags, &attr);
+
+        XSyncChangeAlarm (xdisplay, alarm, flags, &attr);
+        return alarm;
+}
+
+/* Arms watch_alarm at value, or keeps it if it is armed lower.
+ * IDLETIME only falls below value on activity.  Returns FALSE if it
+ * is below value already, the alarm won't fire for that activity. */
+static gboolean
+xsync_watch (GSListenerX11 *listener,
+             gint64         value)
+{
+        Display   *xdisplay;
+        XSyncValue current;
+        gboolean   ret = TRUE;
+
+        if (listener->priv->idle_counter == None)
+                return TRUE;
+
+        /* Falling below 0 can't happen. */
+        value = MAX (value, 1);
+
+        if (listener->priv->watch_alarm != None && listener->priv->watch_value <= value)
+                return TRUE;
+
+        listener->priv->watch_value = value;
+
+        xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+        gdk_error_trap_push ();
+        listener->priv->watch_alarm = xsync_alarm_set (xdisplay,
+                                                       listener->priv->watch_alarm,
+                                                       listener->priv->idle_counter,
+                                                       XSyncNegativeTransition,
+                                                       value);
+
+        /* Input between reading the counter and arming the alarm. */
+        if (XSyncQueryCounter (xdisplay, listener->priv->idle_counter, &current)
+            && xsync_value_to_int64 (current) < value) {
+                gs_debug ("Activity before the watch was armed");
+                ret = FALSE;
+        }
+        gdk_error_trap_pop_ignored ();
+
+        return ret;
+}
+
+/* The threshold follows the server screensaver timeout, so the alarms
+ * fire when the MIT screensaver would start and stop. */
+static void
+xsync_arm_alarms (GSListenerX11 *listener,
+                  Display       *xdisplay)
+{
+        int timeout, interval, prefer_blanking, allow_exposures;
+
+        XGetScreenSaver (xdisplay, &timeout, &interval, &prefer_blanking, &allow_exposures);
+
+        if (timeout <= 0) {
+                gs_debug ("Screensaver timeout disabled, no idle alarms");
+                listener->priv->idle_threshold = 0;
+                return;
+        }
+
+        if ((gint64) timeout * 1000 == listener->priv->idle_threshold)
+                return;
+
+        listener->priv->idle_threshold = (gint64) timeout * 1000;
+
+        listener->priv->idle_alarm = xsync_alarm_set (xdisplay,
+                                                      listener->priv->idle_alarm,
+                                                      listener->priv->idle_counter,
+                                                      XSyncPositiveTransition,
+                                                      listener->priv->idle_threshold);
+        listener->priv->activity_alarm = xsync_alarm_set (xdisplay,
+                                                          listener->priv->activity_alarm,
+                                                          listener->priv->idle_counter,
+                                                          XSyncNegativeTransition,
+                                                          listener->priv->idle_threshold);
+
+        gs_debug ("Idle alarms set at %" G_GINT64_FORMAT " ms", listener->priv->idle_threshold);
+}
+
+static gboolean
+xsync_init (GSListenerX11 *listener,
+            Display       *xdisplay)
+{
+        XSyncSystemCounter *counters;
+        int                 sync_error_base;
+        int                 major, minor;
+        int                 n_counters;
+        int                 i;
+
+        if (! XSyncQueryExtension (xdisplay, &listener->priv->sync_event_base, &sync_error_base)
+            || ! XSyncInitialize (xdisplay, &major, &minor)) {
+                gs_debug ("XSync extension not found");
+                return FALSE;
+        }
+
+        counters = XSyncListSystemCounters (xdisplay, &n_counters);
+        for (i = 0; i < n_counters; i++) {
+                if (strcmp (counters [i].name, "IDLETIME") == 0) {
+                        listener->priv->idle_counter = counters [i].counter;
+                        break;
+                }
+        }
+        if (counters != NULL)
+                XSyncFreeSystemCounterList (counters);
+
+        if (listener->priv->idle_counter == None) {
+                gs_debug ("XSync IDLETIME counter not found");
+                return FALSE;
+        }
+
+        xsync_arm_alarms (listener, xdisplay);
+
+        return TRUE;
+}
+
+static void
+xsync_alarm_notify (GSListenerX11         *listener,
+                    XSyncAlarmNotifyEvent *ane)
+{
+        gint64 idle;
+
+        idle = xsync_value_to_int64 (ane->counter_value);
+
+        if (ane->alarm == listener->priv->idle_alarm && listener->priv->idle_alarm != None) {
+                gs_debug ("Idle for %" G_GINT64_FORMAT " ms", idle);
+                set_idle_snapshot (listener, idle);
+#ifndef HAVE_MIT_SAVER_EXTENSION
+                if (listener->priv->inhibited)
+                        gs_debug ("Inhibited, not blanking");
+                else
+                        set_active (listener, TRUE);
+#endif
+        } else if (ane->alarm == listener->priv->activity_alarm && listener->priv->activity_alarm != None) {
+                gs_debug ("Activity resumed");
+                set_idle_snapshot (listener, idle);
+#ifndef HAVE_MIT_SAVER_EXTENSION
+                set_active (listener, FALSE);
+#endif
+                /* Pick up a changed screensaver timeout for the next time. */
+                xsync_arm_alarms (listener, ane->display);
+        } else if (ane->alarm == listener->priv->watch_alarm && listener->priv->watch_alarm != None) {
+                gint64 watched = listener->priv->watch_value;
+
+                gs_debug ("Activity after %" G_GINT64_FORMAT " ms idle", watched);
+                clear_idle_snapshot (listener);
+
+                /* Until the next snapshot activity is of no interest. */
+                XSyncDestroyAlarm (ane->display, listener->priv->watch_alarm);
+                listener->priv->watch_alarm = None;
+
+                if (listener->priv->activity_idle == 0)
+                        return;
+
+                if (watched >= listener->priv->activity_idle) {
+                        listener->priv->activity_idle = 0;
+                        g_signal_emit (listener, signals [ACTIVITY], 0);
+                } else {
+                        /* Armed lower for the snapshot, wait for a longer pause. */
+                        xsync_watch (listener, listener->priv->activity_idle);
+                }
+        }
+}
+#endif
+
 static GdkFilterReturn
 xroot_filter (GdkXEvent *xevent,
               GdkEvent  *event,
               gpointer  data)
 {
-#ifdef HAVE_MIT_SAVER_EXTENSION /* Added to suppress warnings */
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION) /* Added to suppress warnings */
         GSListenerX11 *listener;
 #endif
         XEvent *ev;
@@ -102,7 +391,7 @@ xroot_filter (GdkXEvent *xevent,
         g_return_val_if_fail (data != NULL, GDK_FILTER_CONTINUE);
         g_return_val_if_fail (GS_IS_LISTENER_X11 (data), GDK_FILTER_CONTINUE);
 
-#ifdef HAVE_MIT_SAVER_EXTENSION /* Added to suppress warnings */
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION) /* Added to suppress warnings */
         listener = GS_LISTENER_X11 (data);
 #endif
 
@@ -118,19 +407,26 @@ xroot_filter (GdkXEvent *xevent,
                         case ScreenSaverOff:
                         case ScreenSaverDisabled:
                                 gs_debug ("ScreenSaver stopped");
-                                if (listener->priv->active)
-                                        g_signal_emit (listener, signals [BLANKING_CHANGED], 0, FALSE);
-                                listener->priv->active = FALSE;
+                                /* Stopped by activity, or the saver was switched off. */
+                                if (xssne->state == ScreenSaverOff)
+                                        set_idle_snapshot (listener, 0);
+                                else
+                                        clear_idle_snapshot (listener);
+                                set_active (listener, FALSE);
                                 break;
 
                         case ScreenSaverOn:
                                 gs_debug ("ScreenSaver started");
-                                if (!listener->priv->active)
-                                        g_signal_emit (listener, signals [BLANKING_CHANGED], 0, TRUE);
-                                listener->priv->active = TRUE;
+                                clear_idle_snapshot (listener);
+                                set_active (listener, TRUE);
                                 break;
                         }
                 }
+#endif
+#ifdef HAVE_XSYNC_EXTENSION
+                if (ev->xany.type == (listener->priv->sync_event_base + XSyncAlarmNotify)) {
+                        xsync_alarm_notify (listener, (XSyncAlarmNotifyEvent *) ev);
+                }
 #endif
                 break;
         }
@@ -173,6 +469,14 @@ gs_listener_x11_acquire (GSListenerX11 *listener)
         gdk_error_trap_pop_ignored ();
 #endif
 
+#ifdef HAVE_XSYNC_EXTENSION
+        gdk_error_trap_push ();
+        if (xsync_init (listener, GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()))) {
+                gs_debug ("XSync idle alarms registered");
+        }
+        gdk_error_trap_pop_ignored ();
+#endif
+
         gdk_window_add_filter (NULL, (GdkFilterFunc)xroot_filter, listener);
 
         return TRUE;
@@ -191,6 +495,8 @@ gs_listener_x11_simulate_activity (GSListenerX11 *listener)
         DPMSForceLevel (GDK_DISPLAY_XDISPLAY (display), DPMSModeOn);
 #endif
         gdk_error_trap_pop_ignored ();
+
+        set_idle_snapshot (listener, 0);
 }
 
 gboolean
@@ -209,8 +515,14 @@ gs_listener_x11_force_blanking (GSListenerX11 *listener,
 #ifdef HAVE_DPMS_EXTENSION
                 DPMSForceLevel (GDK_DISPLAY_XDISPLAY (display), DPMSModeOn);
 #endif
+                set_idle_snapshot (listener, 0);
         }
         gdk_error_trap_pop_ignored ();
+
+#ifndef HAVE_MIT_SAVER_EXTENSION
+        /* There is no ScreenSaverNotify to report this back. */
+        set_active (listener, active);
+#endif
         /* TODO: what should the return value be? */
         return active;
 }
@@ -227,35 +539,128 @@ gs_listener_x11_inhibit (GSListenerX11 *listener,
         gdk_error_trap_push ();
         XScreenSaverSuspend (GDK_DISPLAY_XDISPLAY (display), active);
 
+        gdk_error_trap_pop_ignored ();
+#elif defined(HAVE_XSYNC_EXTENSION)
+        XSyncValue value;
+
+        if (listener->priv->inhibited == active)
+                return;
+
+        listener->priv->inhibited = active;
+
+        if (active || listener->priv->idle_counter == None || listener->priv->idle_threshold == 0)
+                return;
+
+        /* Like a resumed server screensaver, blank right away if the
+         * timeout passed while inhibited.  The idle alarm already
+         * fired and won't again before the next activity. */
+        gdk_error_trap_push ();
+        if (XSyncQueryCounter (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()),
+                               listener->priv->idle_counter, &value)
+            && xsync_value_to_int64 (value) >= listener->priv->idle_threshold) {
+                gs_debug ("Idle past the timeout when uninhibited");
+                set_active (listener, TRUE);
+        }
         gdk_error_trap_pop_ignored ();
 #endif
 }
 
-gulong
-gs_listener_x11_idle_time (GSListenerX11 *listener)
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION)
+static gboolean
+query_idle_time (GSListenerX11 *listener,
+                 gulong        *idle)
 {
-        gulong secs = 0;
-#ifdef HAVE_MIT_SAVER_EXTENSION
         GdkDisplay *display;
+        gboolean    res = FALSE;
+#ifdef HAVE_MIT_SAVER_EXTENSION
         GdkScreen *screen;
         GdkWindow *window;
         XScreenSaverInfo scrnsaver_info;
+#else
+        XSyncValue value;
+#endif
 
         display = gdk_display_get_default ();
+
+        gdk_error_trap_push ();
+#ifdef HAVE_MIT_SAVER_EXTENSION
         screen = gdk_display_get_default_screen (display);
         window = gdk_screen_get_root_window (screen);
 
-        gdk_error_trap_push ();
         if (XScreenSaverQueryInfo (GDK_DISPLAY_XDISPLAY (display), GDK_WINDOW_XID (window), &scrnsaver_info)) {
-                secs = scrnsaver_info.idle / 1000;
+                *idle = scrnsaver_info.idle;
+                res = TRUE;
         } else {
                 gs_debug ("ScreenSaverExtension not found");
         }
+#else
+        if (listener->priv->idle_counter != None
+            && XSyncQueryCounter (GDK_DISPLAY_XDISPLAY (display), listener->priv->idle_counter, &value)) {
+                *idle = xsync_value_to_int64 (value);
+                res = TRUE;
+        } else {
+                gs_debug ("XSync IDLETIME counter not available");
+        }
+#endif
         gdk_error_trap_pop_ignored ();
+
+        return res;
+}
+#endif
+
+gulong
+gs_listener_x11_idle_time (GSListenerX11 *listener)
+{
+        gulong secs = 0;
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION)
+        gulong idle;
+        gint64 age;
+
+        if (listener->priv->idle_snapshot_time != 0 && idle_snapshot_watched (listener)) {
+                age = g_get_monotonic_time () - listener->priv->idle_snapshot_time;
+                if (age < (gint64) listener->priv->idle_max_age * G_USEC_PER_SEC) {
+                        listener->priv->idle_extrapolated++;
+                        return (listener->priv->idle_snapshot + age / 1000) / 1000;
+                }
+        }
+
+        if (query_idle_time (listener, &idle)) {
+                secs = idle / 1000;
+                set_idle_snapshot (listener, idle);
+        }
+
+        listener->priv->idle_queries++;
+        gs_debug ("Idle time %lu s read from X (%u queries, %u extrapolated)",
+                  secs, listener->priv->idle_queries, listener->priv->idle_extrapolated);
 #endif
         return secs;
 }
 
+void
+gs_listener_x11_set_idle_max_age (GSListenerX11 *listener,
+                                  guint          seconds)
+{
+        g_return_if_fail (GS_IS_LISTENER_X11 (listener));
+
+        listener->priv->idle_max_age = seconds;
+}
+
+/* Emits activity once on the first input after at least idle ms
+ * without any. */
+void
+gs_listener_x11_watch_activity (GSListenerX11 *listener,
+                                guint          idle)
+{
+        g_return_if_fail (GS_IS_LISTENER_X11 (listener));
+
+#ifdef HAVE_XSYNC_EXTENSION
+        listener->priv->activity_idle = MAX (idle, 1);
+        xsync_watch (listener, listener->priv->activity_idle);
+#else
+        gs_debug ("No XSync, unable to watch for activity");
+#endif
+}
+
 static void
 gs_listener_x11_init (GSListenerX11 *listener)
 {
@@ -274,6 +679,15 @@ gs_listener_x11_finalize (GObject *object)
 
         g_return_if_fail (listener->priv != NULL);
 
+#ifdef HAVE_XSYNC_EXTENSION
+        if (listener->priv->idle_alarm != None)
+                XSyncDestroyAlarm (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), listener->priv->idle_alarm);
+        if (listener->priv->activity_alarm != None)
+                XSyncDestroyAlarm (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), listener->priv->activity_alarm);
+        if (listener->priv->watch_alarm != None)
+                XSyncDestroyAlarm (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), listener->priv->watch_alarm);
+#endif
+
         gdk_window_remove_filter (NULL, (GdkFilterFunc)xroot_filter, NULL);
 
         G_OBJECT_CLASS (gs_listener_x11_parent_class)->finalize (object);
@@ -45,6 +45,7 @@ typedef struct
         GObjectClass       parent_class;
 
         void            (* blanking_changed)         (GSListenerX11 *listener, gboolean active);
+        void            (* activity)                 (GSListenerX11 *listener);
 
 } GSListenerX11Class;
 
@@ -58,6 +59,10 @@ gboolean       gs_listener_x11_force_blanking    (GSListenerX11 *listener,
 void           gs_listener_x11_inhibit           (GSListenerX11 *listener,
                                                   gboolean       active);
 gulong         gs_listener_x11_idle_time         (GSListenerX11 *listener);
+void           gs_listener_x11_set_idle_max_age  (GSListenerX11 *listener,
+                                                  guint          seconds);
+void           gs_listener_x11_watch_activity    (GSListenerX11 *listener,
+                                                  guint          idle);
 
 G_END_DECLS
 
@@ -0,0 +1,313 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gs-lock-machine.h"
+#include "gs-probe.h"
+#include "gs-debug.h"
+
+/* The last events fed, kept for the diagnostics. */
+#define LOG_SIZE 64
+
+/* Marks an event that doesn't apply to a state. */
+#define IGNORE GS_LOCK_N_STATES
+
+static const char *state_names [GS_LOCK_N_STATES] = {
+        "unlocked",
+        "locking",
+        "locking-deferred",
+        "locked",
+        "deferred",
+        "handed-over",
+};
+
+static const char *event_names [GS_LOCK_N_EVENTS] = {
+        "lock",
+        "mapped",
+        "failed",
+        "defer",
+        "proceed",
+        "hand-over",
+        "unlock",
+};
+
+#define U GS_LOCK_STATE_UNLOCKED
+#define L GS_LOCK_STATE_LOCKING
+#define LD GS_LOCK_STATE_LOCKING_DEFERRED
+#define K GS_LOCK_STATE_LOCKED
+#define D GS_LOCK_STATE_DEFERRED
+#define H GS_LOCK_STATE_HANDED_OVER
+#define X IGNORE
+
+/* The next state for each state and event. A deferral asked for while
+ * the screen isn't locked is dropped, there is nothing to hand over. */
+static const guint8 transitions [GS_LOCK_N_STATES] [GS_LOCK_N_EVENTS] = {
+        /*             lock  mapped failed defer proceed hand-over unlock */
+        /* unlocked */ { L,    X,     X,     X,    X,      X,        X },
+        /* locking  */ { X,    K,     U,     LD,   X,      H,        U },
+        /* locking- */ { X,    D,     U,     X,    L,      H,        U },
+        /* locked   */ { X,    X,     X,     D,    X,      H,        U },
+        /* deferred */ { X,    X,     X,     X,    K,      H,        U },
+        /* handed-  */ { X,    X,     X,     D,    X,      X,        U },
+};
+
+#undef U
+#undef L
+#undef LD
+#undef K
+#undef D
+#undef H
+#undef X
+
+struct _GSLockMachine
+{
+        GObject        parent_instance;
+
+        GSLockState    state;
+
+        guint          entries [GS_LOCK_N_STATES];
+        gint64         entered [GS_LOCK_N_STATES];
+        /* Time spent in each state, not counting the current stay. */
+        gint64         time_in [GS_LOCK_N_STATES];
+
+        GSLockLogEntry log [LOG_SIZE];
+        guint          log_next;
+        guint          log_len;
+};
+
+enum {
+        PROP_0,
+        PROP_STATE,
+        N_PROPERTIES
+};
+
+static GParamSpec *properties [N_PROPERTIES] = { NULL, };
+
+G_DEFINE_TYPE (GSLockMachine, gs_lock_machine, G_TYPE_OBJECT)
+
+const char *
+gs_lock_state_name (GSLockState state)
+{
+        g_return_val_if_fail (state < GS_LOCK_N_STATES, NULL);
+
+        return state_names [state];
+}
+
+const char *
+gs_lock_event_name (GSLockEvent event)
+{
+        g_return_val_if_fail (event < GS_LOCK_N_EVENTS, NULL);
+
+        return event_names [event];
+}
+
+static void
+log_add (GSLockMachine *machine,
+         gint64         now,
+         GSLockEvent    event,
+         GSLockState    from,
+         GSLockState    to,
+         gboolean       ignored)
+{
+        GSLockLogEntry *entry = &machine->log [machine->log_next];
+
+        entry->time = now;
+        entry->event = event;
+        entry->from = from;
+        entry->to = to;
+        entry->ignored = ignored;
+
+        machine->log_next = (machine->log_next + 1) % LOG_SIZE;
+        if (machine->log_len < LOG_SIZE)
+                machine->log_len++;
+}
+
+/* Feeds an event that happened at now, in monotonic microseconds.
+ * Returns FALSE if it doesn't apply to the current state. */
+gboolean
+gs_lock_machine_feed_at (GSLockMachine *machine,
+                         GSLockEvent    event,
+                         gint64         now)
+{
+        GSLockState from;
+        guint       to;
+
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), FALSE);
+        g_return_val_if_fail (event < GS_LOCK_N_EVENTS, FALSE);
+
+        from = machine->state;
+        to = transitions [from] [event];
+
+        GS_PROBE3 (lock_transition, event, from, to);
+
+        if (to == IGNORE) {
+                gs_debug ("Lock state %s ignores %s",
+                          state_names [from], event_names [event]);
+                log_add (machine, now, event, from, from, TRUE);
+                return FALSE;
+        }
+
+        gs_debug ("Lock state %s -> %s on %s",
+                  state_names [from], state_names [to], event_names [event]);
+        log_add (machine, now, event, from, to, FALSE);
+
+        machine->time_in [from] += now - machine->entered [from];
+        machine->entered [to] = now;
+        machine->entries [to]++;
+        machine->state = to;
+
+        g_object_notify_by_pspec (G_OBJECT (machine), properties [PROP_STATE]);
+
+        return TRUE;
+}
+
+gboolean
+gs_lock_machine_feed (GSLockMachine *machine,
+                      GSLockEvent    event)
+{
+        return gs_lock_machine_feed_at (machine, event, g_get_monotonic_time ());
+}
+
+GSLockState
+gs_lock_machine_get_state (GSLockMachine *machine)
+{
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), GS_LOCK_STATE_UNLOCKED);
+
+        return machine->state;
+}
+
+/* Whether handing the session over waits for something. */
+gboolean
+gs_lock_machine_get_deferred (GSLockMachine *machine)
+{
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), FALSE);
+
+        return machine->state == GS_LOCK_STATE_DEFERRED
+                || machine->state == GS_LOCK_STATE_LOCKING_DEFERRED;
+}
+
+guint
+gs_lock_machine_get_entries (GSLockMachine *machine,
+                             GSLockState    state)
+{
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), 0);
+        g_return_val_if_fail (state < GS_LOCK_N_STATES, 0);
+
+        return machine->entries [state];
+}
+
+/* When state was last entered, 0 if never. */
+gint64
+gs_lock_machine_get_entered (GSLockMachine *machine,
+                             GSLockState    state)
+{
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), 0);
+        g_return_val_if_fail (state < GS_LOCK_N_STATES, 0);
+
+        return machine->entered [state];
+}
+
+/* Total time spent in state up to now, in microseconds. */
+gint64
+gs_lock_machine_get_time_in (GSLockMachine *machine,
+                             GSLockState    state,
+                             gint64         now)
+{
+        gint64 time;
+
+        g_return_val_if_fail (GS_IS_LOCK_MACHINE (machine), 0);
+        g_return_val_if_fail (state < GS_LOCK_N_STATES, 0);
+
+        time = machine->time_in [state];
+        if (state == machine->state)
+                time += now - machine->entered [state];
+
+        return time;
+}
+
+/* Calls func for the logged events, oldest first. */
+void
+gs_lock_machine_foreach_log (GSLockMachine *machine,
+                             GSLockLogFunc  func,
+                             gpointer       user_data)
+{
+        guint i;
+
+        g_return_if_fail (GS_IS_LOCK_MACHINE (machine));
+
+        for (i = 0; i < machine->log_len; i++) {
+                guint index = (machine->log_next + LOG_SIZE - machine->log_len + i) % LOG_SIZE;
+
+                func (&machine->log [index], user_data);
+        }
+}
+
+static void
+gs_lock_machine_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+        GSLockMachine *machine = GS_LOCK_MACHINE (object);
+
+        switch (prop_id) {
+        case PROP_STATE:
+                g_value_set_uint (value, machine->state);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+gs_lock_machine_class_init (GSLockMachineClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->get_property = gs_lock_machine_get_property;
+
+        properties [PROP_STATE] =
+                g_param_spec_uint ("state",
+                                   NULL,
+                                   NULL,
+                                   0,
+                                   GS_LOCK_N_STATES - 1,
+                                   GS_LOCK_STATE_UNLOCKED,
+                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+        g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+gs_lock_machine_init (GSLockMachine *machine)
+{
+        machine->state = GS_LOCK_STATE_UNLOCKED;
+        machine->entered [GS_LOCK_STATE_UNLOCKED] = g_get_monotonic_time ();
+        machine->entries [GS_LOCK_STATE_UNLOCKED] = 1;
+}
+
+GSLockMachine *
+gs_lock_machine_new (void)
+{
+        return GS_LOCK_MACHINE (g_object_new (GS_TYPE_LOCK_MACHINE, NULL));
+}
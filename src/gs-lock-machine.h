@@ -0,0 +1,100 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_LOCK_MACHINE_H
+#define __GS_LOCK_MACHINE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Where the session is on its way from unlocked to locked by the
+ * display manager. Deferred means the lock windows stay up, but
+ * handing the session over waits for the screensaver to end or the
+ * lid to open. */
+typedef enum {
+        GS_LOCK_STATE_UNLOCKED = 0,
+        GS_LOCK_STATE_LOCKING,
+        GS_LOCK_STATE_LOCKING_DEFERRED,
+        GS_LOCK_STATE_LOCKED,
+        GS_LOCK_STATE_DEFERRED,
+        GS_LOCK_STATE_HANDED_OVER,
+        GS_LOCK_N_STATES
+} GSLockState;
+
+typedef enum {
+        /* The lock screen was activated. */
+        GS_LOCK_EVENT_LOCK = 0,
+        /* The lock windows are mapped. */
+        GS_LOCK_EVENT_MAPPED,
+        /* The lock windows couldn't be shown. */
+        GS_LOCK_EVENT_FAILED,
+        /* Hand the session over later. */
+        GS_LOCK_EVENT_DEFER,
+        /* A deferred hand over can go ahead. */
+        GS_LOCK_EVENT_PROCEED,
+        /* The display manager locked the session or shows the greeter. */
+        GS_LOCK_EVENT_HAND_OVER,
+        /* The lock screen was deactivated. */
+        GS_LOCK_EVENT_UNLOCK,
+        GS_LOCK_N_EVENTS
+} GSLockEvent;
+
+typedef struct {
+        gint64      time;
+        GSLockEvent event;
+        GSLockState from;
+        GSLockState to;
+        gboolean    ignored;
+} GSLockLogEntry;
+
+typedef void (* GSLockLogFunc) (const GSLockLogEntry *entry,
+                                gpointer              user_data);
+
+#define GS_TYPE_LOCK_MACHINE gs_lock_machine_get_type ()
+G_DECLARE_FINAL_TYPE (GSLockMachine, gs_lock_machine, GS, LOCK_MACHINE, GObject)
+
+GSLockMachine * gs_lock_machine_new            (void);
+
+gboolean        gs_lock_machine_feed           (GSLockMachine *machine,
+                                                GSLockEvent    event);
+gboolean        gs_lock_machine_feed_at        (GSLockMachine *machine,
+                                                GSLockEvent    event,
+                                                gint64         now);
+
+GSLockState     gs_lock_machine_get_state      (GSLockMachine *machine);
+gboolean        gs_lock_machine_get_deferred   (GSLockMachine *machine);
+
+guint           gs_lock_machine_get_entries    (GSLockMachine *machine,
+                                                GSLockState    state);
+gint64          gs_lock_machine_get_entered    (GSLockMachine *machine,
+                                                GSLockState    state);
+gint64          gs_lock_machine_get_time_in    (GSLockMachine *machine,
+                                                GSLockState    state,
+                                                gint64         now);
+
+void            gs_lock_machine_foreach_log    (GSLockMachine *machine,
+                                                GSLockLogFunc  func,
+                                                gpointer       user_data);
+
+const char *    gs_lock_state_name             (GSLockState    state);
+const char *    gs_lock_event_name             (GSLockEvent    event);
+
+G_END_DECLS
+
+#endif /* __GS_LOCK_MACHINE_H */
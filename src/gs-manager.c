@@ -29,7 +29,11 @@
 #include "gs-manager.h"
 #include "gs-window.h"
 #include "gs-grab.h"
+#include "gs-fade.h"
 #include "gs-content.h"
+#include "gs-topology.h"
+#include "gs-trace.h"
+#include "gs-probe.h"
 #include "gs-debug.h"
 
 struct _GSManager
@@ -40,6 +44,7 @@ struct _GSManager
 
   /* Configuration */
   guint        lock_after;
+  gboolean     standby;
 
   /* State */
   gboolean     active;
@@ -47,15 +52,19 @@ struct _GSManager
   gboolean     blank;
   gboolean     closed;
   gboolean     show_content;
+  /* ACTIVATED was emitted since the last activation. */
+  gboolean     activated;
 
   guint        greeter_timeout_id;
   guint        lock_timeout_id;
 
   GSGrab      *grab;
+  GSFade      *fade;
 };
 
 enum {
         ACTIVATED,
+        ACTIVATION_FAILED,
         SWITCH_GREETER,
         LOCK,
         LAST_SIGNAL
@@ -66,6 +75,7 @@ enum {
         N_PROPERTIES
 };
 
+/* How long it takes to dim a visible session while the lock comes up. */
 #define FADE_TIMEOUT 250
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
@@ -110,6 +120,7 @@ static void
 gs_manager_init (GSManager *manager)
 {
         manager->grab = gs_grab_new ();
+        manager->fade = gs_fade_new ();
 
         /* Assume we are the visible session on start. */
         manager->visible = TRUE;
@@ -122,16 +133,12 @@ static gboolean
 manager_maybe_grab_window (GSManager *manager,
                            GSWindow  *window)
 {
-        GdkDisplay *display;
         GdkScreen  *screen;
         int         monitor;
         int         x, y;
         gboolean    grabbed;
 
-        display = gdk_display_get_default ();
-        GdkDeviceManager *device_manager = gdk_display_get_device_manager (display);
-        GdkDevice *pointer = gdk_device_manager_get_client_pointer (device_manager);
-        gdk_device_get_position (pointer, &screen, &x, &y);
+        gs_grab_get_pointer_position (manager->grab, &screen, &x, &y);
         monitor = gdk_screen_get_monitor_at_point (screen, x, y);
 
         gdk_flush ();
@@ -142,7 +149,9 @@ manager_maybe_grab_window (GSManager *manager,
                 gs_grab_move_to_window (manager->grab,
                                         gs_window_get_gdk_window (window),
                                         gs_window_get_screen (window),
-                                        TRUE);
+                                        TRUE,
+                                        NULL,
+                                        NULL);
                 grabbed = TRUE;
         }
 
@@ -162,6 +171,20 @@ window_grab_broken_cb (GSWindow           *window,
         }
 }
 
+static gboolean
+manager_windows_mapped (GSManager *manager)
+{
+        GSList *l;
+
+        for (l = manager->windows; l; l = l->next) {
+                if (! gtk_widget_get_mapped (GTK_WIDGET (l->data))) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
 static gboolean
 window_map_event_cb (GSWindow  *window,
                      GdkEvent  *event,
@@ -169,8 +192,17 @@ window_map_event_cb (GSWindow  *window,
 {
         gs_debug ("Handling window map_event event");
 
-        /* FIXME: only emit signal once */
-        g_signal_emit (manager, signals [ACTIVATED], 0);
+        /* Activated once all the monitors are covered. */
+        if (! manager->activated && manager_windows_mapped (manager)) {
+                manager->activated = TRUE;
+
+                gs_trace_mark (GS_TRACE_WINDOWS_MAPPED);
+                GS_PROBE1 (windows_mapped, g_slist_length (manager->windows));
+                /* The windows cover the screens, the gamma can go back. */
+                gs_fade_reset (manager->fade);
+
+                g_signal_emit (manager, signals [ACTIVATED], 0);
+        }
 
         manager_maybe_grab_window (manager, window);
 
@@ -227,19 +259,20 @@ connect_window_signals (GSManager *manager,
 }
 
 static void
-gs_manager_create_window_for_monitor (GSManager *manager,
-                                      GdkScreen *screen,
-                                      int        monitor)
+gs_manager_create_window_for_monitor (GSManager  *manager,
+                                      GSTopology *topology,
+                                      int         monitor)
 {
         GSWindow    *window;
         GdkRectangle rect;
 
-        gdk_screen_get_monitor_geometry (screen, monitor, &rect);
+        gs_topology_get_area (topology, monitor, &rect);
 
         gs_debug ("Creating window for monitor %d [%d,%d] (%dx%d)",
                   monitor, rect.x, rect.y, rect.width, rect.height);
 
-        window = gs_window_new (screen, monitor);
+        window = gs_window_new (gs_topology_get_screen (topology), monitor);
+        gs_window_set_topology (window, topology);
 
         connect_window_signals (manager, window);
 
@@ -247,6 +280,67 @@ gs_manager_create_window_for_monitor (GSManager *manager,
 
         if (manager->active) {
                 gtk_widget_show (GTK_WIDGET (window));
+        } else if (manager->standby) {
+                /* Keep it ready, activation only needs to map it. */
+                gtk_widget_realize (GTK_WIDGET (window));
+        }
+}
+
+static void
+manager_report_standby_cost (GSManager *manager)
+{
+        GSList  *l;
+        guint64  bytes = 0;
+
+        if (! manager->standby) {
+                return;
+        }
+
+        for (l = manager->windows; l; l = l->next) {
+                GdkRectangle rect;
+
+                gdk_screen_get_monitor_geometry (gs_window_get_screen (l->data),
+                                                 gs_window_get_monitor (l->data),
+                                                 &rect);
+                bytes += (guint64) rect.width * rect.height * 4;
+        }
+
+        gs_debug ("Standby windows: %u, about %" G_GUINT64_FORMAT " KiB",
+                  g_slist_length (manager->windows), bytes / 1024);
+}
+
+/* Whether the window showed the same output in its previous topology. */
+static gboolean
+window_matches_monitor (GSWindow   *window,
+                        GSTopology *topology,
+                        int         monitor,
+                        gboolean    by_name)
+{
+        GSTopology  *old_topology;
+        int          old_monitor;
+
+        old_topology = gs_window_get_topology (window);
+        old_monitor = gs_window_get_monitor (window);
+
+        if (old_topology == NULL) {
+                return FALSE;
+        }
+
+        if (by_name) {
+                const char *old_name = gs_topology_get_name (old_topology, old_monitor);
+                const char *name = gs_topology_get_name (topology, monitor);
+
+                return old_name != NULL && g_strcmp0 (old_name, name) == 0;
+        } else {
+                GdkRectangle old_geometry;
+                GdkRectangle geometry;
+
+                return gs_topology_get_geometry (old_topology, old_monitor, &old_geometry)
+                        && gs_topology_get_geometry (topology, monitor, &geometry)
+                        && old_geometry.x == geometry.x
+                        && old_geometry.y == geometry.y
+                        && old_geometry.width == geometry.width
+                        && old_geometry.height == geometry.height;
         }
 }
 
@@ -254,56 +348,88 @@ static void
 on_screen_monitors_changed (GdkScreen *screen,
                             GSManager *manager)
 {
-        GSList *l;
-        int     n_monitors;
-        int     n_windows;
-        int     i;
+        GSList      *l;
+        GSList      *unmatched = NULL;
+        GSTopology  *topology;
+        GSWindow   **assigned;
+        gint64       start;
+        int          n_monitors;
+        int          n_kept = 0;
+        int          n_moved = 0;
+        int          n_created = 0;
+        int          n_destroyed = 0;
+        int          pass;
+        int          i;
 
-        n_monitors = gdk_screen_get_n_monitors (screen);
-        n_windows = g_slist_length (manager->windows);
+        start = g_get_monotonic_time ();
+
+        topology = gs_topology_new (screen);
+        n_monitors = gs_topology_get_n_monitors (topology);
 
         gs_debug ("Monitors changed for screen %d: num=%d",
                   gdk_screen_get_number (screen),
                   n_monitors);
 
-        if (n_monitors > n_windows) {
-
-                /* add more windows */
-                for (i = n_windows; i < n_monitors; i++) {
-                        gs_manager_create_window_for_monitor (manager, screen, i);
+        for (l = manager->windows; l != NULL; l = l->next) {
+                if (gs_window_get_screen (GS_WINDOW (l->data)) == screen) {
+                        unmatched = g_slist_prepend (unmatched, l->data);
                 }
-        } else {
+        }
+        unmatched = g_slist_reverse (unmatched);
+
+        /* Follow each output by its connector name first, then by its
+         * geometry. Whatever is left is reused in order. */
+        assigned = g_new0 (GSWindow *, n_monitors);
+        for (pass = 0; pass < 3; pass++) {
+                for (i = 0; i < n_monitors && unmatched != NULL; i++) {
+                        if (assigned [i] != NULL) {
+                                continue;
+                        }
 
-                gdk_x11_grab_server ();
+                        for (l = unmatched; l != NULL; l = l->next) {
+                                if (pass == 2 || window_matches_monitor (l->data, topology, i, pass == 0)) {
+                                        assigned [i] = l->data;
+                                        unmatched = g_slist_delete_link (unmatched, l);
+                                        break;
+                                }
+                        }
+                }
+        }
 
-                /* remove the extra windows */
-                l = manager->windows;
-                while (l != NULL) {
-                        GdkScreen *this_screen;
-                        int        this_monitor;
-                        GSList    *next = l->next;
+        for (i = 0; i < n_monitors; i++) {
+                if (assigned [i] == NULL) {
+                        gs_manager_create_window_for_monitor (manager, topology, i);
+                        n_created++;
+                        continue;
+                }
 
-                        this_screen = gs_window_get_screen (GS_WINDOW (l->data));
-                        this_monitor = gs_window_get_monitor (GS_WINDOW (l->data));
-                        if (this_screen == screen && this_monitor >= n_monitors) {
-                                gs_window_destroy (GS_WINDOW (l->data));
-                                manager->windows = g_slist_delete_link (manager->windows, l);
-                        }
-                        l = next;
+                if (gs_window_get_monitor (assigned [i]) == i) {
+                        n_kept++;
+                } else {
+                        n_moved++;
                 }
 
-                gdk_flush ();
-                gdk_x11_ungrab_server ();
+                /* Windows whose area didn't change are left alone. */
+                gs_window_set_monitor (assigned [i], i);
+                gs_window_set_topology (assigned [i], topology);
         }
+        g_free (assigned);
 
-        for (l = manager->windows; l != NULL; l = l->next) {
-              GdkScreen *this_screen;
-
-              this_screen = gs_window_get_screen (GS_WINDOW (l->data));
-              if (this_screen == screen) {
-                    gtk_widget_queue_resize (GTK_WIDGET (l->data));
-              }
+        /* The outputs of these windows are gone. */
+        for (l = unmatched; l != NULL; l = l->next) {
+                manager->windows = g_slist_remove (manager->windows, l->data);
+                gs_window_destroy (GS_WINDOW (l->data));
+                n_destroyed++;
         }
+        g_slist_free (unmatched);
+
+        gs_topology_unref (topology);
+
+        gs_debug ("Reconciled windows in %" G_GINT64_FORMAT " us: %d kept, %d moved, %d created, %d destroyed",
+                  g_get_monotonic_time () - start,
+                  n_kept, n_moved, n_created, n_destroyed);
+
+        manager_report_standby_cost (manager);
 }
 
 static void
@@ -430,6 +556,7 @@ gs_manager_dispose (GObject *object)
         g_return_if_fail (manager != NULL);
 
         gs_grab_release (manager->grab);
+        gs_fade_reset (manager->fade);
 
         gs_manager_destroy_windows (manager);
 
@@ -439,6 +566,7 @@ gs_manager_dispose (GObject *object)
         gs_manager_stop_lock (manager);
 
         g_clear_object (&manager->grab);
+        g_clear_object (&manager->fade);
 
         G_OBJECT_CLASS (gs_manager_parent_class)->dispose (object);
 }
@@ -447,24 +575,25 @@ static void
 gs_manager_create_windows_for_screen (GSManager *manager,
                                       GdkScreen *screen)
 {
-        int       n_monitors;
-        int       i;
+        GSTopology *topology;
+        int         n_monitors;
+        int         i;
 
         g_return_if_fail (GS_IS_MANAGER (manager));
         g_return_if_fail (GDK_IS_SCREEN (screen));
 
         g_object_ref (manager);
-        g_object_ref (screen);
 
-        n_monitors = gdk_screen_get_n_monitors (screen);
+        topology = gs_topology_new (screen);
+        n_monitors = gs_topology_get_n_monitors (topology);
 
         gs_debug ("Creating %d windows for screen %d", n_monitors, gdk_screen_get_number (screen));
 
         for (i = 0; i < n_monitors; i++) {
-                gs_manager_create_window_for_monitor (manager, screen, i);
+                gs_manager_create_window_for_monitor (manager, topology, i);
         }
 
-        g_object_unref (screen);
+        gs_topology_unref (topology);
         g_object_unref (manager);
 }
 
@@ -503,11 +632,41 @@ show_windows (GSList *windows)
         }
 }
 
+static void
+hide_windows (GSList *windows)
+{
+        GSList *l;
+
+        for (l = windows; l; l = l->next) {
+                gtk_widget_hide (GTK_WIDGET (l->data));
+        }
+}
+
+static void
+manager_grab_root_cb (GSGrab    *grab,
+                      gboolean   success,
+                      GSManager *manager)
+{
+        if (! success) {
+                /* Whoever activated us is expected to deactivate. */
+                gs_debug ("Unable to grab the keyboard and mouse, giving up");
+                gs_fade_reset (manager->fade);
+                g_signal_emit (manager, signals [ACTIVATION_FAILED], 0);
+                return;
+        }
+
+        gs_trace_mark (GS_TRACE_GRAB_ROOT);
+
+        if (manager->windows == NULL) {
+                gs_manager_create_windows (GS_MANAGER (manager));
+        }
+
+        show_windows (manager->windows);
+}
+
 static gboolean
 gs_manager_activate (GSManager *manager)
 {
-        gboolean    res;
-
         g_return_val_if_fail (manager != NULL, FALSE);
         g_return_val_if_fail (GS_IS_MANAGER (manager), FALSE);
 
@@ -516,18 +675,20 @@ gs_manager_activate (GSManager *manager)
                 return FALSE;
         }
 
-        res = gs_grab_grab_root (manager->grab, FALSE);
-        if (! res) {
-                return FALSE;
-        }
+        GS_PROBE2 (manager_activate, manager->visible, manager->blank);
 
-        if (manager->windows == NULL) {
-                gs_manager_create_windows (GS_MANAGER (manager));
-        }
+        gs_trace_mark (GS_TRACE_MANAGER_ACTIVATE);
 
         manager->active = TRUE;
 
-        show_windows (manager->windows);
+        if (manager->visible && !manager->blank) {
+                gs_fade_out (manager->fade, FADE_TIMEOUT);
+        }
+
+        /* The windows are shown once the grab is held. */
+        gs_grab_grab_root (manager->grab, FALSE,
+                           (GSGrabFunc)manager_grab_root_cb,
+                           manager);
 
         if (manager->visible && !manager->blank && !manager->closed) {
                 gs_manager_timed_switch (manager);
@@ -549,9 +710,16 @@ gs_manager_deactivate (GSManager *manager)
                 return FALSE;
         }
 
+        GS_PROBE1 (manager_deactivate, manager->standby);
+
         gs_grab_release (manager->grab);
+        gs_fade_reset (manager->fade);
 
-        gs_manager_destroy_windows (manager);
+        if (manager->standby) {
+                hide_windows (manager->windows);
+        } else {
+                gs_manager_destroy_windows (manager);
+        }
 
         gs_manager_stop_switch (manager);
 
@@ -562,6 +730,9 @@ gs_manager_deactivate (GSManager *manager)
         /* reset state */
         manager->active = FALSE;
         manager->show_content = FALSE;
+        manager->activated = FALSE;
+
+        GS_PROBE (manager_deactivated);
 
         return TRUE;
 }
@@ -586,6 +757,17 @@ gs_manager_class_init (GSManagerClass *klass)
                               G_TYPE_NONE,
                               0);
 
+        signals [ACTIVATION_FAILED] =
+                g_signal_new ("activation-failed",
+                              G_TYPE_FROM_CLASS (object_class),
+                              G_SIGNAL_RUN_LAST,
+                              0,
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__VOID,
+                              G_TYPE_NONE,
+                              0);
+
         signals [SWITCH_GREETER] =
                 g_signal_new ("switch-greeter",
                               G_TYPE_FROM_CLASS (object_class),
@@ -655,6 +837,18 @@ gs_manager_get_active (GSManager *manager)
         return manager->active;
 }
 
+/* Whether the lock windows are all mapped and hold the grabs. */
+gboolean
+gs_manager_get_ready (GSManager *manager)
+{
+        g_return_val_if_fail (GS_IS_MANAGER (manager), FALSE);
+
+        return manager->active
+                && manager->windows != NULL
+                && manager_windows_mapped (manager)
+                && gs_grab_get_held (manager->grab);
+}
+
 void
 gs_manager_set_session_visible (GSManager *manager,
                                 gboolean   visible)
@@ -686,6 +880,10 @@ gs_manager_set_blank_screen (GSManager *manager,
 
         manager->blank = blank;
 
+        if (!blank) {
+                gs_manager_user_activity (manager);
+        }
+
         if (!manager->active && blank) {
                 gs_manager_timed_lock (manager);
         } else {
@@ -696,6 +894,27 @@ gs_manager_set_blank_screen (GSManager *manager,
         }
 }
 
+/* Whether the session is dimmed while the lock comes up. */
+gboolean
+gs_manager_get_fading (GSManager *manager)
+{
+        g_return_val_if_fail (GS_IS_MANAGER (manager), FALSE);
+
+        return gs_fade_get_active (manager->fade);
+}
+
+/* Activity while the lock is still coming up, undo the dimming. */
+void
+gs_manager_user_activity (GSManager *manager)
+{
+        g_return_if_fail (GS_IS_MANAGER (manager));
+
+        if (gs_fade_get_active (manager->fade)) {
+                gs_debug ("Activity while fading, fading back in");
+                gs_fade_in (manager->fade, FADE_TIMEOUT);
+        }
+}
+
 gboolean
 gs_manager_get_blank_screen (GSManager *manager)
 {
@@ -727,6 +946,32 @@ gs_manager_set_lock_after (GSManager *manager,
         manager->lock_after = lock_after;
 }
 
+void
+gs_manager_set_standby_windows (GSManager *manager,
+                                gboolean   standby)
+{
+        g_return_if_fail (GS_IS_MANAGER (manager));
+
+        if (manager->standby == standby) {
+                return;
+        }
+
+        manager->standby = standby;
+
+        /* While active the windows are in use either way. */
+        if (manager->active) {
+                return;
+        }
+
+        if (standby) {
+                gs_manager_create_windows (manager);
+                manager_report_standby_cost (manager);
+        } else {
+                gs_debug ("Dropping standby windows");
+                gs_manager_destroy_windows (manager);
+        }
+}
+
 void
 gs_manager_show_content (GSManager *manager)
 {
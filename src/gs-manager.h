@@ -33,6 +33,7 @@ GSManager * gs_manager_new                  (void);
 gboolean    gs_manager_set_active           (GSManager  *manager,
                                              gboolean    active);
 gboolean    gs_manager_get_active           (GSManager  *manager);
+gboolean    gs_manager_get_ready            (GSManager  *manager);
 
 void        gs_manager_set_session_visible  (GSManager  *manager,
                                              gboolean    active);
@@ -50,8 +51,14 @@ void        gs_manager_set_lid_closed       (GSManager *manager,
 void        gs_manager_set_lock_after       (GSManager  *manager,
                                              guint       lock_after);
 
+void        gs_manager_set_standby_windows  (GSManager  *manager,
+                                             gboolean    standby);
+
 void        gs_manager_show_content         (GSManager  *manager);
 
+gboolean    gs_manager_get_fading           (GSManager  *manager);
+void        gs_manager_user_activity        (GSManager  *manager);
+
 G_END_DECLS
 
 #endif /* __GS_MANAGER_H */
@@ -37,8 +37,23 @@
 #include "gs-listener-dbus.h"
 #include "gs-listener-x11.h"
 #include "gs-monitor.h"
+#include "gs-trace.h"
+#include "gs-probe.h"
 #include "gs-debug.h"
 
+/* Handing the session over to the display manager waits for the lock
+ * windows to be mapped and grabbed and for the session to be active,
+ * but no longer than HAND_OVER_TIMEOUT ms. Switching VT before the
+ * windows are up exposed the content and upset some backlights.
+ */
+#define HAND_OVER_TIMEOUT 1000
+
+typedef enum {
+        HAND_OVER_NONE,
+        HAND_OVER_LOCK_SESSION,
+        HAND_OVER_SWITCH_GREETER
+} HandOver;
+
 struct _GSMonitor
 {
         GObject parent_instance;
@@ -47,11 +62,15 @@ struct _GSMonitor
         GSListenerX11   *listener_x11;
         GSManager       *manager;
         LLConfig        *conf;
+        GSLockMachine   *lock_machine;
+
+        HandOver         hand_over;
+        guint            hand_over_id;
+        gint64           hand_over_queued;
 
         gboolean         late_locking;
         gboolean         lock_on_suspend;
         gboolean         idle_hint;
-        gboolean         perform_lock;
         gboolean         lock_on_lid;
 };
 
@@ -63,8 +82,15 @@ gs_monitor_lock_screen (GSMonitor *monitor)
         gboolean res;
         gboolean active;
 
+        if (gs_manager_get_ready (monitor->manager))
+                gs_trace_skip_lock ();
+        else
+                gs_trace_mark (GS_TRACE_LOCK_SCREEN);
+
         active = gs_manager_get_active (monitor->manager);
 
+        GS_PROBE1 (lock_screen, active);
+
         if (! active) {
                 res = gs_listener_set_active (monitor->listener, TRUE);
                 if (! res) {
@@ -74,70 +100,167 @@ gs_monitor_lock_screen (GSMonitor *monitor)
 
 }
 
-static gboolean
+static void
 gs_monitor_lock_session (GSMonitor *monitor)
 {
         gboolean visible;
 
         visible = gs_manager_get_session_visible (monitor->manager);
 
+        GS_PROBE1 (lock_session, visible);
+
         /* Only switch to greeter if we are the visible session */
         if (visible) {
                 gs_listener_send_lock_session (monitor->listener);
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_HAND_OVER);
         } else {
                 /* Show the content in case the session gets visible again. */
                 gs_manager_show_content (monitor->manager);
         }
-
-        return FALSE;
 }
 
-static gboolean
+static void
 gs_monitor_switch_greeter (GSMonitor *monitor)
 {
         gboolean visible;
 
         visible = gs_manager_get_session_visible (monitor->manager);
 
+        GS_PROBE1 (switch_greeter, visible);
+
         /* Only switch to greeter if we are the visible session */
         if (visible) {
                 gs_listener_send_switch_greeter (monitor->listener);
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_HAND_OVER);
         } else {
                 /* Show the content in case the session gets visible again. */
                 gs_manager_show_content (monitor->manager);
         }
+}
 
-        return FALSE;
+static void
+gs_monitor_hand_over_cancel (GSMonitor *monitor)
+{
+        if (monitor->hand_over != HAND_OVER_NONE) {
+                gs_debug ("Cancelling pending hand over");
+        }
+
+        monitor->hand_over = HAND_OVER_NONE;
+        if (monitor->hand_over_id != 0) {
+                g_source_remove (monitor->hand_over_id);
+                monitor->hand_over_id = 0;
+        }
+}
+
+static void
+gs_monitor_hand_over_run (GSMonitor *monitor)
+{
+        HandOver hand_over = monitor->hand_over;
+
+        gs_debug ("Handing over after %" G_GINT64_FORMAT " ms",
+                  (g_get_monotonic_time () - monitor->hand_over_queued) / 1000);
+
+        monitor->hand_over = HAND_OVER_NONE;
+        gs_monitor_hand_over_cancel (monitor);
+
+        switch (hand_over) {
+        case HAND_OVER_LOCK_SESSION:
+                gs_monitor_lock_session (monitor);
+                break;
+        case HAND_OVER_SWITCH_GREETER:
+                gs_monitor_switch_greeter (monitor);
+                break;
+        default:
+                break;
+        }
+}
+
+/* Runs the pending hand over once the lock screen is up. */
+static void
+gs_monitor_hand_over_check (GSMonitor *monitor)
+{
+        if (monitor->hand_over == HAND_OVER_NONE)
+                return;
+
+        if (gs_manager_get_ready (monitor->manager)
+            && gs_manager_get_session_visible (monitor->manager)) {
+                gs_monitor_hand_over_run (monitor);
+        }
+}
+
+static gboolean
+gs_monitor_hand_over_timeout (GSMonitor *monitor)
+{
+        monitor->hand_over_id = 0;
+
+        gs_debug ("Lock screen not ready in time");
+        gs_monitor_hand_over_run (monitor);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Replaces a pending hand over. */
+static void
+gs_monitor_hand_over_queue (GSMonitor *monitor,
+                            HandOver   hand_over)
+{
+        GS_PROBE1 (hand_over_queue, hand_over);
+
+        gs_monitor_hand_over_cancel (monitor);
+
+        monitor->hand_over = hand_over;
+        monitor->hand_over_queued = g_get_monotonic_time ();
+        monitor->hand_over_id = g_timeout_add (HAND_OVER_TIMEOUT,
+                                               (GSourceFunc) gs_monitor_hand_over_timeout,
+                                               monitor);
+
+        gs_monitor_hand_over_check (monitor);
 }
 
 static void
 manager_activated_cb (GSManager *manager,
                       GSMonitor *monitor)
 {
-        gs_listener_resume_suspend (monitor->listener);
+        GS_PROBE (manager_activated);
+        gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_MAPPED);
+        /* Otherwise the listener lets suspend go on after its deadline. */
+        if (gs_manager_get_ready (monitor->manager)) {
+                gs_listener_resume_suspend (monitor->listener);
+        }
+        gs_monitor_hand_over_check (monitor);
+}
+
+static void
+manager_activation_failed_cb (GSManager *manager,
+                              GSMonitor *monitor)
+{
+        GS_PROBE (manager_activation_failed);
+        gs_debug ("Unable to lock the screen");
+        gs_monitor_hand_over_cancel (monitor);
+        gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_FAILED);
+        gs_listener_set_active (monitor->listener, FALSE);
 }
 
 static void
 manager_switch_greeter_cb (GSManager *manager,
                            GSMonitor *monitor)
 {
+        GS_PROBE (manager_switch_greeter);
+        gs_monitor_hand_over_cancel (monitor);
         gs_listener_send_switch_greeter (monitor->listener);
+        gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_HAND_OVER);
 }
 
 static void
 manager_lock_cb (GSManager *manager,
                  GSMonitor *monitor)
 {
+        GS_PROBE1 (manager_lock, monitor->late_locking);
         gs_monitor_lock_screen (monitor);
         if (monitor->late_locking) {
-                monitor->perform_lock = TRUE;
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_DEFER);
         } else if (gs_manager_get_session_visible (monitor->manager)) {
-                /* Add a 1s delay for VT switching.
-                 * This seems to preserved content exposure.
-                 */
-                g_timeout_add_seconds (1,
-                                       (GSourceFunc)gs_monitor_lock_session,
-                                       monitor);
+                gs_monitor_hand_over_queue (monitor, HAND_OVER_LOCK_SESSION);
         } else {
                 gs_manager_show_content (monitor->manager);
         }
@@ -148,6 +271,8 @@ conf_lock_on_suspend_cb (LLConfig    *conf,
                          GParamSpec  *pspec,
                          GSMonitor   *monitor)
 {
+        GS_PROBE1 (conf_changed, pspec->name);
+
         g_object_get (G_OBJECT(conf),
                       "lock-on-suspend", &monitor->lock_on_suspend,
                       NULL);
@@ -164,6 +289,8 @@ conf_late_locking_cb (LLConfig    *conf,
                       GParamSpec  *pspec,
                       GSMonitor   *monitor)
 {
+        GS_PROBE1 (conf_changed, pspec->name);
+
         g_object_get (G_OBJECT(conf),
                       "late-locking", &monitor->late_locking,
                       NULL);
@@ -176,6 +303,8 @@ conf_lock_after_screensaver_cb (LLConfig    *conf,
 {
         guint lock_after_screensaver = 5;
 
+        GS_PROBE1 (conf_changed, pspec->name);
+
         g_object_get (G_OBJECT(conf),
                       "lock-after-screensaver", &lock_after_screensaver,
                       NULL);
@@ -188,6 +317,8 @@ conf_lock_on_lid_cb (LLConfig    *conf,
                      GParamSpec  *pspec,
                      GSMonitor   *monitor)
 {
+        GS_PROBE1 (conf_changed, pspec->name);
+
         g_object_get (G_OBJECT(conf),
                       "lock-on-lid", &monitor->lock_on_lid,
                       NULL);
@@ -198,6 +329,8 @@ conf_idle_hint_cb (LLConfig    *conf,
                    GParamSpec  *pspec,
                    GSMonitor   *monitor)
 {
+        GS_PROBE1 (conf_changed, pspec->name);
+
         g_object_get (G_OBJECT(conf),
                       "idle_hint", &monitor->idle_hint,
                       NULL);
@@ -206,30 +339,60 @@ conf_idle_hint_cb (LLConfig    *conf,
                                    monitor->idle_hint && gs_manager_get_blank_screen (monitor->manager));
 }
 
+static void
+conf_standby_windows_cb (LLConfig    *conf,
+                         GParamSpec  *pspec,
+                         GSMonitor   *monitor)
+{
+        gboolean standby_windows = TRUE;
+
+        GS_PROBE1 (conf_changed, pspec->name);
+
+        g_object_get (G_OBJECT(conf),
+                      "standby-windows", &standby_windows,
+                      NULL);
+
+        gs_manager_set_standby_windows (monitor->manager, standby_windows);
+}
+
+static void
+conf_idle_time_max_age_cb (LLConfig    *conf,
+                           GParamSpec  *pspec,
+                           GSMonitor   *monitor)
+{
+        guint idle_time_max_age = 5;
+
+        GS_PROBE1 (conf_changed, pspec->name);
+
+        g_object_get (G_OBJECT(conf),
+                      "idle-time-max-age", &idle_time_max_age,
+                      NULL);
+
+        gs_listener_x11_set_idle_max_age (monitor->listener_x11, idle_time_max_age);
+}
+
 static void
 listener_locked_cb (GSListener *listener,
                     GSMonitor  *monitor)
 {
+        GS_PROBE (locked);
+        gs_monitor_hand_over_cancel (monitor);
         gs_manager_show_content (monitor->manager);
         gs_monitor_lock_screen (monitor);
-        monitor->perform_lock = FALSE;
+        gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_HAND_OVER);
 }
 
 static void
 listener_lock_cb (GSListener *listener,
                   GSMonitor  *monitor)
 {
+        GS_PROBE (lock);
         gs_monitor_lock_screen (monitor);
         if (gs_listener_is_lid_closed (listener)) {
                 /* Don't switch VT while the lid is closed. */
-                monitor->perform_lock = TRUE;
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_DEFER);
         } else if (gs_manager_get_session_visible (monitor->manager)) {
-                /* Add a 1s delay for VT switching.
-                 * This seems to preserved content exposure.
-                 */
-                g_timeout_add_seconds (1,
-                                       (GSourceFunc)gs_monitor_lock_session,
-                                       monitor);
+                gs_monitor_hand_over_queue (monitor, HAND_OVER_LOCK_SESSION);
         } else {
                 gs_manager_show_content (monitor->manager);
         }
@@ -240,8 +403,10 @@ listener_session_switched_cb (GSListener *listener,
                               gboolean    active,
                               GSMonitor  *monitor)
 {
+        GS_PROBE1 (session_switched, active);
         gs_debug ("Session switched: %d", active);
         gs_manager_set_session_visible (monitor->manager, active);
+        gs_monitor_hand_over_check (monitor);
 }
 
 static gboolean
@@ -252,6 +417,8 @@ listener_active_changed_cb (GSListener *listener,
         gboolean res;
         gboolean ret;
 
+        GS_PROBE1 (active_changed, active);
+
         if (monitor->lock_on_suspend && !active) {
                 gs_listener_delay_suspend (monitor->listener);
         }
@@ -263,6 +430,19 @@ listener_active_changed_cb (GSListener *listener,
                 goto done;
         }
 
+        if (! active) {
+                gs_monitor_hand_over_cancel (monitor);
+        }
+
+        gs_lock_machine_feed (monitor->lock_machine,
+                              active ? GS_LOCK_EVENT_LOCK : GS_LOCK_EVENT_UNLOCK);
+
+        /* Input while dimming brings the session back until the lock is up.
+         * A short pause first, so the key that locked doesn't count. */
+        if (active && gs_manager_get_fading (monitor->manager)) {
+                gs_listener_x11_watch_activity (monitor->listener_x11, 100);
+        }
+
         ret = TRUE;
 
  done:
@@ -274,19 +454,35 @@ static void
 listener_suspend_cb (GSListener *listener,
                      GSMonitor  *monitor)
 {
-        if (! monitor->lock_on_suspend)
+        GS_PROBE1 (suspend, monitor->lock_on_suspend);
+
+        if (! monitor->lock_on_suspend) {
+                gs_trace_skip_lock ();
+                /* Still delayed from before it was turned off. */
+                gs_listener_resume_suspend (monitor->listener);
                 return;
+        }
+
+        gs_trace_mark (GS_TRACE_SUSPEND);
+
         /* Show the lock screen until resume.
          * We lock the screen here even when the displaymanager didn't send the signal.
          * This means that need tell the displaymanager to lock the session before it can unlock.
          */
         gs_monitor_lock_screen (monitor);
+
+        /* Already locked, there is nothing to wait for. */
+        if (gs_manager_get_ready (monitor->manager)) {
+                gs_listener_resume_suspend (monitor->listener);
+        }
 }
 
 static void
 listener_resume_cb (GSListener *listener,
                     GSMonitor  *monitor)
 {
+        GS_PROBE1 (resume, monitor->lock_on_suspend);
+
         if (! monitor->lock_on_suspend)
                 return;
         if (gs_listener_is_lid_closed (monitor->listener)) {
@@ -294,14 +490,9 @@ listener_resume_cb (GSListener *listener,
                  * As a corner case this is ok.
                  */
                 /* Don't switch VT while the lid is closed. */
-                monitor->perform_lock = TRUE;
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_DEFER);
         } else {
-                /* Add a 1s delay for resume to complete.
-                 * This seems to fix backlight issues.
-                 */
-                g_timeout_add_seconds (1,
-                                       (GSourceFunc)gs_monitor_switch_greeter,
-                                       monitor);
+                gs_monitor_hand_over_queue (monitor, HAND_OVER_SWITCH_GREETER);
         }
 }
 
@@ -309,6 +500,7 @@ static void
 listener_simulate_user_activity_cb (GSListener *listener,
                                     GSMonitor  *monitor)
 {
+        GS_PROBE (simulate_activity);
         gs_listener_x11_simulate_activity (monitor->listener_x11);
 }
 
@@ -317,6 +509,8 @@ listener_blanking_cb (GSListener *listener,
                       gboolean    active,
                       GSMonitor  *monitor)
 {
+        GS_PROBE1 (blanking, active);
+
         if (! active)
         {
                 /* Don't deactivate the screensaver if we are locked */
@@ -332,6 +526,7 @@ listener_inhibit_cb (GSListener *listener,
                      gboolean    active,
                      GSMonitor  *monitor)
 {
+        GS_PROBE1 (inhibit, active);
         gs_listener_x11_inhibit (monitor->listener_x11, active);
 }
 
@@ -348,6 +543,9 @@ listener_lid_closed_cb (GSListener *listener,
                         GSMonitor   *monitor)
 {
         gboolean closed = gs_listener_is_lid_closed (listener);
+        gboolean deferred = gs_lock_machine_get_deferred (monitor->lock_machine);
+
+        GS_PROBE2 (lid_closed, closed, deferred);
 
         /* If the manager requested a lock when the lid was closed.
          * We don't take the reason of the lock into account.
@@ -355,15 +553,10 @@ listener_lid_closed_cb (GSListener *listener,
          * In case of resume the switch would become a lock.
          * And in case of late locking, the screen saver state isn't taken into account.
          */
-        if (monitor->perform_lock && !closed)
+        if (deferred && !closed)
         {
-                /* Add a 1s delay for resume to complete.
-                 * This seems to fix backlight issues.
-                 */
-                g_timeout_add_seconds (1,
-                                       (GSourceFunc)gs_monitor_lock_session,
-                                       monitor);
-                monitor->perform_lock = FALSE;
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_PROCEED);
+                gs_monitor_hand_over_queue (monitor, HAND_OVER_LOCK_SESSION);
                 return;
         }
 
@@ -382,20 +575,24 @@ listener_lid_closed_cb (GSListener *listener,
         }
         else
         {
-                /* Add a 1s delay for resume to complete.
-                 * This seems to fix backlight issues.
-                 */
-                g_timeout_add_seconds (1,
-                                       (GSourceFunc)gs_monitor_switch_greeter,
-                                       monitor);
+                gs_monitor_hand_over_queue (monitor, HAND_OVER_SWITCH_GREETER);
         }
 }
 
+static void
+listener_x11_activity_cb (GSListenerX11 *listener,
+                          GSMonitor     *monitor)
+{
+        GS_PROBE (activity);
+        gs_manager_user_activity (monitor->manager);
+}
+
 static void
 listener_x11_blanking_changed_cb (GSListenerX11 *listener,
                                   gboolean    active,
                                   GSMonitor  *monitor)
 {
+        GS_PROBE1 (blanking_changed, active);
         gs_debug ("Blanking changed: %d", active);
         gs_manager_set_blank_screen (monitor->manager, active);
         gs_listener_set_blanked (monitor->listener, active);
@@ -404,9 +601,11 @@ listener_x11_blanking_changed_cb (GSListenerX11 *listener,
         }
 
         /* If late locking is enabled only lock the session if the lid isn't closed. */
-        if (!active && !gs_listener_is_lid_closed (monitor->listener) && monitor->perform_lock) {
+        if (!active && !gs_listener_is_lid_closed (monitor->listener)
+            && gs_lock_machine_get_deferred (monitor->lock_machine)) {
+                gs_lock_machine_feed (monitor->lock_machine, GS_LOCK_EVENT_PROCEED);
+                gs_monitor_hand_over_cancel (monitor);
                 gs_monitor_lock_session (monitor);
-                monitor->perform_lock = FALSE;
         }
 }
 
@@ -424,10 +623,13 @@ gs_monitor_init (GSMonitor *monitor)
 #endif
         monitor->idle_hint = FALSE;
 
+        monitor->lock_machine = gs_lock_machine_new ();
         monitor->listener = gs_listener_new ();
         monitor->listener_x11 = gs_listener_x11_new ();
         monitor->manager = gs_manager_new ();
 
+        gs_listener_set_lock_machine (monitor->listener, monitor->lock_machine);
+
         /*
          * Listener signals
          */
@@ -456,12 +658,16 @@ gs_monitor_init (GSMonitor *monitor)
 
         g_signal_connect (monitor->listener_x11, "blanking-changed",
                           G_CALLBACK (listener_x11_blanking_changed_cb), monitor);
+        g_signal_connect (monitor->listener_x11, "activity",
+                          G_CALLBACK (listener_x11_activity_cb), monitor);
 
         /*
          * Manager signals
          */
         g_signal_connect (monitor->manager, "activated",
                           G_CALLBACK (manager_activated_cb), monitor);
+        g_signal_connect (monitor->manager, "activation-failed",
+                          G_CALLBACK (manager_activation_failed_cb), monitor);
         g_signal_connect (monitor->manager, "switch-greeter",
                           G_CALLBACK (manager_switch_greeter_cb), monitor);
         g_signal_connect (monitor->manager, "lock",
@@ -473,6 +679,8 @@ gs_monitor_dispose (GObject *object)
 {
         GSMonitor *monitor = GS_MONITOR (object);
 
+        gs_monitor_hand_over_cancel (monitor);
+
         /*
          * Conf signals
          */
@@ -481,6 +689,8 @@ gs_monitor_dispose (GObject *object)
         g_signal_handlers_disconnect_by_func (monitor->conf, conf_lock_after_screensaver_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->conf, conf_lock_on_lid_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->conf, conf_idle_hint_cb, monitor);
+        g_signal_handlers_disconnect_by_func (monitor->conf, conf_standby_windows_cb, monitor);
+        g_signal_handlers_disconnect_by_func (monitor->conf, conf_idle_time_max_age_cb, monitor);
 
         /*
          * Listener signals
@@ -497,11 +707,13 @@ gs_monitor_dispose (GObject *object)
         g_signal_handlers_disconnect_by_func (monitor->listener, listener_idle_time_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->listener, listener_lid_closed_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->listener_x11, listener_x11_blanking_changed_cb, monitor);
+        g_signal_handlers_disconnect_by_func (monitor->listener_x11, listener_x11_activity_cb, monitor);
 
         /*
          * Manager signals
          */
         g_signal_handlers_disconnect_by_func (monitor->manager, manager_activated_cb, monitor);
+        g_signal_handlers_disconnect_by_func (monitor->manager, manager_activation_failed_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->manager, manager_switch_greeter_cb, monitor);
         g_signal_handlers_disconnect_by_func (monitor->manager, manager_lock_cb, monitor);
 
@@ -509,6 +721,7 @@ gs_monitor_dispose (GObject *object)
         g_clear_object (&monitor->listener);
         g_clear_object (&monitor->listener_x11);
         g_clear_object (&monitor->manager);
+        g_clear_object (&monitor->lock_machine);
 
         G_OBJECT_CLASS (gs_monitor_parent_class)->dispose (object);
 }
@@ -526,6 +739,8 @@ gs_monitor_new (LLConfig *config)
 {
         GSMonitor *monitor;
         guint lock_after_screensaver = 5;
+        gboolean standby_windows = TRUE;
+        guint idle_time_max_age = 5;
 
         monitor = g_object_new (GS_TYPE_MONITOR, NULL);
 
@@ -541,6 +756,10 @@ gs_monitor_new (LLConfig *config)
                           G_CALLBACK (conf_lock_on_lid_cb), monitor);
         g_signal_connect (monitor->conf, "notify::idle-hint",
                           G_CALLBACK (conf_idle_hint_cb), monitor);
+        g_signal_connect (monitor->conf, "notify::standby-windows",
+                          G_CALLBACK (conf_standby_windows_cb), monitor);
+        g_signal_connect (monitor->conf, "notify::idle-time-max-age",
+                          G_CALLBACK (conf_idle_time_max_age_cb), monitor);
 
         g_object_get (G_OBJECT (config),
                       "late-locking", &monitor->late_locking,
@@ -548,9 +767,13 @@ gs_monitor_new (LLConfig *config)
                       "lock-on-lid", &monitor->lock_on_lid,
                       "idle-hint", &monitor->idle_hint,
                       "lock-after-screensaver", &lock_after_screensaver,
+                      "standby-windows", &standby_windows,
+                      "idle-time-max-age", &idle_time_max_age,
                       NULL);
 
         gs_manager_set_lock_after (monitor->manager, lock_after_screensaver);
+        gs_manager_set_standby_windows (monitor->manager, standby_windows);
+        gs_listener_x11_set_idle_max_age (monitor->listener_x11, idle_time_max_age);
 
         if (monitor->lock_on_suspend) {
               gs_listener_delay_suspend (monitor->listener);
@@ -0,0 +1,42 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_PROBE_H
+#define __GS_PROBE_H
+
+/* Static tracepoints in the light_locker provider, for perf, bpftrace
+ * and SystemTap. An SDT probe that nobody attached to is a single nop,
+ * without WITH_SDT it is nothing at all. List them with
+ * "bpftrace -l 'usdt:/usr/bin/light-locker:*'".
+ */
+
+#ifdef WITH_SDT
+#include <sys/sdt.h>
+
+#define GS_PROBE(name)              DTRACE_PROBE (light_locker, name)
+#define GS_PROBE1(name, a)          DTRACE_PROBE1 (light_locker, name, a)
+#define GS_PROBE2(name, a, b)       DTRACE_PROBE2 (light_locker, name, a, b)
+#define GS_PROBE3(name, a, b, c)    DTRACE_PROBE3 (light_locker, name, a, b, c)
+#else
+#define GS_PROBE(name)
+#define GS_PROBE1(name, a)
+#define GS_PROBE2(name, a, b)
+#define GS_PROBE3(name, a, b, c)
+#endif
+
+#endif /* __GS_PROBE_H */
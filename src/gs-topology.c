@@ -0,0 +1,176 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <gdk/gdk.h>
+
+#include "gs-topology.h"
+#include "gs-debug.h"
+
+struct _GSTopology
+{
+        gint          ref_count;
+        GdkScreen    *screen;
+        int           n_monitors;
+        GdkRectangle *geometries;
+        /* Connector names, may be NULL if the server doesn't know. */
+        char        **names;
+        /* The part of each monitor not already covered by a
+         * lower numbered one, so windows don't overlap. */
+        GdkRectangle *areas;
+};
+
+GSTopology *
+gs_topology_new (GdkScreen *screen)
+{
+        GSTopology     *topology;
+        cairo_region_t *covered;
+        int             i;
+
+        g_return_val_if_fail (GDK_IS_SCREEN (screen), NULL);
+
+        topology = g_slice_new0 (GSTopology);
+        topology->ref_count = 1;
+        topology->screen = g_object_ref (screen);
+        topology->n_monitors = gdk_screen_get_n_monitors (screen);
+        topology->geometries = g_new0 (GdkRectangle, topology->n_monitors);
+        topology->names = g_new0 (char *, topology->n_monitors);
+        topology->areas = g_new0 (GdkRectangle, topology->n_monitors);
+
+        covered = cairo_region_create ();
+        for (i = 0; i < topology->n_monitors; i++) {
+                GdkRectangle    geometry;
+                cairo_region_t *region;
+
+                gdk_screen_get_monitor_geometry (screen, i, &geometry);
+                topology->geometries [i] = geometry;
+                topology->names [i] = gdk_screen_get_monitor_plug_name (screen, i);
+
+                region = cairo_region_create_rectangle ((const cairo_rectangle_int_t *)&geometry);
+                cairo_region_subtract (region, covered);
+                cairo_region_get_extents (region, (cairo_rectangle_int_t *)&topology->areas [i]);
+                cairo_region_destroy (region);
+
+                cairo_region_union_rectangle (covered, (const cairo_rectangle_int_t *)&geometry);
+
+                gs_debug ("Monitor %d (%s): x=%d y=%d w=%d h=%d, using x=%d y=%d w=%d h=%d",
+                          i, topology->names [i] ? topology->names [i] : "unknown",
+                          geometry.x, geometry.y, geometry.width, geometry.height,
+                          topology->areas [i].x, topology->areas [i].y,
+                          topology->areas [i].width, topology->areas [i].height);
+        }
+        cairo_region_destroy (covered);
+
+        return topology;
+}
+
+GSTopology *
+gs_topology_ref (GSTopology *topology)
+{
+        g_return_val_if_fail (topology != NULL, NULL);
+
+        topology->ref_count++;
+
+        return topology;
+}
+
+void
+gs_topology_unref (GSTopology *topology)
+{
+        int i;
+
+        g_return_if_fail (topology != NULL);
+
+        if (--topology->ref_count > 0) {
+                return;
+        }
+
+        for (i = 0; i < topology->n_monitors; i++) {
+                g_free (topology->names [i]);
+        }
+
+        g_object_unref (topology->screen);
+        g_free (topology->names);
+        g_free (topology->geometries);
+        g_free (topology->areas);
+        g_slice_free (GSTopology, topology);
+}
+
+GdkScreen *
+gs_topology_get_screen (GSTopology *topology)
+{
+        g_return_val_if_fail (topology != NULL, NULL);
+
+        return topology->screen;
+}
+
+int
+gs_topology_get_n_monitors (GSTopology *topology)
+{
+        g_return_val_if_fail (topology != NULL, 0);
+
+        return topology->n_monitors;
+}
+
+gboolean
+gs_topology_get_area (GSTopology   *topology,
+                      int           monitor,
+                      GdkRectangle *area)
+{
+        g_return_val_if_fail (topology != NULL, FALSE);
+        g_return_val_if_fail (area != NULL, FALSE);
+
+        if (monitor < 0 || monitor >= topology->n_monitors) {
+                return FALSE;
+        }
+
+        *area = topology->areas [monitor];
+
+        return TRUE;
+}
+
+gboolean
+gs_topology_get_geometry (GSTopology   *topology,
+                          int           monitor,
+                          GdkRectangle *geometry)
+{
+        g_return_val_if_fail (topology != NULL, FALSE);
+        g_return_val_if_fail (geometry != NULL, FALSE);
+
+        if (monitor < 0 || monitor >= topology->n_monitors) {
+                return FALSE;
+        }
+
+        *geometry = topology->geometries [monitor];
+
+        return TRUE;
+}
+
+const char *
+gs_topology_get_name (GSTopology *topology,
+                      int         monitor)
+{
+        g_return_val_if_fail (topology != NULL, NULL);
+
+        if (monitor < 0 || monitor >= topology->n_monitors) {
+                return NULL;
+        }
+
+        return topology->names [monitor];
+}
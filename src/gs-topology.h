@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_TOPOLOGY_H
+#define __GS_TOPOLOGY_H
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+/* An immutable snapshot of the monitor layout of a screen. */
+typedef struct _GSTopology GSTopology;
+
+GSTopology *         gs_topology_new            (GdkScreen  *screen);
+GSTopology *         gs_topology_ref            (GSTopology *topology);
+void                 gs_topology_unref          (GSTopology *topology);
+
+GdkScreen *          gs_topology_get_screen     (GSTopology *topology);
+int                  gs_topology_get_n_monitors (GSTopology *topology);
+gboolean             gs_topology_get_area       (GSTopology   *topology,
+                                                 int           monitor,
+                                                 GdkRectangle *area);
+gboolean             gs_topology_get_geometry   (GSTopology   *topology,
+                                                 int           monitor,
+                                                 GdkRectangle *geometry);
+const char *         gs_topology_get_name       (GSTopology   *topology,
+                                                 int           monitor);
+
+G_END_DECLS
+
+#endif /* __GS_TOPOLOGY_H */
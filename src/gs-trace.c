@@ -0,0 +1,179 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-trace.h"
+#include "gs-debug.h"
+
+/* A span that didn't complete within this time is dropped. */
+#define SPAN_TIMEOUT (60 * G_USEC_PER_SEC)
+
+static const char *point_names [GS_TRACE_N_POINTS] = {
+        "prepare-for-sleep",
+        "suspend",
+        "lock-screen",
+        "manager-activate",
+        "grab-root",
+        "windows-mapped",
+        "delay-released",
+};
+
+/* Time spent since the previous point of the same span. */
+static GSTraceHistogram step [GS_TRACE_N_POINTS];
+/* Time spent since PrepareForSleep, only for spans started by it. */
+static GSTraceHistogram since_sleep [GS_TRACE_N_POINTS];
+
+static gboolean span_open = FALSE;
+static gboolean span_from_sleep = FALSE;
+/* Nothing is going to cover the screen for this span. */
+static gboolean span_skip_lock = FALSE;
+static guint    span_seen = 0;
+static gint64   span_start = 0;
+static gint64   span_last = 0;
+
+static void
+histogram_add (GSTraceHistogram *histogram,
+               gint64            usec)
+{
+        guint bucket;
+
+        if (usec < 0)
+                usec = 0;
+
+        bucket = usec > 0 ? g_bit_storage (usec) - 1 : 0;
+        if (bucket >= GS_TRACE_N_BUCKETS)
+                bucket = GS_TRACE_N_BUCKETS - 1;
+
+        if (histogram->count == 0 || (guint64) usec < histogram->min)
+                histogram->min = usec;
+        if ((guint64) usec > histogram->max)
+                histogram->max = usec;
+
+        histogram->count++;
+        histogram->sum += usec;
+        histogram->buckets [bucket]++;
+}
+
+void
+gs_trace_begin (GSTracePoint point)
+{
+        g_return_if_fail (point < GS_TRACE_N_POINTS);
+
+        if (span_open)
+                gs_debug ("Dropping unfinished lock span");
+
+        span_open = TRUE;
+        span_from_sleep = (point == GS_TRACE_PREPARE_FOR_SLEEP);
+        span_skip_lock = FALSE;
+        span_seen = 1 << point;
+        span_start = g_get_monotonic_time ();
+        span_last = span_start;
+
+        gs_debug ("Lock span started at %s", point_names [point]);
+}
+
+void
+gs_trace_mark (GSTracePoint point)
+{
+        gint64 now;
+
+        g_return_if_fail (point < GS_TRACE_N_POINTS);
+
+        now = g_get_monotonic_time ();
+
+        if (span_open && now - span_start > SPAN_TIMEOUT) {
+                gs_debug ("Lock span timed out");
+                span_open = FALSE;
+        }
+
+        if (! span_open) {
+                /* Anything up to the lock request can start a span. */
+                if (point <= GS_TRACE_LOCK_SCREEN)
+                        gs_trace_begin (point);
+                return;
+        }
+
+        /* Only the first time a point is reached counts. */
+        if (span_seen & (1 << point))
+                return;
+
+        histogram_add (&step [point], now - span_last);
+        if (span_from_sleep)
+                histogram_add (&since_sleep [point], now - span_start);
+
+        gs_debug ("Lock span reached %s: +%" G_GINT64_FORMAT " us, %" G_GINT64_FORMAT " us total",
+                  point_names [point], now - span_last, now - span_start);
+
+        span_seen |= 1 << point;
+        span_last = now;
+
+        /* The span is done once the screen is covered and,
+         * when racing suspend, the delay has been handed back. */
+        if ((span_skip_lock || (span_seen & (1 << GS_TRACE_WINDOWS_MAPPED)))
+            && (! span_from_sleep || (span_seen & (1 << GS_TRACE_DELAY_RELEASED)))) {
+                span_open = FALSE;
+        }
+}
+
+/* The screen is locked already, or won't be.  A span started by a
+ * lock request is dropped, one started by PrepareForSleep still times
+ * how long the delay is held and ends when it is released. */
+void
+gs_trace_skip_lock (void)
+{
+        if (! span_open)
+                return;
+
+        if (! span_from_sleep) {
+                gs_debug ("Dropping lock span, nothing to lock");
+                span_open = FALSE;
+                return;
+        }
+
+        span_skip_lock = TRUE;
+
+        if (span_seen & (1 << GS_TRACE_DELAY_RELEASED))
+                span_open = FALSE;
+}
+
+const char *
+gs_trace_point_name (GSTracePoint point)
+{
+        g_return_val_if_fail (point < GS_TRACE_N_POINTS, NULL);
+
+        return point_names [point];
+}
+
+const GSTraceHistogram *
+gs_trace_get_step (GSTracePoint point)
+{
+        g_return_val_if_fail (point < GS_TRACE_N_POINTS, NULL);
+
+        return &step [point];
+}
+
+const GSTraceHistogram *
+gs_trace_get_since_sleep (GSTracePoint point)
+{
+        g_return_val_if_fail (point < GS_TRACE_N_POINTS, NULL);
+
+        return &since_sleep [point];
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_TRACE_H
+#define __GS_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The points along the lock path, in the order they are normally reached. */
+typedef enum {
+        GS_TRACE_PREPARE_FOR_SLEEP = 0,
+        GS_TRACE_SUSPEND,
+        GS_TRACE_LOCK_SCREEN,
+        GS_TRACE_MANAGER_ACTIVATE,
+        GS_TRACE_GRAB_ROOT,
+        GS_TRACE_WINDOWS_MAPPED,
+        GS_TRACE_DELAY_RELEASED,
+        GS_TRACE_N_POINTS
+} GSTracePoint;
+
+/* Bucket i counts the samples in [2^i, 2^(i+1)) microseconds,
+ * the last bucket also holds everything above. */
+#define GS_TRACE_N_BUCKETS 24
+
+typedef struct {
+        guint32 count;
+        guint64 sum;
+        guint64 min;
+        guint64 max;
+        guint32 buckets [GS_TRACE_N_BUCKETS];
+} GSTraceHistogram;
+
+void                    gs_trace_begin           (GSTracePoint point);
+void                    gs_trace_mark            (GSTracePoint point);
+void                    gs_trace_skip_lock       (void);
+
+const char *            gs_trace_point_name      (GSTracePoint point);
+const GSTraceHistogram *gs_trace_get_step        (GSTracePoint point);
+const GSTraceHistogram *gs_trace_get_since_sleep (GSTracePoint point);
+
+G_END_DECLS
+
+#endif /* __GS_TRACE_H */
@@ -33,6 +33,7 @@
 #include <gtk/gtkx.h>
 
 #include "gs-window.h"
+#include "gs-topology.h"
 #include "gs-marshal.h"
 #include "gs-debug.h"
 
@@ -47,6 +48,13 @@ enum {
 
 #define MAX_QUEUED_EVENTS 16
 #define INFO_BAR_SECONDS 30
+/* Raise requests within one frame are folded into a single restack. */
+#define RAISE_COALESCE_MS 16
+/* Focus is restored on FocusOut and visibility changes, this only
+ * catches whatever slipped through. */
+#define FOCUS_SAFETY_SECONDS 300
+/* The interval of the per window timer this replaced. */
+#define OLD_WATCHDOG_SECONDS 30
 
 struct _GSWindow
 {
@@ -56,11 +64,12 @@ struct _GSWindow
         GdkRectangle geometry;
         gboolean     obscured;
 
+        GSTopology  *topology;
+
         GtkWidget *drawing_area;
         GtkWidget *info_bar;
         GtkWidget *info_content;
 
-        guint      watchdog_timer_id;
         guint      info_bar_timer_id;
 
         gdouble    last_x;
@@ -77,6 +86,22 @@ G_DEFINE_TYPE (GSWindow, gs_window, GTK_TYPE_WINDOW)
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
+/* The shown lock windows, restacked together from top to bottom. */
+static GList *raise_windows = NULL;
+static guint  raise_id = 0;
+static guint  raise_requests = 0;
+static guint  raise_coalesced = 0;
+
+static GSWindow *focus_window = NULL;
+static guint     focus_id = 0;
+static guint     focus_safety_id = 0;
+static gint64    focus_since = 0;
+/* Timer wakeups, compared against the old watchdog. */
+static guint     focus_wakeups = 0;
+/* Checks on FocusOut and visibility changes, those wake us up anyway. */
+static guint     focus_checks = 0;
+static guint     focus_restored = 0;
+
 static void
 set_invisible_cursor (GdkWindow *window,
                       gboolean   invisible)
@@ -139,53 +164,24 @@ gs_window_clear (GSWindow *window)
         clear_widget (window->drawing_area);
 }
 
-static cairo_region_t *
-get_outside_region (GSWindow *window)
-{
-        int             i;
-        cairo_region_t *region;
-
-        region = cairo_region_create ();
-        for (i = 0; i < window->monitor; i++) {
-                GdkRectangle geometry;
-                cairo_rectangle_int_t rectangle;
-
-                gdk_screen_get_monitor_geometry (gtk_window_get_screen (GTK_WINDOW (window)),
-                                                 i, &geometry);
-                rectangle.x = geometry.x;
-                rectangle.y = geometry.y;
-                rectangle.width = geometry.width;
-                rectangle.height = geometry.height;
-                cairo_region_union_rectangle (region, &rectangle);
-        }
-
-        return region;
-}
-
 static void
 update_geometry (GSWindow *window)
 {
-        GdkRectangle    geometry;
-        cairo_region_t *outside_region;
-        cairo_region_t *monitor_region;
-
-        outside_region = get_outside_region (window);
+        GdkRectangle geometry;
 
-        gdk_screen_get_monitor_geometry (gtk_window_get_screen (GTK_WINDOW (window)),
-                                         window->monitor,
-                                         &geometry);
-        gs_debug ("got geometry for monitor %d: x=%d y=%d w=%d h=%d",
-                  window->monitor,
-                  geometry.x,
-                  geometry.y,
-                  geometry.width,
-                  geometry.height);
-        monitor_region = cairo_region_create_rectangle ((const cairo_rectangle_int_t *)&geometry);
-        cairo_region_subtract (monitor_region, outside_region);
-        cairo_region_destroy (outside_region);
+        if (window->topology == NULL
+            || gs_topology_get_screen (window->topology) != gtk_window_get_screen (GTK_WINDOW (window))) {
+                /* Not managed, take a snapshot of our own. */
+                if (window->topology != NULL) {
+                        gs_topology_unref (window->topology);
+                }
+                window->topology = gs_topology_new (gtk_window_get_screen (GTK_WINDOW (window)));
+        }
 
-        cairo_region_get_extents (monitor_region, (cairo_rectangle_int_t *)&geometry);
-        cairo_region_destroy (monitor_region);
+        if (! gs_topology_get_area (window->topology, window->monitor, &geometry)) {
+                gs_debug ("monitor %d is not in the topology", window->monitor);
+                return;
+        }
 
         gs_debug ("using geometry for monitor %d: x=%d y=%d w=%d h=%d",
                   window->monitor,
@@ -194,10 +190,7 @@ update_geometry (GSWindow *window)
                   geometry.width,
                   geometry.height);
 
-        window->geometry.x = geometry.x;
-        window->geometry.y = geometry.y;
-        window->geometry.width = geometry.width;
-        window->geometry.height = geometry.height;
+        window->geometry = geometry;
 }
 
 static void
@@ -273,48 +266,166 @@ gs_window_real_realize (GtkWidget *widget)
                           widget);
 }
 
-/* every so often we should raise the window in case
-   another window has somehow gotten on top */
+static gboolean x11_window_is_ours (Window window);
+
+/* Give the focus back to window unless one of our windows has it. */
+static void
+restore_focus (GSWindow *window)
+{
+        Window focus;
+        int    revert;
+
+        if (! gtk_widget_get_mapped (GTK_WIDGET (window)))
+                return;
+
+        gdk_error_trap_push ();
+        XGetInputFocus (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), &focus, &revert);
+        gdk_error_trap_pop_ignored ();
+
+        if (focus != None && focus != PointerRoot && x11_window_is_ours (focus))
+                return;
+
+        gs_debug ("Restoring focus to the screensaver window");
+
+        focus_restored++;
+        gdk_window_focus (gtk_widget_get_window (GTK_WIDGET (window)), GDK_CURRENT_TIME);
+}
+
 static gboolean
-watchdog_timer (GSWindow *window)
+focus_idle_cb (gpointer data)
 {
-        GtkWidget *widget = GTK_WIDGET (window);
+        focus_id = 0;
 
-        gdk_window_focus (gtk_widget_get_window (widget), GDK_CURRENT_TIME);
+        if (focus_window != NULL) {
+                focus_checks++;
+                restore_focus (focus_window);
+        }
 
-        return TRUE;
+        return G_SOURCE_REMOVE;
 }
 
+/* Deferred so that focus moving between our own windows settles first. */
 static void
-remove_watchdog_timer (GSWindow *window)
+queue_restore_focus (GSWindow *window)
+{
+        focus_window = window;
+
+        if (focus_id == 0)
+                focus_id = g_idle_add (focus_idle_cb, NULL);
+}
+
+static gboolean
+focus_safety_cb (gpointer data)
 {
-        if (window->watchdog_timer_id != 0) {
-                g_source_remove (window->watchdog_timer_id);
-                window->watchdog_timer_id = 0;
+        gint64 elapsed;
+        gint64 old_wakeups;
+
+        focus_wakeups++;
+
+        if (raise_windows != NULL)
+                restore_focus (GS_WINDOW (raise_windows->data));
+
+        /* What the per window watchdog would have cost over the same time. */
+        elapsed = MAX ((g_get_monotonic_time () - focus_since) / G_USEC_PER_SEC, 1);
+        old_wakeups = elapsed / OLD_WATCHDOG_SECONDS * g_list_length (raise_windows);
+
+        gs_debug ("Focus checks: %u on events, %u on the timer, restored %u times, %" G_GINT64_FORMAT " wakeups/hour saved",
+                  focus_checks, focus_wakeups, focus_restored,
+                  (old_wakeups - focus_wakeups) * 3600 / elapsed);
+
+        return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+raise_windows_cb (gpointer data)
+{
+        Window *xwindows;
+        GList  *l;
+        int     n = 0;
+
+        raise_id = 0;
+
+        xwindows = g_new (Window, g_list_length (raise_windows));
+        for (l = raise_windows; l != NULL; l = l->next) {
+                GdkWindow *win = gtk_widget_get_window (GTK_WIDGET (l->data));
+
+                if (win != NULL && gtk_widget_get_mapped (GTK_WIDGET (l->data)))
+                        xwindows [n++] = GDK_WINDOW_XID (win);
         }
+
+        if (n > 0) {
+                gs_debug ("Raising %d screensaver windows (%u requests, %u coalesced)",
+                          n, raise_requests, raise_coalesced);
+
+                /* XRestackWindows keeps the first window in place,
+                 * so put that one on top first. */
+                gdk_error_trap_push ();
+                XRaiseWindow (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), xwindows [0]);
+                if (n > 1)
+                        XRestackWindows (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), xwindows, n);
+                gdk_error_trap_pop_ignored ();
+        }
+
+        g_free (xwindows);
+
+        return G_SOURCE_REMOVE;
 }
 
 static void
-add_watchdog_timer (GSWindow *window,
-                    glong     timeout)
+gs_window_queue_raise (GSWindow *window)
 {
-        window->watchdog_timer_id = g_timeout_add_seconds (timeout,
-                                                           (GSourceFunc)watchdog_timer,
-                                                           window);
+        g_return_if_fail (GS_IS_WINDOW (window));
+
+        raise_requests++;
+
+        if (raise_id != 0) {
+                raise_coalesced++;
+                return;
+        }
+
+        raise_id = g_timeout_add (RAISE_COALESCE_MS, raise_windows_cb, NULL);
 }
 
 static void
-gs_window_raise (GSWindow *window)
+raise_windows_add (GSWindow *window)
 {
-        GdkWindow *win;
+        if (g_list_find (raise_windows, window) != NULL)
+                return;
 
-        g_return_if_fail (GS_IS_WINDOW (window));
+        raise_windows = g_list_append (raise_windows, window);
+
+        if (focus_safety_id == 0) {
+                focus_since = g_get_monotonic_time ();
+                focus_wakeups = 0;
+                focus_checks = 0;
+                focus_restored = 0;
+                focus_safety_id = g_timeout_add_seconds (FOCUS_SAFETY_SECONDS, focus_safety_cb, NULL);
+        }
+}
 
-        gs_debug ("Raising screensaver window");
+static void
+raise_windows_remove (GSWindow *window)
+{
+        raise_windows = g_list_remove (raise_windows, window);
 
-        win = gtk_widget_get_window (GTK_WIDGET (window));
+        if (focus_window == window)
+                focus_window = NULL;
 
-        gdk_window_raise (win);
+        if (raise_windows != NULL)
+                return;
+
+        if (raise_id != 0) {
+                g_source_remove (raise_id);
+                raise_id = 0;
+        }
+        if (focus_id != 0) {
+                g_source_remove (focus_id);
+                focus_id = 0;
+        }
+        if (focus_safety_id != 0) {
+                g_source_remove (focus_safety_id);
+                focus_safety_id = 0;
+        }
 }
 
 static gboolean
@@ -349,7 +460,7 @@ gs_window_xevent (GSWindow  *window,
                         XMapEvent *xme = &ev->xmap;
 
                         if (! x11_window_is_ours (xme->window)) {
-                                gs_window_raise (window);
+                                gs_window_queue_raise (window);
                         } else {
                                 gs_debug ("not raising our windows");
                         }
@@ -361,7 +472,7 @@ gs_window_xevent (GSWindow  *window,
                         XConfigureEvent *xce = &ev->xconfigure;
 
                         if (! x11_window_is_ours (xce->window)) {
-                                gs_window_raise (window);
+                                gs_window_queue_raise (window);
                         } else {
                                 gs_debug ("not raising our windows");
                         }
@@ -418,8 +529,7 @@ gs_window_real_show (GtkWidget *widget)
 
         window = GS_WINDOW (widget);
 
-        remove_watchdog_timer (window);
-        add_watchdog_timer (window, 30);
+        raise_windows_add (window);
 
         select_popup_events ();
         gdk_window_add_filter (NULL, (GdkFilterFunc)xevent_filter, window);
@@ -442,7 +552,7 @@ gs_window_real_hide (GtkWidget *widget)
 
         gdk_window_remove_filter (NULL, (GdkFilterFunc)xevent_filter, window);
 
-        remove_watchdog_timer (window);
+        raise_windows_remove (window);
 
         if (GTK_WIDGET_CLASS (gs_window_parent_class)->hide) {
                 GTK_WIDGET_CLASS (gs_window_parent_class)->hide (widget);
@@ -510,6 +620,47 @@ gs_window_set_monitor (GSWindow *window,
         g_object_notify (G_OBJECT (window), "monitor");
 }
 
+void
+gs_window_set_topology (GSWindow   *window,
+                        GSTopology *topology)
+{
+        GdkRectangle area;
+
+        g_return_if_fail (GS_IS_WINDOW (window));
+
+        if (window->topology == topology) {
+                return;
+        }
+
+        if (topology != NULL) {
+                gs_topology_ref (topology);
+        }
+        if (window->topology != NULL) {
+                gs_topology_unref (window->topology);
+        }
+        window->topology = topology;
+
+        /* Only relayout the windows that are actually affected. */
+        if (topology != NULL
+            && gs_topology_get_area (topology, window->monitor, &area)
+            && area.x == window->geometry.x
+            && area.y == window->geometry.y
+            && area.width == window->geometry.width
+            && area.height == window->geometry.height) {
+                return;
+        }
+
+        gtk_widget_queue_resize (GTK_WIDGET (window));
+}
+
+GSTopology *
+gs_window_get_topology (GSWindow *window)
+{
+        g_return_val_if_fail (GS_IS_WINDOW (window), NULL);
+
+        return window->topology;
+}
+
 int
 gs_window_get_monitor (GSWindow *window)
 {
@@ -689,6 +840,18 @@ gs_window_real_visibility_notify_event (GtkWidget          *widget,
                 break;
         }
 
+        /* Something may have come on top and taken the focus with it. */
+        queue_restore_focus (GS_WINDOW (widget));
+
+        return FALSE;
+}
+
+static gboolean
+gs_window_real_focus_out_event (GtkWidget     *widget,
+                                GdkEventFocus *event)
+{
+        queue_restore_focus (GS_WINDOW (widget));
+
         return FALSE;
 }
 
@@ -738,6 +901,7 @@ gs_window_class_init (GSWindowClass *klass)
         widget_class->get_preferred_height       = gs_window_real_get_preferred_height;
         widget_class->grab_broken_event   = gs_window_real_grab_broken;
         widget_class->visibility_notify_event = gs_window_real_visibility_notify_event;
+        widget_class->focus_out_event     = gs_window_real_focus_out_event;
 
         obj_properties[PROP_OBSCURED] =
                 g_param_spec_boolean ("obscured",
@@ -797,6 +961,7 @@ gs_window_init (GSWindow *window)
                                | GDK_KEY_RELEASE_MASK
                                | GDK_EXPOSURE_MASK
                                | GDK_VISIBILITY_NOTIFY_MASK
+                               | GDK_FOCUS_CHANGE_MASK
                                | GDK_ENTER_NOTIFY_MASK
                                | GDK_LEAVE_NOTIFY_MASK);
 
@@ -820,7 +985,11 @@ gs_window_finalize (GObject *object)
                 window->info_bar_timer_id = 0;
         }
 
-        remove_watchdog_timer (window);
+        raise_windows_remove (window);
+
+        if (window->topology != NULL) {
+                gs_topology_unref (window->topology);
+        }
 
         G_OBJECT_CLASS (gs_window_parent_class)->finalize (object);
 }
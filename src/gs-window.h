@@ -26,6 +26,8 @@
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 
+#include "gs-topology.h"
+
 G_BEGIN_DECLS
 
 #define GS_TYPE_WINDOW gs_window_get_type ()
@@ -39,6 +41,9 @@ GdkScreen * gs_window_get_screen         (GSWindow  *window);
 void        gs_window_set_monitor        (GSWindow  *window,
                                           int        monitor);
 int         gs_window_get_monitor        (GSWindow  *window);
+void        gs_window_set_topology       (GSWindow   *window,
+                                          GSTopology *topology);
+GSTopology *gs_window_get_topology       (GSWindow   *window);
 
 GSWindow  * gs_window_new                (GdkScreen *screen,
                                           int        monitor);
@@ -0,0 +1,1528 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Runs light-locker headless and measures it. Xvfb provides the
+ * monitors, a private system and session dbus-daemon the buses, and
+ * logind, UPower and LightDM are mocked here on the system bus. The
+ * lock, suspend and lid scenarios are then driven the way the real
+ * services would and the results are printed as JSON.
+ *
+ * Needs Xvfb, xrandr and dbus-daemon in the PATH, and a host with
+ * /run/systemd/seats, since only then light-locker talks to logind.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <X11/Xlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+#include "gs-bus.h"
+
+#define BENCH_SESSION_ID        "bench"
+#define BENCH_SESSION_PATH      "/org/freedesktop/login1/session/bench"
+#define BENCH_GREETER_ID        "greeter"
+#define BENCH_GREETER_PATH      "/org/freedesktop/login1/session/greeter"
+#define BENCH_SEAT_ID           "seat0"
+#define BENCH_SEAT_PATH         "/org/freedesktop/login1/seat/seat0"
+#define BENCH_DM_SEAT_PATH      "/org/freedesktop/DisplayManager/Seat0"
+#define BENCH_DM_SESSION_PATH   "/org/freedesktop/DisplayManager/Session0"
+
+#define MONITOR_WIDTH   1024
+#define MONITOR_HEIGHT  768
+
+/* How long to wait for anything light-locker is expected to do, in ms. */
+#define EVENT_TIMEOUT   5000
+#define STARTUP_TIMEOUT 10000
+/* Pause between iterations, so they don't overlap. */
+#define SETTLE_TIME     200
+
+typedef enum {
+        EVENT_READY,
+        EVENT_INHIBIT,
+        EVENT_DELAY_RELEASED,
+        EVENT_MAPPED,
+        EVENT_UNMAPPED,
+        EVENT_DM_LOCK,
+        EVENT_SWITCH_GREETER,
+        N_EVENTS
+} Event;
+
+typedef struct {
+        const char *name;
+        GArray     *samples;
+} Series;
+
+#define MAX_SERIES 4
+
+typedef struct {
+        const char *name;
+        gboolean    skipped;
+        guint       iterations;
+        guint       failed;
+        Series      series [MAX_SERIES];
+        gint64      cpu_us;
+        guint64     wakeups;
+} Scenario;
+
+typedef struct {
+        gint64  cpu_us;
+        guint64 wakeups;
+        guint64 involuntary;
+        guint64 peak_rss_kb;
+} ProcStats;
+
+static struct {
+        char            *tmpdir;
+        char            *display;
+
+        GPid             xvfb_pid;
+        GPid             system_bus_pid;
+        GPid             session_bus_pid;
+        GPid             locker_pid;
+
+        GDBusConnection *system;
+        GDBusConnection *session;
+        GDBusNodeInfo   *introspection;
+
+        Display         *xdisplay;
+        guint            x_watch;
+        GHashTable      *mapped;
+
+        /* Mock state */
+        gboolean         session_active;
+        gboolean         lid_closed;
+        guint            delays_held;
+
+        gint64           events [N_EVENTS];
+        gboolean         exited;
+        /* Set once we asked light-locker to go away. */
+        gboolean         stopping;
+        gboolean         interrupted;
+} bench;
+
+static char    *light_locker = NULL;
+static gint     n_monitors = 2;
+static gint     iterations = 20;
+static gint     idle_seconds = 10;
+static char    *output = NULL;
+static gboolean verbose = FALSE;
+static char   **extra_args = NULL;
+
+static GOptionEntry entries [] = {
+        { "light-locker", 0, 0, G_OPTION_ARG_FILENAME, &light_locker, "The light-locker to run", "PATH" },
+        { "monitors", 0, 0, G_OPTION_ARG_INT, &n_monitors, "Number of virtual monitors", "N" },
+        { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Iterations of each scenario", "N" },
+        { "idle-seconds", 0, 0, G_OPTION_ARG_INT, &idle_seconds, "Seconds to measure idle wakeups for", "S" },
+        { "output", 0, 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+        { "verbose", 0, 0, G_OPTION_ARG_NONE, &verbose, "Show the output of the programs started", NULL },
+        { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &extra_args, NULL, "[-- LIGHT-LOCKER OPTIONS]" },
+        { NULL }
+};
+
+static const char mock_xml [] =
+        "<node>\n"
+        "  <interface name=\""SYSTEMD_LOGIND_INTERFACE"\">\n"
+        "    <method name=\"GetSession\">\n"
+        "      <arg direction=\"in\" type=\"s\"/>\n"
+        "      <arg direction=\"out\" type=\"o\"/>\n"
+        "    </method>\n"
+        "    <method name=\"GetSessionByPID\">\n"
+        "      <arg direction=\"in\" type=\"u\"/>\n"
+        "      <arg direction=\"out\" type=\"o\"/>\n"
+        "    </method>\n"
+        "    <method name=\"Inhibit\">\n"
+        "      <arg name=\"what\" direction=\"in\" type=\"s\"/>\n"
+        "      <arg name=\"who\" direction=\"in\" type=\"s\"/>\n"
+        "      <arg name=\"why\" direction=\"in\" type=\"s\"/>\n"
+        "      <arg name=\"mode\" direction=\"in\" type=\"s\"/>\n"
+        "      <arg direction=\"out\" type=\"h\"/>\n"
+        "    </method>\n"
+        "    <signal name=\"PrepareForSleep\">\n"
+        "      <arg type=\"b\"/>\n"
+        "    </signal>\n"
+        "  </interface>\n"
+        "  <interface name=\""SYSTEMD_LOGIND_SESSION_INTERFACE"\">\n"
+        "    <method name=\"SetIdleHint\">\n"
+        "      <arg direction=\"in\" type=\"b\"/>\n"
+        "    </method>\n"
+        "    <signal name=\"Lock\"/>\n"
+        "    <signal name=\"Unlock\"/>\n"
+        "    <property name=\"Active\" type=\"b\" access=\"read\"/>\n"
+        "    <property name=\"Seat\" type=\"(so)\" access=\"read\"/>\n"
+        "  </interface>\n"
+        "  <interface name=\""SYSTEMD_LOGIND_SEAT_INTERFACE"\">\n"
+        "    <property name=\"ActiveSession\" type=\"(so)\" access=\"read\"/>\n"
+        "  </interface>\n"
+        "  <interface name=\""UP_INTERFACE"\">\n"
+        "    <property name=\"LidIsClosed\" type=\"b\" access=\"read\"/>\n"
+        "    <property name=\"LidIsPresent\" type=\"b\" access=\"read\"/>\n"
+        "  </interface>\n"
+        "  <interface name=\""DM_SEAT_INTERFACE"\">\n"
+        "    <method name=\"SwitchToGreeter\"/>\n"
+        "    <method name=\"Lock\"/>\n"
+        "  </interface>\n"
+        "  <interface name=\""DM_SESSION_INTERFACE"\">\n"
+        "    <method name=\"Lock\"/>\n"
+        "    <property name=\"Seat\" type=\"o\" access=\"read\"/>\n"
+        "  </interface>\n"
+        "</node>\n";
+
+static void
+bench_event (Event event)
+{
+        bench.events [event] = g_get_monotonic_time ();
+}
+
+static gboolean
+wait_timeout_cb (gboolean *timed_out)
+{
+        *timed_out = TRUE;
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Runs the main loop until event happened after it was reset, returns
+ * how long that took since start in ms, or -1 on a timeout. */
+static gdouble
+wait_for (Event  event,
+          gint64 start,
+          guint  timeout)
+{
+        gboolean timed_out = FALSE;
+        guint    id;
+
+        id = g_timeout_add (timeout, (GSourceFunc) wait_timeout_cb, &timed_out);
+
+        while (bench.events [event] == 0 && ! timed_out
+               && ! bench.exited && ! bench.interrupted)
+                g_main_context_iteration (NULL, TRUE);
+
+        if (! timed_out)
+                g_source_remove (id);
+
+        if (bench.events [event] == 0)
+                return -1;
+
+        return (bench.events [event] - start) / 1000.0;
+}
+
+static void
+bench_sleep (guint ms)
+{
+        gboolean timed_out = FALSE;
+
+        g_timeout_add (ms, (GSourceFunc) wait_timeout_cb, &timed_out);
+
+        while (! timed_out)
+                g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+reset_events (void)
+{
+        memset (bench.events, 0, sizeof (bench.events));
+}
+
+/* Mocked services */
+
+static void
+emit_signal (const char *path,
+             const char *interface,
+             const char *name,
+             GVariant   *parameters)
+{
+        GError *error = NULL;
+
+        if (! g_dbus_connection_emit_signal (bench.system, NULL, path, interface, name,
+                                             parameters, &error)) {
+                g_warning ("Unable to emit %s: %s", name, error->message);
+                g_error_free (error);
+        }
+}
+
+static void
+emit_property_changed (const char *path,
+                       const char *interface,
+                       const char *property,
+                       GVariant   *value)
+{
+        GVariantBuilder changed;
+
+        g_variant_builder_init (&changed, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add (&changed, "{sv}", property, value);
+
+        emit_signal (path, DBUS_PROPERTIES_INTERFACE, "PropertiesChanged",
+                     g_variant_new ("(sa{sv}as)", interface, &changed, NULL));
+}
+
+static GVariant *
+active_session_value (void)
+{
+        if (bench.session_active)
+                return g_variant_new ("(so)", BENCH_SESSION_ID, BENCH_SESSION_PATH);
+
+        return g_variant_new ("(so)", BENCH_GREETER_ID, BENCH_GREETER_PATH);
+}
+
+/* What LightDM does around the greeter: the seat shows another session. */
+static void
+mock_set_session_active (gboolean active)
+{
+        if (bench.session_active == active)
+                return;
+
+        bench.session_active = active;
+
+        emit_property_changed (BENCH_SEAT_PATH, SYSTEMD_LOGIND_SEAT_INTERFACE,
+                               "ActiveSession", active_session_value ());
+}
+
+static void
+mock_set_lid_closed (gboolean closed)
+{
+        bench.lid_closed = closed;
+
+        emit_property_changed (UP_PATH, UP_INTERFACE,
+                               "LidIsClosed", g_variant_new_boolean (closed));
+}
+
+static gboolean
+delay_released_cb (gint         fd,
+                   GIOCondition condition,
+                   gpointer     user_data)
+{
+        char buf [16];
+
+        /* Nothing is ever written, so this is the last writer closing. */
+        if ((condition & G_IO_IN) != 0 && read (fd, buf, sizeof (buf)) > 0)
+                return G_SOURCE_CONTINUE;
+
+        close (fd);
+
+        bench.delays_held--;
+        bench_event (EVENT_DELAY_RELEASED);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Like logind, a delay lock is the write end of a pipe,
+ * released when every copy of it was closed. */
+static void
+mock_inhibit (GVariant              *parameters,
+              GDBusMethodInvocation *invocation)
+{
+        GUnixFDList *fd_list;
+        GError      *error = NULL;
+        const char  *what, *mode;
+        int          fds [2];
+        int          index;
+
+        g_variant_get (parameters, "(&s&s&s&s)", &what, NULL, NULL, &mode);
+
+        if (strcmp (what, "sleep") != 0 || strcmp (mode, "delay") != 0) {
+                g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_NOT_SUPPORTED,
+                                                       "Only sleep delays are mocked");
+                return;
+        }
+
+        if (! g_unix_open_pipe (fds, FD_CLOEXEC, &error)) {
+                g_dbus_method_invocation_take_error (invocation, error);
+                return;
+        }
+
+        fd_list = g_unix_fd_list_new ();
+        index = g_unix_fd_list_append (fd_list, fds [1], &error);
+        close (fds [1]);
+
+        if (index < 0) {
+                close (fds [0]);
+                g_object_unref (fd_list);
+                g_dbus_method_invocation_take_error (invocation, error);
+                return;
+        }
+
+        g_unix_fd_add (fds [0], G_IO_IN | G_IO_HUP | G_IO_ERR, delay_released_cb, NULL);
+        bench.delays_held++;
+
+        g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                                 g_variant_new ("(h)", index),
+                                                                 fd_list);
+        g_object_unref (fd_list);
+
+        bench_event (EVENT_INHIBIT);
+}
+
+static void
+mock_method_call (GDBusConnection       *connection,
+                  const char            *sender,
+                  const char            *object_path,
+                  const char            *interface_name,
+                  const char            *method_name,
+                  GVariant              *parameters,
+                  GDBusMethodInvocation *invocation,
+                  gpointer               user_data)
+{
+        if (strcmp (interface_name, SYSTEMD_LOGIND_INTERFACE) == 0) {
+                if (strcmp (method_name, "Inhibit") == 0) {
+                        mock_inhibit (parameters, invocation);
+                } else {
+                        /* Every pid and session id is ours. */
+                        g_dbus_method_invocation_return_value (invocation,
+                                                               g_variant_new ("(o)", BENCH_SESSION_PATH));
+                }
+                return;
+        }
+
+        if (strcmp (interface_name, DM_SESSION_INTERFACE) == 0) {
+                /* Lock */
+                bench_event (EVENT_DM_LOCK);
+                mock_set_session_active (FALSE);
+        } else if (strcmp (interface_name, DM_SEAT_INTERFACE) == 0) {
+                if (strcmp (method_name, "SwitchToGreeter") == 0)
+                        bench_event (EVENT_SWITCH_GREETER);
+                else
+                        bench_event (EVENT_DM_LOCK);
+                mock_set_session_active (FALSE);
+        }
+
+        /* SetIdleHint is only accepted. */
+        g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static GVariant *
+mock_get_property (GDBusConnection *connection,
+                   const char      *sender,
+                   const char      *object_path,
+                   const char      *interface_name,
+                   const char      *property_name,
+                   GError         **error,
+                   gpointer         user_data)
+{
+        if (strcmp (property_name, "Active") == 0)
+                return g_variant_new_boolean (bench.session_active);
+        if (strcmp (property_name, "ActiveSession") == 0)
+                return active_session_value ();
+        if (strcmp (property_name, "LidIsClosed") == 0)
+                return g_variant_new_boolean (bench.lid_closed);
+        if (strcmp (property_name, "LidIsPresent") == 0)
+                return g_variant_new_boolean (TRUE);
+        if (strcmp (property_name, "Seat") == 0) {
+                if (strcmp (interface_name, DM_SESSION_INTERFACE) == 0)
+                        return g_variant_new_object_path (BENCH_DM_SEAT_PATH);
+                return g_variant_new ("(so)", BENCH_SEAT_ID, BENCH_SEAT_PATH);
+        }
+
+        g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                     "No property %s", property_name);
+        return NULL;
+}
+
+static const GDBusInterfaceVTable mock_vtable = {
+        mock_method_call,
+        mock_get_property,
+        NULL
+};
+
+static const struct {
+        const char *path;
+        const char *interface;
+} mock_objects [] = {
+        { SYSTEMD_LOGIND_PATH, SYSTEMD_LOGIND_INTERFACE },
+        { BENCH_SESSION_PATH, SYSTEMD_LOGIND_SESSION_INTERFACE },
+        { BENCH_SEAT_PATH, SYSTEMD_LOGIND_SEAT_INTERFACE },
+        { UP_PATH, UP_INTERFACE },
+        { BENCH_DM_SEAT_PATH, DM_SEAT_INTERFACE },
+        { BENCH_DM_SESSION_PATH, DM_SESSION_INTERFACE },
+};
+
+static const char *mock_names [] = {
+        SYSTEMD_LOGIND_SERVICE,
+        UP_SERVICE,
+        DM_SERVICE,
+};
+
+static gboolean
+mock_services_start (GError **error)
+{
+        guint i;
+
+        bench.introspection = g_dbus_node_info_new_for_xml (mock_xml, error);
+        if (bench.introspection == NULL)
+                return FALSE;
+
+        bench.session_active = TRUE;
+
+        for (i = 0; i < G_N_ELEMENTS (mock_objects); i++) {
+                GDBusInterfaceInfo *info;
+
+                info = g_dbus_node_info_lookup_interface (bench.introspection,
+                                                          mock_objects [i].interface);
+
+                if (g_dbus_connection_register_object (bench.system,
+                                                       mock_objects [i].path,
+                                                       info,
+                                                       &mock_vtable,
+                                                       NULL,
+                                                       NULL,
+                                                       error) == 0)
+                        return FALSE;
+        }
+
+        for (i = 0; i < G_N_ELEMENTS (mock_names); i++) {
+                GVariant *reply;
+
+                reply = g_dbus_connection_call_sync (bench.system,
+                                                     DBUS_SERVICE,
+                                                     DBUS_PATH,
+                                                     DBUS_INTERFACE,
+                                                     "RequestName",
+                                                     g_variant_new ("(su)", mock_names [i], 4),
+                                                     G_VARIANT_TYPE ("(u)"),
+                                                     G_DBUS_CALL_FLAGS_NONE,
+                                                     -1,
+                                                     NULL,
+                                                     error);
+                if (reply == NULL)
+                        return FALSE;
+                g_variant_unref (reply);
+        }
+
+        return TRUE;
+}
+
+/* Lock windows, seen as override redirect windows being mapped */
+
+static void
+window_mapped (Window   window,
+               gboolean mapped)
+{
+        guint before = g_hash_table_size (bench.mapped);
+
+        if (mapped)
+                g_hash_table_add (bench.mapped, GSIZE_TO_POINTER (window));
+        else
+                g_hash_table_remove (bench.mapped, GSIZE_TO_POINTER (window));
+
+        if (mapped && g_hash_table_size (bench.mapped) == (guint) n_monitors)
+                bench_event (EVENT_MAPPED);
+        else if (! mapped && before > 0 && g_hash_table_size (bench.mapped) == 0)
+                bench_event (EVENT_UNMAPPED);
+}
+
+static gboolean
+x_events_cb (gint         fd,
+             GIOCondition condition,
+             gpointer     user_data)
+{
+        while (XPending (bench.xdisplay)) {
+                XEvent event;
+
+                XNextEvent (bench.xdisplay, &event);
+
+                switch (event.type) {
+                case MapNotify:
+                        if (event.xmap.override_redirect)
+                                window_mapped (event.xmap.window, TRUE);
+                        break;
+                case UnmapNotify:
+                        window_mapped (event.xunmap.window, FALSE);
+                        break;
+                case DestroyNotify:
+                        window_mapped (event.xdestroywindow.window, FALSE);
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+x_watch_start (GError **error)
+{
+        int i;
+
+        bench.xdisplay = XOpenDisplay (bench.display);
+        if (bench.xdisplay == NULL) {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Unable to open display %s", bench.display);
+                return FALSE;
+        }
+
+        for (i = 0; i < ScreenCount (bench.xdisplay); i++)
+                XSelectInput (bench.xdisplay, RootWindow (bench.xdisplay, i), SubstructureNotifyMask);
+        XFlush (bench.xdisplay);
+
+        bench.mapped = g_hash_table_new (NULL, NULL);
+        bench.x_watch = g_unix_fd_add (ConnectionNumber (bench.xdisplay), G_IO_IN, x_events_cb, NULL);
+
+        return TRUE;
+}
+
+/* Processes */
+
+static gboolean
+read_line (int      fd,
+           char   **line,
+           GError **error)
+{
+        GString      *str = g_string_new (NULL);
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        for (;;) {
+                char c;
+                int  res;
+
+                res = poll (&pfd, 1, STARTUP_TIMEOUT);
+                if (res < 0 && errno == EINTR)
+                        continue;
+                if (res <= 0 || read (fd, &c, 1) != 1) {
+                        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                     "No output from the process");
+                        g_string_free (str, TRUE);
+                        return FALSE;
+                }
+
+                if (c == '\n')
+                        break;
+                g_string_append_c (str, c);
+        }
+
+        *line = g_string_free (str, FALSE);
+
+        return TRUE;
+}
+
+/* Starts argv and returns the first line it writes to stdout. */
+static gboolean
+spawn_with_line (char   **argv,
+                 char   **envp,
+                 GPid    *pid,
+                 char   **line,
+                 GError **error)
+{
+        GSpawnFlags flags = G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD;
+        int         out;
+        gboolean    res;
+
+        if (! verbose)
+                flags |= G_SPAWN_STDERR_TO_DEV_NULL;
+
+        if (! g_spawn_async_with_pipes (NULL, argv, envp, flags, NULL, NULL,
+                                        pid, NULL, &out, NULL, error))
+                return FALSE;
+
+        res = read_line (out, line, error);
+        close (out);
+
+        if (! res) {
+                kill (*pid, SIGKILL);
+                waitpid (*pid, NULL, 0);
+                g_spawn_close_pid (*pid);
+                *pid = 0;
+        }
+
+        return res;
+}
+
+static void
+process_stop (GPid *pid)
+{
+        if (*pid == 0)
+                return;
+
+        kill (*pid, SIGTERM);
+        waitpid (*pid, NULL, 0);
+        g_spawn_close_pid (*pid);
+        *pid = 0;
+}
+
+static gboolean
+xvfb_start (GError **error)
+{
+        char     *geometry;
+        char     *number = NULL;
+        gboolean  res;
+        int       i;
+
+        geometry = g_strdup_printf ("%dx%dx24", MONITOR_WIDTH * n_monitors, MONITOR_HEIGHT);
+
+        {
+                char *argv [] = { "Xvfb", "-displayfd", "1", "-nolisten", "tcp",
+                                  "-screen", "0", geometry, NULL };
+
+                res = spawn_with_line (argv, NULL, &bench.xvfb_pid, &number, error);
+        }
+        g_free (geometry);
+
+        if (! res)
+                return FALSE;
+
+        bench.display = g_strdup_printf (":%s", number);
+        g_free (number);
+
+        if (n_monitors == 1)
+                return TRUE;
+
+        /* Xvfb has a single output, the monitors are added on top of it. */
+        for (i = 0; i < n_monitors; i++) {
+                char *name, *area;
+                int   status;
+
+                name = g_strdup_printf ("bench%d", i);
+                area = g_strdup_printf ("%d/271x%d/203+%d+0", MONITOR_WIDTH, MONITOR_HEIGHT,
+                                        MONITOR_WIDTH * i);
+
+                {
+                        char *argv [] = { "xrandr", "-display", bench.display,
+                                          "--setmonitor", name, area,
+                                          i == 0 ? "screen" : "none", NULL };
+
+                        res = g_spawn_sync (NULL, argv, NULL,
+                                            G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                                            NULL, NULL, NULL, NULL, &status, error)
+                              && g_spawn_check_exit_status (status, error);
+                }
+
+                g_free (name);
+                g_free (area);
+
+                if (! res)
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+static char *
+bus_config_write (const char *type,
+                  GError    **error)
+{
+        char *path, *config;
+
+        path = g_build_filename (bench.tmpdir, type, NULL);
+        config = g_strdup_printf ("<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\"\n"
+                                  " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+                                  "<busconfig>\n"
+                                  "  <type>%s</type>\n"
+                                  "  <listen>unix:dir=%s</listen>\n"
+                                  "  <auth>EXTERNAL</auth>\n"
+                                  "  <policy context=\"default\">\n"
+                                  "    <allow user=\"*\"/>\n"
+                                  "    <allow own=\"*\"/>\n"
+                                  "    <allow send_destination=\"*\"/>\n"
+                                  "    <allow receive_sender=\"*\"/>\n"
+                                  "  </policy>\n"
+                                  "</busconfig>\n",
+                                  type, bench.tmpdir);
+
+        if (! g_file_set_contents (path, config, -1, error))
+                g_clear_pointer (&path, g_free);
+
+        g_free (config);
+
+        return path;
+}
+
+static GDBusConnection *
+bus_start (const char *type,
+           GPid       *pid,
+           GError    **error)
+{
+        GDBusConnection *connection;
+        char            *config, *option, *address = NULL;
+        gboolean         res;
+
+        config = bus_config_write (type, error);
+        if (config == NULL)
+                return NULL;
+
+        option = g_strdup_printf ("--config-file=%s", config);
+
+        {
+                char *argv [] = { "dbus-daemon", option, "--nofork", "--print-address=1", NULL };
+
+                res = spawn_with_line (argv, NULL, pid, &address, error);
+        }
+
+        g_free (option);
+        g_free (config);
+
+        if (! res)
+                return NULL;
+
+        connection = g_dbus_connection_new_for_address_sync (address,
+                                                             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+                                                             | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                             NULL, NULL, error);
+        if (connection != NULL)
+                g_object_set_data_full (G_OBJECT (connection), "address", address, g_free);
+        else
+                g_free (address);
+
+        return connection;
+}
+
+static void
+locker_exited_cb (GPid     pid,
+                  gint     status,
+                  gpointer user_data)
+{
+        if (! bench.interrupted && ! bench.stopping)
+                g_printerr ("light-locker exited unexpectedly\n");
+
+        bench.exited = TRUE;
+        g_spawn_close_pid (pid);
+        bench.locker_pid = 0;
+}
+
+static void
+locker_name_appeared_cb (GDBusConnection *connection,
+                         const char      *name,
+                         const char      *owner,
+                         gpointer         user_data)
+{
+        bench_event (EVENT_READY);
+}
+
+static gboolean
+locker_start (gdouble *startup,
+              GError **error)
+{
+        GPtrArray *argv;
+        char     **envp;
+        gint64     start;
+        guint      watch;
+        guint      i;
+
+        envp = g_get_environ ();
+        envp = g_environ_setenv (envp, "DISPLAY", bench.display, TRUE);
+        envp = g_environ_setenv (envp, "DBUS_SESSION_BUS_ADDRESS",
+                                 g_object_get_data (G_OBJECT (bench.session), "address"), TRUE);
+        envp = g_environ_setenv (envp, "DBUS_SYSTEM_BUS_ADDRESS",
+                                 g_object_get_data (G_OBJECT (bench.system), "address"), TRUE);
+        envp = g_environ_setenv (envp, "XDG_SESSION_PATH", BENCH_DM_SESSION_PATH, TRUE);
+        envp = g_environ_setenv (envp, "XDG_SEAT_PATH", BENCH_DM_SEAT_PATH, TRUE);
+        envp = g_environ_setenv (envp, "XDG_SESSION_ID", BENCH_SESSION_ID, TRUE);
+        /* Leave the settings of the user alone. */
+        envp = g_environ_setenv (envp, "GSETTINGS_BACKEND", "memory", TRUE);
+
+        argv = g_ptr_array_new ();
+        g_ptr_array_add (argv, light_locker);
+        g_ptr_array_add (argv, "--lock-on-suspend");
+        g_ptr_array_add (argv, "--lock-on-lid");
+        g_ptr_array_add (argv, "--no-late-locking");
+        for (i = 0; extra_args != NULL && extra_args [i] != NULL; i++)
+                g_ptr_array_add (argv, extra_args [i]);
+        g_ptr_array_add (argv, NULL);
+
+        watch = g_bus_watch_name_on_connection (bench.session, GS_SERVICE,
+                                                G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                locker_name_appeared_cb,
+                                                NULL, NULL, NULL);
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        if (! g_spawn_async (NULL, (char **) argv->pdata, envp,
+                             G_SPAWN_DO_NOT_REAP_CHILD
+                             | (verbose ? 0 : G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL),
+                             NULL, NULL, &bench.locker_pid, error)) {
+                g_bus_unwatch_name (watch);
+                g_ptr_array_free (argv, TRUE);
+                g_strfreev (envp);
+                return FALSE;
+        }
+
+        g_child_watch_add (bench.locker_pid, locker_exited_cb, NULL);
+
+        *startup = wait_for (EVENT_READY, start, STARTUP_TIMEOUT);
+
+        g_bus_unwatch_name (watch);
+        g_ptr_array_free (argv, FALSE);
+        g_strfreev (envp);
+
+        if (*startup < 0) {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "light-locker didn't show up on the session bus");
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+locker_stop (void)
+{
+        if (bench.locker_pid == 0)
+                return;
+
+        bench.stopping = TRUE;
+        kill (bench.locker_pid, SIGTERM);
+
+        {
+                gboolean timed_out = FALSE;
+                guint    id = g_timeout_add (EVENT_TIMEOUT, (GSourceFunc) wait_timeout_cb, &timed_out);
+
+                while (! bench.exited && ! timed_out)
+                        g_main_context_iteration (NULL, TRUE);
+
+                if (! timed_out)
+                        g_source_remove (id);
+        }
+
+        if (! bench.exited) {
+                kill (bench.locker_pid, SIGKILL);
+                while (! bench.exited)
+                        g_main_context_iteration (NULL, TRUE);
+        }
+}
+
+/* Resource usage from /proc, summed over the threads */
+
+static guint64
+status_field (const char *status,
+              const char *name)
+{
+        const char *p;
+
+        p = strstr (status, name);
+        if (p == NULL)
+                return 0;
+
+        return g_ascii_strtoull (p + strlen (name), NULL, 10);
+}
+
+static gboolean
+proc_stats_read (GPid       pid,
+                 ProcStats *stats)
+{
+        char        *path, *contents;
+        const char  *p;
+        char       **fields;
+        GDir        *dir;
+        const char  *task;
+        gboolean     res = FALSE;
+
+        memset (stats, 0, sizeof (ProcStats));
+
+        if (pid == 0)
+                return FALSE;
+
+        path = g_strdup_printf ("/proc/%d/stat", pid);
+        if (g_file_get_contents (path, &contents, NULL, NULL)) {
+                /* The name may contain spaces, the fields start after it. */
+                p = strrchr (contents, ')');
+                if (p != NULL) {
+                        fields = g_strsplit (p + 2, " ", 0);
+                        if (g_strv_length (fields) > 12) {
+                                guint64 ticks;
+
+                                ticks = g_ascii_strtoull (fields [11], NULL, 10)
+                                        + g_ascii_strtoull (fields [12], NULL, 10);
+                                stats->cpu_us = ticks * G_USEC_PER_SEC / sysconf (_SC_CLK_TCK);
+                                res = TRUE;
+                        }
+                        g_strfreev (fields);
+                }
+                g_free (contents);
+        }
+        g_free (path);
+
+        path = g_strdup_printf ("/proc/%d/status", pid);
+        if (g_file_get_contents (path, &contents, NULL, NULL)) {
+                stats->peak_rss_kb = status_field (contents, "VmHWM:");
+                g_free (contents);
+        }
+        g_free (path);
+
+        /* Every voluntary switch is the thread going to sleep, and
+         * so one wakeup. */
+        path = g_strdup_printf ("/proc/%d/task", pid);
+        dir = g_dir_open (path, 0, NULL);
+        g_free (path);
+
+        while (dir != NULL && (task = g_dir_read_name (dir)) != NULL) {
+                path = g_strdup_printf ("/proc/%d/task/%s/status", pid, task);
+                if (g_file_get_contents (path, &contents, NULL, NULL)) {
+                        stats->wakeups += status_field (contents, "\nvoluntary_ctxt_switches:");
+                        stats->involuntary += status_field (contents, "nonvoluntary_ctxt_switches:");
+                        g_free (contents);
+                }
+                g_free (path);
+        }
+
+        if (dir != NULL)
+                g_dir_close (dir);
+
+        return res;
+}
+
+/* Scenarios */
+
+static Scenario *
+scenario_new (const char *name,
+              ...)
+{
+        Scenario   *scenario;
+        va_list     args;
+        const char *series;
+        guint       i = 0;
+
+        scenario = g_new0 (Scenario, 1);
+        scenario->name = name;
+
+        va_start (args, name);
+        while ((series = va_arg (args, const char *)) != NULL && i < MAX_SERIES) {
+                scenario->series [i].name = series;
+                scenario->series [i].samples = g_array_new (FALSE, FALSE, sizeof (gdouble));
+                i++;
+        }
+        va_end (args);
+
+        return scenario;
+}
+
+static void
+scenario_free (Scenario *scenario)
+{
+        guint i;
+
+        for (i = 0; i < MAX_SERIES && scenario->series [i].name != NULL; i++)
+                g_array_free (scenario->series [i].samples, TRUE);
+
+        g_free (scenario);
+}
+
+/* Adds a sample to the named series, FALSE if it timed out. */
+static gboolean
+scenario_add (Scenario   *scenario,
+              const char *series,
+              gdouble     ms)
+{
+        guint i;
+
+        if (ms < 0)
+                return FALSE;
+
+        for (i = 0; i < MAX_SERIES && scenario->series [i].name != NULL; i++) {
+                if (strcmp (scenario->series [i].name, series) == 0) {
+                        g_array_append_val (scenario->series [i].samples, ms);
+                        break;
+                }
+        }
+
+        return TRUE;
+}
+
+/* What the greeter does on a successful login. */
+static gboolean
+unlock (Scenario *scenario)
+{
+        gint64 start;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        mock_set_session_active (TRUE);
+        emit_signal (BENCH_SESSION_PATH, SYSTEMD_LOGIND_SESSION_INTERFACE, "Unlock", NULL);
+
+        if (! scenario_add (scenario, "unlock_ms", wait_for (EVENT_UNMAPPED, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        /* A new delay is taken once unlocked. */
+        if (bench.delays_held == 0)
+                wait_for (EVENT_INHIBIT, start, EVENT_TIMEOUT);
+
+        return TRUE;
+}
+
+static gboolean
+lock_iteration (Scenario *scenario)
+{
+        gint64 start;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        g_dbus_connection_call (bench.session, GS_SERVICE, GS_PATH, GS_INTERFACE, "Lock",
+                                NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+
+        if (! scenario_add (scenario, "lock_ms", wait_for (EVENT_MAPPED, start, EVENT_TIMEOUT)))
+                return FALSE;
+        if (! scenario_add (scenario, "greeter_ms", wait_for (EVENT_DM_LOCK, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        return unlock (scenario);
+}
+
+static gboolean
+suspend_iteration (Scenario *scenario)
+{
+        gint64 start;
+
+        if (bench.delays_held == 0)
+                return FALSE;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        emit_signal (SYSTEMD_LOGIND_PATH, SYSTEMD_LOGIND_INTERFACE, "PrepareForSleep",
+                     g_variant_new ("(b)", TRUE));
+
+        if (! scenario_add (scenario, "delay_released_ms", wait_for (EVENT_DELAY_RELEASED, start, EVENT_TIMEOUT)))
+                return FALSE;
+        if (! scenario_add (scenario, "lock_ms", wait_for (EVENT_MAPPED, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        emit_signal (SYSTEMD_LOGIND_PATH, SYSTEMD_LOGIND_INTERFACE, "PrepareForSleep",
+                     g_variant_new ("(b)", FALSE));
+
+        if (! scenario_add (scenario, "greeter_ms", wait_for (EVENT_SWITCH_GREETER, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        return unlock (scenario);
+}
+
+static gboolean
+lid_iteration (Scenario *scenario)
+{
+        gint64 start;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        mock_set_lid_closed (TRUE);
+
+        if (! scenario_add (scenario, "lock_ms", wait_for (EVENT_MAPPED, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        reset_events ();
+        start = g_get_monotonic_time ();
+
+        mock_set_lid_closed (FALSE);
+
+        if (! scenario_add (scenario, "greeter_ms", wait_for (EVENT_SWITCH_GREETER, start, EVENT_TIMEOUT)))
+                return FALSE;
+
+        return unlock (scenario);
+}
+
+/* Puts things back after a failed iteration. */
+static void
+recover (void)
+{
+        Scenario *scratch = scenario_new ("recover", "unlock_ms", NULL);
+
+        if (bench.lid_closed)
+                mock_set_lid_closed (FALSE);
+
+        bench_sleep (EVENT_TIMEOUT);
+        if (g_hash_table_size (bench.mapped) > 0 || ! bench.session_active)
+                unlock (scratch);
+
+        scenario_free (scratch);
+}
+
+static void
+scenario_run (Scenario *scenario,
+              gboolean (*iteration) (Scenario *scenario))
+{
+        ProcStats before, after;
+        gint      i;
+
+        proc_stats_read (bench.locker_pid, &before);
+
+        for (i = 0; i < iterations && ! bench.exited && ! bench.interrupted; i++) {
+                scenario->iterations++;
+
+                if (! iteration (scenario)) {
+                        scenario->failed++;
+                        recover ();
+                }
+
+                bench_sleep (SETTLE_TIME);
+        }
+
+        proc_stats_read (bench.locker_pid, &after);
+
+        scenario->cpu_us = after.cpu_us - before.cpu_us;
+        scenario->wakeups = after.wakeups - before.wakeups;
+}
+
+typedef struct {
+        gdouble seconds;
+        gint64  cpu_us;
+        guint64 wakeups;
+} Idle;
+
+static void
+idle_measure (Idle *idle)
+{
+        ProcStats before, after;
+        gint64    start;
+
+        proc_stats_read (bench.locker_pid, &before);
+        start = g_get_monotonic_time ();
+
+        bench_sleep (idle_seconds * 1000);
+
+        proc_stats_read (bench.locker_pid, &after);
+
+        idle->seconds = (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+        idle->cpu_us = after.cpu_us - before.cpu_us;
+        idle->wakeups = after.wakeups - before.wakeups;
+}
+
+/* JSON output */
+
+static void
+json_double (GString *json,
+             gdouble  value)
+{
+        char buf [G_ASCII_DTOSTR_BUF_SIZE];
+
+        g_string_append (json, g_ascii_formatd (buf, sizeof (buf), "%.3f", value));
+}
+
+static void
+json_string (GString    *json,
+             const char *value)
+{
+        const char *p;
+
+        g_string_append_c (json, '"');
+        for (p = value; *p != '\0'; p++) {
+                if (*p == '"' || *p == '\\')
+                        g_string_append_printf (json, "\\%c", *p);
+                else if ((guchar) *p < 0x20)
+                        g_string_append_printf (json, "\\u%04x", *p);
+                else
+                        g_string_append_c (json, *p);
+        }
+        g_string_append_c (json, '"');
+}
+
+static int
+compare_double (gconstpointer a,
+                gconstpointer b)
+{
+        gdouble x = *(const gdouble *) a;
+        gdouble y = *(const gdouble *) b;
+
+        return (x > y) - (x < y);
+}
+
+/* Nearest rank, the samples are sorted. */
+static gdouble
+percentile (GArray *samples,
+            guint   p)
+{
+        guint rank;
+
+        rank = (p * samples->len + 99) / 100;
+        rank = CLAMP (rank, 1, samples->len);
+
+        return g_array_index (samples, gdouble, rank - 1);
+}
+
+static void
+json_series (GString *json,
+             Series  *series)
+{
+        static const guint percentiles [] = { 50, 90, 99 };
+        gdouble sum = 0;
+        guint   i;
+
+        json_string (json, series->name);
+        g_string_append (json, ": ");
+
+        if (series->samples->len == 0) {
+                g_string_append (json, "null");
+                return;
+        }
+
+        g_array_sort (series->samples, compare_double);
+        for (i = 0; i < series->samples->len; i++)
+                sum += g_array_index (series->samples, gdouble, i);
+
+        g_string_append_printf (json, "{ \"samples\": %u, \"min\": ", series->samples->len);
+        json_double (json, g_array_index (series->samples, gdouble, 0));
+        for (i = 0; i < G_N_ELEMENTS (percentiles); i++) {
+                g_string_append_printf (json, ", \"p%u\": ", percentiles [i]);
+                json_double (json, percentile (series->samples, percentiles [i]));
+        }
+        g_string_append (json, ", \"max\": ");
+        json_double (json, g_array_index (series->samples, gdouble, series->samples->len - 1));
+        g_string_append (json, ", \"mean\": ");
+        json_double (json, sum / series->samples->len);
+        g_string_append (json, " }");
+}
+
+static void
+json_scenario (GString  *json,
+               Scenario *scenario)
+{
+        guint i;
+
+        g_string_append (json, "    ");
+        json_string (json, scenario->name);
+
+        if (scenario->skipped) {
+                g_string_append (json, ": { \"skipped\": true }");
+                return;
+        }
+
+        g_string_append_printf (json, ": {\n      \"iterations\": %u,\n      \"failed\": %u,\n",
+                                scenario->iterations, scenario->failed);
+
+        for (i = 0; i < MAX_SERIES && scenario->series [i].name != NULL; i++) {
+                g_string_append (json, "      ");
+                json_series (json, &scenario->series [i]);
+                g_string_append (json, ",\n");
+        }
+
+        g_string_append (json, "      \"cpu_ms\": ");
+        json_double (json, scenario->cpu_us / 1000.0);
+        g_string_append_printf (json, ",\n      \"wakeups\": %" G_GUINT64_FORMAT "\n    }",
+                                scenario->wakeups);
+}
+
+static void
+json_idle (GString    *json,
+           const char *name,
+           Idle       *idle)
+{
+        g_string_append (json, "    ");
+        json_string (json, name);
+        g_string_append (json, ": { \"seconds\": ");
+        json_double (json, idle->seconds);
+        g_string_append (json, ", \"cpu_ms\": ");
+        json_double (json, idle->cpu_us / 1000.0);
+        g_string_append (json, ", \"wakeups_per_second\": ");
+        json_double (json, idle->seconds > 0 ? idle->wakeups / idle->seconds : 0);
+        g_string_append (json, " }");
+}
+
+static gboolean
+interrupted_cb (gpointer user_data)
+{
+        bench.interrupted = TRUE;
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+cleanup (void)
+{
+        char *path;
+
+        locker_stop ();
+
+        if (bench.x_watch != 0)
+                g_source_remove (bench.x_watch);
+        if (bench.xdisplay != NULL)
+                XCloseDisplay (bench.xdisplay);
+        g_clear_pointer (&bench.mapped, g_hash_table_destroy);
+
+        g_clear_object (&bench.session);
+        g_clear_object (&bench.system);
+        g_clear_pointer (&bench.introspection, g_dbus_node_info_unref);
+
+        process_stop (&bench.session_bus_pid);
+        process_stop (&bench.system_bus_pid);
+        process_stop (&bench.xvfb_pid);
+
+        if (bench.tmpdir != NULL) {
+                path = g_build_filename (bench.tmpdir, "system", NULL);
+                g_remove (path);
+                g_free (path);
+                path = g_build_filename (bench.tmpdir, "session", NULL);
+                g_remove (path);
+                g_free (path);
+                g_rmdir (bench.tmpdir);
+                g_clear_pointer (&bench.tmpdir, g_free);
+        }
+
+        g_clear_pointer (&bench.display, g_free);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        GOptionContext *context;
+        GError         *error = NULL;
+        Scenario       *scenarios [3];
+        Idle            idle_unlocked = { 0 }, idle_locked = { 0 };
+        ProcStats       stats;
+        GString        *json;
+        gdouble         startup = -1;
+        gboolean        ok = FALSE;
+        guint           i;
+
+        context = g_option_context_new (NULL);
+        g_option_context_set_summary (context,
+                                      "Runs light-locker against Xvfb and mocked system services\n"
+                                      "and prints lock latency and resource use as JSON.");
+        g_option_context_add_main_entries (context, entries, NULL);
+        if (! g_option_context_parse (context, &argc, &argv, &error)) {
+                g_printerr ("%s\n", error->message);
+                g_error_free (error);
+                return EXIT_FAILURE;
+        }
+        g_option_context_free (context);
+
+        if (n_monitors < 1 || iterations < 1 || idle_seconds < 0) {
+                g_printerr ("Invalid number of monitors, iterations or idle seconds\n");
+                return EXIT_FAILURE;
+        }
+
+        if (light_locker == NULL) {
+                char *dir = g_path_get_dirname (argv [0]);
+
+                light_locker = g_build_filename (dir, "light-locker", NULL);
+                g_free (dir);
+        }
+
+        /* light-locker itself only uses logind when it finds it. */
+        if (access ("/run/systemd/seats/", F_OK) < 0) {
+                g_printerr ("/run/systemd/seats not found, light-locker won't use the logind mock\n");
+                return EXIT_FAILURE;
+        }
+
+        g_unix_signal_add (SIGINT, interrupted_cb, NULL);
+        g_unix_signal_add (SIGTERM, interrupted_cb, NULL);
+
+        scenarios [0] = scenario_new ("lock", "lock_ms", "greeter_ms", "unlock_ms", NULL);
+        scenarios [1] = scenario_new ("suspend", "delay_released_ms", "lock_ms", "greeter_ms", "unlock_ms", NULL);
+        scenarios [2] = scenario_new ("lid", "lock_ms", "greeter_ms", "unlock_ms", NULL);
+
+        bench.tmpdir = g_dir_make_tmp ("light-locker-bench-XXXXXX", &error);
+        if (bench.tmpdir == NULL)
+                goto out;
+
+        if (! xvfb_start (&error) || ! x_watch_start (&error))
+                goto out;
+
+        bench.system = bus_start ("system", &bench.system_bus_pid, &error);
+        if (bench.system == NULL)
+                goto out;
+        bench.session = bus_start ("session", &bench.session_bus_pid, &error);
+        if (bench.session == NULL)
+                goto out;
+
+        if (! mock_services_start (&error) || ! locker_start (&startup, &error))
+                goto out;
+
+        /* The suspend delay is taken at startup. */
+        if (bench.delays_held == 0)
+                wait_for (EVENT_INHIBIT, 0, EVENT_TIMEOUT);
+        bench_sleep (SETTLE_TIME);
+
+        idle_measure (&idle_unlocked);
+
+        scenario_run (scenarios [0], lock_iteration);
+        if (bench.delays_held > 0)
+                scenario_run (scenarios [1], suspend_iteration);
+        else
+                scenarios [1]->skipped = TRUE;
+        scenario_run (scenarios [2], lid_iteration);
+
+        /* Idle while locked, what a machine left alone does most. */
+        if (! bench.exited && ! bench.interrupted) {
+                Scenario *scratch = scenario_new ("idle", "lock_ms", "greeter_ms", "unlock_ms", NULL);
+                gint64    start;
+
+                reset_events ();
+                start = g_get_monotonic_time ();
+                g_dbus_connection_call (bench.session, GS_SERVICE, GS_PATH, GS_INTERFACE, "Lock",
+                                        NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+                wait_for (EVENT_DM_LOCK, start, EVENT_TIMEOUT);
+
+                idle_measure (&idle_locked);
+
+                unlock (scratch);
+                scenario_free (scratch);
+        }
+
+        proc_stats_read (bench.locker_pid, &stats);
+
+        ok = ! bench.exited && ! bench.interrupted;
+
+        json = g_string_new ("{\n  \"light_locker\": ");
+        json_string (json, light_locker);
+        g_string_append_printf (json, ",\n  \"monitors\": %d,\n  \"iterations\": %d,\n  \"startup_ms\": ",
+                                n_monitors, iterations);
+        json_double (json, startup);
+        g_string_append (json, ",\n  \"scenarios\": {\n");
+        for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+                json_scenario (json, scenarios [i]);
+                g_string_append (json, i + 1 < G_N_ELEMENTS (scenarios) ? ",\n" : "\n");
+        }
+        g_string_append (json, "  },\n  \"idle\": {\n");
+        json_idle (json, "unlocked", &idle_unlocked);
+        g_string_append (json, ",\n");
+        json_idle (json, "locked", &idle_locked);
+        g_string_append_printf (json, "\n  },\n  \"peak_rss_kb\": %" G_GUINT64_FORMAT ",\n"
+                                "  \"crashed\": %s\n}\n",
+                                stats.peak_rss_kb, bench.exited ? "true" : "false");
+
+        if (output != NULL) {
+                if (! g_file_set_contents (output, json->str, json->len, &error))
+                        ok = FALSE;
+        } else {
+                g_print ("%s", json->str);
+        }
+
+        g_string_free (json, TRUE);
+
+ out:
+        if (error != NULL) {
+                g_printerr ("%s\n", error->message);
+                g_error_free (error);
+        }
+
+        cleanup ();
+
+        for (i = 0; i < G_N_ELEMENTS (scenarios); i++)
+                scenario_free (scenarios [i]);
+
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
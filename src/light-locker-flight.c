@@ -0,0 +1,237 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Prints a flight recorder dump written by light-locker, see gs-flight.h. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gs-flight.h"
+
+typedef struct {
+        const guchar *data;
+        gsize         len;
+        gsize         pos;
+} Reader;
+
+static const void *
+reader_take (Reader *reader,
+             gsize   len)
+{
+        const void *p;
+
+        if (reader->len - reader->pos < len)
+                return NULL;
+
+        p = reader->data + reader->pos;
+        reader->pos += len;
+
+        return p;
+}
+
+/* Formats the arguments the way gs_debug would have. */
+static void
+format_entry (GString       *out,
+              const char    *format,
+              gsize          format_len,
+              const guint64 *args,
+              guint          n_args,
+              const char    *chars,
+              gsize          chars_len)
+{
+        const char *p = format;
+        const char *end = format + format_len;
+        guint       n = 0;
+
+        while (p < end) {
+                GString *spec;
+                char     conv;
+
+                if (*p != '%') {
+                        g_string_append_c (out, *p++);
+                        continue;
+                }
+
+                if (p + 1 < end && p [1] == '%') {
+                        g_string_append_c (out, '%');
+                        p += 2;
+                        continue;
+                }
+
+                /* Flags, width and precision are kept, the length is
+                 * replaced since every argument was stored as 64 bits. */
+                spec = g_string_new ("%");
+                p++;
+                while (p < end && strchr ("-+ #0123456789.", *p) != NULL)
+                        g_string_append_c (spec, *p++);
+                while (p < end && strchr ("hlqjzt", *p) != NULL)
+                        p++;
+
+                if (p == end || n >= n_args) {
+                        /* Not recorded, show the rest as it is. */
+                        g_string_append (out, spec->str);
+                        g_string_append_len (out, p, end - p);
+                        g_string_free (spec, TRUE);
+                        return;
+                }
+
+                conv = *p++;
+
+                switch (conv) {
+                case 'd':
+                case 'i':
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                        g_string_append (spec, G_GINT64_MODIFIER);
+                        g_string_append_c (spec, conv);
+                        g_string_append_printf (out, spec->str, args [n]);
+                        break;
+                case 'c':
+                        g_string_append_c (out, (char) args [n]);
+                        break;
+                case 'e':
+                case 'E':
+                case 'f':
+                case 'F':
+                case 'g':
+                case 'G':
+                        {
+                                double value;
+
+                                memcpy (&value, &args [n], sizeof (value));
+                                g_string_append_c (spec, conv);
+                                g_string_append_printf (out, spec->str, value);
+                        }
+                        break;
+                case 'p':
+                        g_string_append_printf (out, "0x%" G_GINT64_MODIFIER "x", args [n]);
+                        break;
+                case 's':
+                        {
+                                gsize offset = args [n] >> 16;
+                                gsize len = args [n] & 0xffff;
+
+                                if (offset + len <= chars_len)
+                                        g_string_append_len (out, chars + offset, len);
+                                else
+                                        g_string_append (out, "(?)");
+                        }
+                        break;
+                default:
+                        g_string_append (out, spec->str);
+                        g_string_append_c (out, conv);
+                        break;
+                }
+
+                g_string_free (spec, TRUE);
+                n++;
+        }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        GError               *error = NULL;
+        gchar                *contents;
+        gsize                 length;
+        Reader                reader;
+        const GSFlightHeader *header;
+        GString              *line;
+        guint64               first = 0;
+        guint                 i;
+
+        if (argc != 2) {
+                g_printerr ("Usage: %s FILE\n", argv [0]);
+                return EXIT_FAILURE;
+        }
+
+        if (! g_file_get_contents (argv [1], &contents, &length, &error)) {
+                g_printerr ("%s\n", error->message);
+                g_error_free (error);
+                return EXIT_FAILURE;
+        }
+
+        reader.data = (const guchar *) contents;
+        reader.len = length;
+        reader.pos = 0;
+
+        header = reader_take (&reader, sizeof (GSFlightHeader));
+        if (header == NULL
+            || header->magic != GS_FLIGHT_MAGIC
+            || header->version != GS_FLIGHT_VERSION) {
+                g_printerr ("%s: not a light-locker flight recorder dump\n", argv [1]);
+                g_free (contents);
+                return EXIT_FAILURE;
+        }
+
+        g_print ("%u records, %u older ones dropped\n", header->n_records, header->dropped);
+
+        line = g_string_new (NULL);
+
+        for (i = 0; i < header->n_records; i++) {
+                GSFlightEntry  entry;
+                const void    *p;
+                guint64        args [GS_FLIGHT_ARGS];
+                const char    *func, *format, *chars;
+
+                /* The entries are packed, copy out to get them aligned. */
+                if ((p = reader_take (&reader, sizeof (entry))) == NULL)
+                        break;
+                memcpy (&entry, p, sizeof (entry));
+
+                if (entry.n_args > GS_FLIGHT_ARGS
+                    || (p = reader_take (&reader, entry.n_args * sizeof (guint64))) == NULL)
+                        break;
+                memcpy (args, p, entry.n_args * sizeof (guint64));
+
+                if ((func = reader_take (&reader, entry.func_len)) == NULL
+                    || (format = reader_take (&reader, entry.format_len)) == NULL
+                    || (chars = reader_take (&reader, entry.chars_len)) == NULL)
+                        break;
+
+                if (i == 0)
+                        first = entry.time;
+
+                g_string_truncate (line, 0);
+                format_entry (line, format, entry.format_len,
+                              args, entry.n_args,
+                              chars, entry.chars_len);
+
+                g_print ("%8u +%.6f [%.*s] %u:\t %s\n",
+                         entry.seq,
+                         (entry.time - first) / (double) G_USEC_PER_SEC,
+                         (int) entry.func_len, func,
+                         entry.line,
+                         line->str);
+        }
+
+        if (i < header->n_records)
+                g_printerr ("%s: truncated after %u records\n", argv [1], i);
+
+        g_string_free (line, TRUE);
+        g_free (contents);
+
+        return EXIT_SUCCESS;
+}
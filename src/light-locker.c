@@ -59,12 +59,15 @@ main (int    argc,
         static gboolean     lock_on_suspend;
         static gboolean     lock_on_lid;
         static gboolean     idle_hint;
+        static gboolean     standby_windows;
+        static gint         idle_time_max_age;
 
         static GOptionEntry entries []   = {
                 { "version", 0, 0, G_OPTION_ARG_NONE, &show_version, N_("Version of this application"), NULL },
                 { "debug", 0, 0, G_OPTION_ARG_NONE, &debug, N_("Enable debugging code"), NULL },
-#ifdef HAVE_MIT_SAVER_EXTENSION /* Remove the flag if this feature is not supported */
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION) /* Remove the flag if this feature is not supported */
                 { "lock-after-screensaver", 0, 0, G_OPTION_ARG_INT, &lock_after_screensaver, N_("Lock the screen S seconds after the screensaver started"), "S" },
+                { "idle-time-max-age", 0, 0, G_OPTION_ARG_INT, &idle_time_max_age, N_("Reuse the session idle time read from X for up to S seconds"), "S" },
 #ifdef WITH_LATE_LOCKING
                 { "late-locking", 0, 0, G_OPTION_ARG_NONE, &late_locking, N_("Lock the screen on screensaver deactivation"), NULL },
                 { "no-late-locking", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &late_locking, N_("Lock the screen on screensaver activation"), NULL },
@@ -80,6 +83,8 @@ main (int    argc,
 #endif
                 { "idle-hint", 0, 0, G_OPTION_ARG_NONE, &idle_hint, N_("Set idle hint during screensaver"), NULL },
                 { "no-idle-hint", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &idle_hint, N_("Let something else handle the idle hint"), NULL },
+                { "standby-windows", 0, 0, G_OPTION_ARG_NONE, &standby_windows, N_("Keep the lock windows ready between locks"), NULL },
+                { "no-standby-windows", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &standby_windows, N_("Create the lock windows only when locking"), NULL },
                 { NULL }
         };
 
@@ -96,6 +101,8 @@ main (int    argc,
                       "lock-after-screensaver", &lock_after_screensaver,
                       "lock-on-lid", &lock_on_lid,
                       "idle-hint", &idle_hint,
+                      "standby-windows", &standby_windows,
+                      "idle-time-max-age", &idle_time_max_age,
                       NULL);
 
 #ifndef WITH_LATE_LOCKING
@@ -132,6 +139,8 @@ main (int    argc,
                       "lock-after-screensaver", lock_after_screensaver,
                       "lock-on-lid", lock_on_lid,
                       "idle-hint", idle_hint,
+                      "standby-windows", standby_windows,
+                      "idle-time-max-age", idle_time_max_age,
                       NULL);
 
         gs_debug_init (debug, FALSE);
@@ -154,11 +163,17 @@ main (int    argc,
                   );
         gs_debug ("Features:\n"
                   "lock-after-screensaver: %s\n"
+                  "XSync idle alarms:      %s\n"
                   "late-locking:           %s\n"
                   "lock-on-suspend:        %s\n"
                   "lock-on-lid:            %s\n"
                   "settings backend:       %s",
-#ifdef HAVE_MIT_SAVER_EXTENSION
+#if defined(HAVE_MIT_SAVER_EXTENSION) || defined(HAVE_XSYNC_EXTENSION)
+                  "yes",
+#else
+                  "no",
+#endif
+#ifdef HAVE_XSYNC_EXTENSION
                   "yes",
 #else
                   "no",
@@ -190,6 +205,8 @@ main (int    argc,
         gs_debug ("lock on suspend %d", lock_on_suspend);
         gs_debug ("lock on lid %d", lock_on_lid);
         gs_debug ("idle hint %d", idle_hint);
+        gs_debug ("standby windows %d", standby_windows);
+        gs_debug ("idle time max age %d", idle_time_max_age);
 
         monitor = gs_monitor_new (conf);
 
@@ -18,6 +18,8 @@ enum
     PROP_LOCK_AFTER_SCREENSAVER,
     PROP_LOCK_ON_LID,
     PROP_IDLE_HINT,
+    PROP_STANDBY_WINDOWS,
+    PROP_IDLE_TIME_MAX_AGE,
     N_PROPERTIES
 };
 
@@ -36,10 +38,12 @@ struct _LLConfig
     GObject    parent_instance;
     GSettings *settings;
     guint      lock_after_screensaver;
+    guint      idle_time_max_age;
     gboolean   late_locking : 1;
     gboolean   lock_on_suspend : 1;
     gboolean   lock_on_lid : 1;
     gboolean   idle_hint : 1;
+    gboolean   standby_windows : 1;
 };
 
 G_DEFINE_TYPE (LLConfig, ll_config, G_TYPE_OBJECT)
@@ -84,6 +88,14 @@ static void ll_config_set_property (GObject      *object,
             conf->idle_hint = g_value_get_boolean(value);
             break;
 
+        case PROP_STANDBY_WINDOWS:
+            conf->standby_windows = g_value_get_boolean(value);
+            break;
+
+        case PROP_IDLE_TIME_MAX_AGE:
+            conf->idle_time_max_age = g_value_get_uint(value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -128,6 +140,14 @@ static void ll_config_get_property (GObject    *object,
             g_value_set_boolean(value, conf->idle_hint);
             break;
 
+        case PROP_STANDBY_WINDOWS:
+            g_value_set_boolean(value, conf->standby_windows);
+            break;
+
+        case PROP_IDLE_TIME_MAX_AGE:
+            g_value_set_uint(value, conf->idle_time_max_age);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -208,6 +228,30 @@ ll_config_class_init (LLConfigClass *klass)
                                   FALSE,
                                   G_PARAM_READWRITE);
 
+    /**
+     * LLConfig:standby-windows:
+     *
+     * Keep realized lock windows around between locks
+     **/
+    obj_properties[PROP_STANDBY_WINDOWS] =
+            g_param_spec_boolean ("standby-windows",
+                                  NULL,
+                                  NULL,
+                                  TRUE,
+                                  G_PARAM_READWRITE);
+
+    /**
+     * LLConfig:idle-time-max-age:
+     *
+     * Seconds an idle time read from the X server is extrapolated
+     **/
+    obj_properties[PROP_IDLE_TIME_MAX_AGE] =
+            g_param_spec_uint ("idle-time-max-age",
+                               NULL,
+                               NULL,
+                               0, 60, 5,
+                               G_PARAM_READWRITE);
+
     g_object_class_install_properties (object_class,
                                        N_PROPERTIES,
                                        obj_properties);
@@ -240,6 +284,8 @@ ll_config_init (LLConfig *conf)
     conf->lock_on_lid = WITH_LOCK_ON_LID;
 #endif
     conf->idle_hint = FALSE;
+    conf->standby_windows = TRUE;
+    conf->idle_time_max_age = 5;
 
 #ifdef WITH_SETTINGS_BACKEND
 #define GSETTINGS 1
@@ -65,6 +65,8 @@ main (int    argc,
         static gboolean     debug        = FALSE;
         static gint         width        = 640;
         static gint         height       = 480;
+        guint               hits;
+        guint               misses;
         static GOptionEntry entries []   = {
                 { "version", 0, 0, G_OPTION_ARG_NONE, &show_version, N_("Version of this application"), NULL },
                 { "debug", 0, 0, G_OPTION_ARG_NONE, &debug, N_("Enable debugging code"), NULL },
@@ -115,6 +117,11 @@ main (int    argc,
 
         gtk_main ();
 
+        content_get_cache_stats (&hits, &misses);
+        g_print ("content cache: %u hits, %u misses (%.1f%% hit rate)\n",
+                 hits, misses,
+                 hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+
         gs_debug ("preview finished");
 
         return 0;
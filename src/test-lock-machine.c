@@ -0,0 +1,252 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gs-lock-machine.h"
+
+/* Events are fed at synthetic times counted from when a new machine
+ * entered unlocked. */
+static gint64
+get_base (GSLockMachine *machine)
+{
+        return gs_lock_machine_get_entered (machine, GS_LOCK_STATE_UNLOCKED);
+}
+
+static void
+feed (GSLockMachine *machine,
+      gint64         base,
+      GSLockEvent    event,
+      gint64         at,
+      GSLockState    expected)
+{
+        g_assert_true (gs_lock_machine_feed_at (machine, event, base + at));
+        g_assert_cmpuint (gs_lock_machine_get_state (machine), ==, expected);
+}
+
+static void
+test_lock_cycle (void)
+{
+        GSLockMachine *machine = gs_lock_machine_new ();
+        gint64         base = get_base (machine);
+
+        g_assert_cmpuint (gs_lock_machine_get_state (machine), ==, GS_LOCK_STATE_UNLOCKED);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_UNLOCKED), ==, 1);
+
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 100, GS_LOCK_STATE_LOCKING);
+        feed (machine, base, GS_LOCK_EVENT_MAPPED, 300, GS_LOCK_STATE_LOCKED);
+        feed (machine, base, GS_LOCK_EVENT_HAND_OVER, 1300, GS_LOCK_STATE_HANDED_OVER);
+        feed (machine, base, GS_LOCK_EVENT_UNLOCK, 2300, GS_LOCK_STATE_UNLOCKED);
+
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_UNLOCKED), ==, 2);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_LOCKING), ==, 1);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_LOCKED), ==, 1);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_HANDED_OVER), ==, 1);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_DEFERRED), ==, 0);
+
+        g_assert_cmpint (gs_lock_machine_get_entered (machine, GS_LOCK_STATE_LOCKED), ==, base + 300);
+        g_assert_cmpint (gs_lock_machine_get_entered (machine, GS_LOCK_STATE_UNLOCKED), ==, base + 2300);
+        g_assert_cmpint (gs_lock_machine_get_entered (machine, GS_LOCK_STATE_DEFERRED), ==, 0);
+
+        /* The current stay counts up to now, the finished ones don't. */
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_LOCKING, base + 5000), ==, 200);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_LOCKED, base + 5000), ==, 1000);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_HANDED_OVER, base + 5000), ==, 1000);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_UNLOCKED, base + 5000), ==, 100 + 2700);
+
+        /* A second lock adds to the totals. */
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 6000, GS_LOCK_STATE_LOCKING);
+        feed (machine, base, GS_LOCK_EVENT_MAPPED, 6050, GS_LOCK_STATE_LOCKED);
+
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_LOCKED), ==, 2);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_LOCKING, base + 7000), ==, 250);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_LOCKED, base + 7000), ==, 1000 + 950);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_UNLOCKED, base + 7000), ==, 100 + 3700);
+
+        g_object_unref (machine);
+}
+
+static void
+test_ignored (void)
+{
+        GSLockMachine *machine = gs_lock_machine_new ();
+        gint64         base = get_base (machine);
+        GSLockEvent    events [] = {
+                GS_LOCK_EVENT_MAPPED,
+                GS_LOCK_EVENT_FAILED,
+                /* A deferral while unlocked is dropped on purpose. */
+                GS_LOCK_EVENT_DEFER,
+                GS_LOCK_EVENT_PROCEED,
+                GS_LOCK_EVENT_HAND_OVER,
+                GS_LOCK_EVENT_UNLOCK,
+        };
+        guint          i;
+
+        for (i = 0; i < G_N_ELEMENTS (events); i++) {
+                g_assert_false (gs_lock_machine_feed_at (machine, events [i], base + i));
+                g_assert_cmpuint (gs_lock_machine_get_state (machine), ==, GS_LOCK_STATE_UNLOCKED);
+        }
+
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_UNLOCKED), ==, 1);
+        g_assert_false (gs_lock_machine_get_deferred (machine));
+
+        /* Nothing can be handed over twice. */
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 100, GS_LOCK_STATE_LOCKING);
+        feed (machine, base, GS_LOCK_EVENT_HAND_OVER, 200, GS_LOCK_STATE_HANDED_OVER);
+        g_assert_false (gs_lock_machine_feed_at (machine, GS_LOCK_EVENT_HAND_OVER, base + 300));
+        g_assert_false (gs_lock_machine_feed_at (machine, GS_LOCK_EVENT_LOCK, base + 300));
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_HANDED_OVER), ==, 1);
+
+        g_object_unref (machine);
+}
+
+static void
+test_deferred (void)
+{
+        GSLockMachine *machine = gs_lock_machine_new ();
+        gint64         base = get_base (machine);
+
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 100, GS_LOCK_STATE_LOCKING);
+        feed (machine, base, GS_LOCK_EVENT_DEFER, 200, GS_LOCK_STATE_LOCKING_DEFERRED);
+        g_assert_true (gs_lock_machine_get_deferred (machine));
+
+        /* Proceeding before the windows are up goes back to locking. */
+        feed (machine, base, GS_LOCK_EVENT_PROCEED, 300, GS_LOCK_STATE_LOCKING);
+        g_assert_false (gs_lock_machine_get_deferred (machine));
+
+        feed (machine, base, GS_LOCK_EVENT_DEFER, 400, GS_LOCK_STATE_LOCKING_DEFERRED);
+        feed (machine, base, GS_LOCK_EVENT_MAPPED, 500, GS_LOCK_STATE_DEFERRED);
+        g_assert_true (gs_lock_machine_get_deferred (machine));
+
+        feed (machine, base, GS_LOCK_EVENT_PROCEED, 900, GS_LOCK_STATE_LOCKED);
+        g_assert_false (gs_lock_machine_get_deferred (machine));
+
+        feed (machine, base, GS_LOCK_EVENT_HAND_OVER, 1000, GS_LOCK_STATE_HANDED_OVER);
+        feed (machine, base, GS_LOCK_EVENT_DEFER, 1100, GS_LOCK_STATE_DEFERRED);
+
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_LOCKING), ==, 2);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_LOCKING_DEFERRED), ==, 2);
+        g_assert_cmpuint (gs_lock_machine_get_entries (machine, GS_LOCK_STATE_DEFERRED), ==, 2);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_LOCKING_DEFERRED, base + 2000), ==, 200);
+        g_assert_cmpint (gs_lock_machine_get_time_in (machine, GS_LOCK_STATE_DEFERRED, base + 2000), ==, 400 + 900);
+
+        feed (machine, base, GS_LOCK_EVENT_UNLOCK, 2000, GS_LOCK_STATE_UNLOCKED);
+        /* The lock screen failing to come up ends the lock. */
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 2100, GS_LOCK_STATE_LOCKING);
+        feed (machine, base, GS_LOCK_EVENT_FAILED, 2200, GS_LOCK_STATE_UNLOCKED);
+
+        g_object_unref (machine);
+}
+
+typedef struct {
+        guint  n;
+        gint64 times [128];
+        guint  n_ignored;
+} LogData;
+
+static void
+collect_log (const GSLockLogEntry *entry,
+             gpointer              user_data)
+{
+        LogData *data = user_data;
+
+        g_assert_cmpuint (data->n, <, G_N_ELEMENTS (data->times));
+
+        data->times [data->n++] = entry->time;
+        if (entry->ignored) {
+                g_assert_cmpuint (entry->from, ==, entry->to);
+                data->n_ignored++;
+        }
+}
+
+static void
+test_log (void)
+{
+        GSLockMachine *machine = gs_lock_machine_new ();
+        gint64         base = get_base (machine);
+        LogData        data = { 0, };
+
+        gs_lock_machine_foreach_log (machine, collect_log, &data);
+        g_assert_cmpuint (data.n, ==, 0);
+
+        feed (machine, base, GS_LOCK_EVENT_LOCK, 10, GS_LOCK_STATE_LOCKING);
+        g_assert_false (gs_lock_machine_feed_at (machine, GS_LOCK_EVENT_LOCK, base + 20));
+        feed (machine, base, GS_LOCK_EVENT_UNLOCK, 30, GS_LOCK_STATE_UNLOCKED);
+
+        gs_lock_machine_foreach_log (machine, collect_log, &data);
+        g_assert_cmpuint (data.n, ==, 3);
+        g_assert_cmpuint (data.n_ignored, ==, 1);
+        g_assert_cmpint (data.times [0], ==, base + 10);
+        g_assert_cmpint (data.times [1], ==, base + 20);
+        g_assert_cmpint (data.times [2], ==, base + 30);
+
+        g_object_unref (machine);
+}
+
+static void
+test_log_wraparound (void)
+{
+        GSLockMachine *machine = gs_lock_machine_new ();
+        gint64         base = get_base (machine);
+        LogData        data = { 0, };
+        guint          i;
+
+        /* 70 events, the first 6 fall out of the 64 kept. */
+        for (i = 0; i < 70; i++) {
+                gs_lock_machine_feed_at (machine,
+                                         i % 2 == 0 ? GS_LOCK_EVENT_LOCK : GS_LOCK_EVENT_UNLOCK,
+                                         base + i);
+        }
+
+        gs_lock_machine_foreach_log (machine, collect_log, &data);
+
+        g_assert_cmpuint (data.n, ==, 64);
+        for (i = 0; i < data.n; i++) {
+                g_assert_cmpint (data.times [i], ==, base + 6 + i);
+        }
+
+        g_object_unref (machine);
+}
+
+static void
+test_names (void)
+{
+        g_assert_cmpstr (gs_lock_state_name (GS_LOCK_STATE_LOCKING_DEFERRED), ==, "locking-deferred");
+        g_assert_cmpstr (gs_lock_state_name (GS_LOCK_STATE_HANDED_OVER), ==, "handed-over");
+        g_assert_cmpstr (gs_lock_event_name (GS_LOCK_EVENT_HAND_OVER), ==, "hand-over");
+        g_assert_cmpstr (gs_lock_event_name (GS_LOCK_EVENT_UNLOCK), ==, "unlock");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/lock-machine/lock-cycle", test_lock_cycle);
+        g_test_add_func ("/lock-machine/ignored", test_ignored);
+        g_test_add_func ("/lock-machine/deferred", test_deferred);
+        g_test_add_func ("/lock-machine/log", test_log);
+        g_test_add_func ("/lock-machine/log-wraparound", test_log_wraparound);
+        g_test_add_func ("/lock-machine/names", test_names);
+
+        return g_test_run ();
+}
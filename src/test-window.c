@@ -42,7 +42,9 @@ window_show_cb (GSWindow  *window,
         gs_grab_move_to_window (grab,
                                 gs_window_get_gdk_window (window),
                                 gs_window_get_screen (window),
-                                FALSE);
+                                FALSE,
+                                NULL,
+                                NULL);
 
 }
 